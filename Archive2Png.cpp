@@ -0,0 +1,317 @@
+// Extracts the frames of a capture archive, written by the plugin between StartArchive and
+// StopArchive, back into files.
+//
+//   Archive2Png <archive> [outputDirectory]
+//   Archive2Png --list <archive>
+//   Archive2Png --rebuild <archive>
+//   Archive2Png --benchmark <directory> [frames] [width] [height] [pngLevel]
+//
+// Frames go to the path they were captured for, or into outputDirectory under the same file
+// name. An archive that was never closed has no index; it is read by walking its records, and
+// --rebuild cuts off the incomplete last record and appends the index. --benchmark writes the
+// same encoded frame `frames` times as separate files and into an archive in directory, and
+// reports files per second for both.
+#include <windows.h>
+#include <io.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "ArchiveFormat.h"
+#include "CaptureArchive.h"
+#include "PngEncoder.h"
+#include "lodepng.h"
+
+struct Entry
+{
+	uint64_t offset;
+	ArchiveRecordHeader header;
+	std::string name;
+};
+
+
+//--------------------------------------------------------------------------------------
+static bool ReadAt(FILE* file, uint64_t offset, void* data, size_t size)
+{
+	return _fseeki64(file, (__int64)offset, SEEK_SET) == 0 && fread(data, 1, size, file) == size;
+}
+
+static uint64_t ArchiveFileSize(FILE* file)
+{
+	_fseeki64(file, 0, SEEK_END);
+	return (uint64_t)_ftelli64(file);
+}
+
+static bool IsValidHeader(const ArchiveRecordHeader& header, uint64_t offset, uint64_t fileSize)
+{
+	uint64_t dataEnd = header.dataOffset + header.dataSize;
+	return header.magic == kArchiveRecordMagic && dataEnd >= header.dataOffset && dataEnd <= fileSize
+		&& ((header.flags & kArchiveRecordLink) ? header.dataOffset < offset
+			: header.dataOffset == offset + sizeof(ArchiveRecordHeader) + header.nameLength);
+}
+
+// Reads the index the archive was closed with. Returns false when there is none.
+static bool ReadIndex(FILE* file, uint64_t fileSize, std::vector<Entry>& entries)
+{
+	ArchiveTrailer trailer;
+	if (fileSize < sizeof(ArchiveFileHeader) + sizeof(trailer)
+		|| !ReadAt(file, fileSize - sizeof(trailer), &trailer, sizeof(trailer))
+		|| trailer.magic != kArchiveIndexMagic || trailer.indexOffset > fileSize - sizeof(trailer))
+		return false;
+
+	if (_fseeki64(file, (__int64)trailer.indexOffset, SEEK_SET) != 0)
+		return false;
+	for (uint64_t i = 0; i < trailer.recordCount; ++i) {
+		Entry entry;
+		if (fread(&entry.offset, sizeof(entry.offset), 1, file) != 1
+			|| fread(&entry.header, sizeof(entry.header), 1, file) != 1
+			|| !IsValidHeader(entry.header, entry.offset, trailer.indexOffset))
+			return false;
+		entry.name.resize(entry.header.nameLength);
+		if (entry.header.nameLength > 0 && fread(&entry.name[0], 1, entry.name.size(), file) != entry.name.size())
+			return false;
+		entries.push_back(entry);
+	}
+	return true;
+}
+
+// Walks the records from the start up to the first incomplete one. Returns where it ends.
+static uint64_t ScanRecords(FILE* file, uint64_t fileSize, std::vector<Entry>& entries)
+{
+	uint64_t offset = sizeof(ArchiveFileHeader);
+	for (;;) {
+		Entry entry;
+		entry.offset = offset;
+		if (offset + sizeof(ArchiveRecordHeader) > fileSize || !ReadAt(file, offset, &entry.header, sizeof(entry.header))
+			|| !IsValidHeader(entry.header, offset, fileSize))
+			break;
+		uint64_t end = offset + sizeof(ArchiveRecordHeader) + entry.header.nameLength;
+		if (!(entry.header.flags & kArchiveRecordLink))
+			end += entry.header.dataSize;
+		if (end > fileSize)
+			break;
+		entry.name.resize(entry.header.nameLength);
+		if (entry.header.nameLength > 0 && fread(&entry.name[0], 1, entry.name.size(), file) != entry.name.size())
+			break;
+		entries.push_back(entry);
+		offset = end;
+	}
+	return offset;
+}
+
+static FILE* OpenArchive(const char* path, const char* mode, std::vector<Entry>& entries, bool& indexed,
+						 uint64_t& recordsEnd)
+{
+	FILE* file = fopen(path, mode);
+	if (!file) {
+		fprintf(stderr, "%s: can't open\n", path);
+		return NULL;
+	}
+	ArchiveFileHeader header;
+	uint64_t fileSize = ArchiveFileSize(file);
+	if (!ReadAt(file, 0, &header, sizeof(header)) || header.magic != kArchiveFileMagic
+		|| header.version != kArchiveVersion) {
+		fprintf(stderr, "%s: not a capture archive\n", path);
+		fclose(file);
+		return NULL;
+	}
+	indexed = ReadIndex(file, fileSize, entries);
+	if (!indexed) {
+		entries.clear();
+		recordsEnd = ScanRecords(file, fileSize, entries);
+	}
+	std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+		return a.header.sequence < b.header.sequence;
+	});
+	return file;
+}
+
+
+//--------------------------------------------------------------------------------------
+static std::string GetOutputPath(const std::string& path, const std::string& outputDirectory)
+{
+	if (outputDirectory.empty())
+		return path;
+	size_t slash = path.find_last_of("/\\");
+	std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+	return outputDirectory + "\\" + name;
+}
+
+static int Extract(const char* archivePath, const std::string& outputDirectory)
+{
+	std::vector<Entry> entries;
+	bool indexed;
+	uint64_t recordsEnd;
+	FILE* file = OpenArchive(archivePath, "rb", entries, indexed, recordsEnd);
+	if (!file)
+		return 1;
+	if (!indexed)
+		fprintf(stderr, "%s: no index, read %u records\n", archivePath, (unsigned)entries.size());
+
+	int written = 0, failed = 0;
+	std::vector<unsigned char> data;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		const Entry& entry = entries[i];
+		std::string path = GetOutputPath(entry.name, outputDirectory);
+		data.resize((size_t)entry.header.dataSize);
+		if ((data.empty() || ReadAt(file, entry.header.dataOffset, &data[0], data.size()))
+			&& lodepng::save_file(data, path) == 0) {
+			++written;
+		} else {
+			fprintf(stderr, "%s: could not write frame %lld\n", path.c_str(), (long long)entry.header.sequence);
+			++failed;
+		}
+	}
+	fclose(file);
+
+	printf("%d written, %d failed\n", written, failed);
+	return failed > 0 ? 1 : 0;
+}
+
+static int List(const char* archivePath)
+{
+	std::vector<Entry> entries;
+	bool indexed;
+	uint64_t recordsEnd;
+	FILE* file = OpenArchive(archivePath, "rb", entries, indexed, recordsEnd);
+	if (!file)
+		return 1;
+	fclose(file);
+
+	for (size_t i = 0; i < entries.size(); ++i) {
+		const Entry& entry = entries[i];
+		printf("%8lld %12llu %s%s\n", (long long)entry.header.sequence, (unsigned long long)entry.header.dataSize,
+			entry.name.c_str(), (entry.header.flags & kArchiveRecordLink) ? " (link)" : "");
+	}
+	printf("%u records%s\n", (unsigned)entries.size(), indexed ? "" : ", no index");
+	return 0;
+}
+
+static int Rebuild(const char* archivePath)
+{
+	std::vector<Entry> entries;
+	bool indexed;
+	uint64_t recordsEnd;
+	FILE* file = OpenArchive(archivePath, "r+b", entries, indexed, recordsEnd);
+	if (!file)
+		return 1;
+	if (indexed) {
+		printf("%s: already indexed, %u records\n", archivePath, (unsigned)entries.size());
+		fclose(file);
+		return 0;
+	}
+
+	// The index of a closed archive lists records in file order
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.offset < b.offset; });
+	ArchiveTrailer trailer;
+	trailer.magic = kArchiveIndexMagic;
+	trailer.reserved = 0;
+	trailer.indexOffset = recordsEnd;
+	trailer.recordCount = entries.size();
+	bool ok = _fseeki64(file, (__int64)recordsEnd, SEEK_SET) == 0;
+	for (size_t i = 0; i < entries.size() && ok; ++i) {
+		const Entry& entry = entries[i];
+		ok = fwrite(&entry.offset, sizeof(entry.offset), 1, file) == 1
+			&& fwrite(&entry.header, sizeof(entry.header), 1, file) == 1
+			&& fwrite(entry.name.data(), 1, entry.name.size(), file) == entry.name.size();
+	}
+	ok = ok && fwrite(&trailer, sizeof(trailer), 1, file) == 1 && fflush(file) == 0;
+	// Anything after the index is what was left of the incomplete record
+	ok = ok && _chsize_s(_fileno(file), _ftelli64(file)) == 0;
+	fclose(file);
+
+	if (!ok) {
+		fprintf(stderr, "%s: could not write the index\n", archivePath);
+		return 1;
+	}
+	printf("%s: indexed %u records\n", archivePath, (unsigned)entries.size());
+	return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+static double Seconds(const LARGE_INTEGER& start, const LARGE_INTEGER& end)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return (double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+}
+
+static int Benchmark(const std::string& directory, int frames, unsigned width, unsigned height, int level)
+{
+	// A gradient with some noise, so the PNG is a realistic size rather than a few bytes
+	std::vector<uint8_t> pixels((size_t)width * height * 4);
+	for (size_t i = 0; i < pixels.size(); ++i)
+		pixels[i] = (uint8_t)((i / 4 % width) + (i / 4 / width) + (rand() & 15));
+	std::vector<unsigned char> png;
+	if (!EncodePng(&pixels[0], width, height, kPixelRGBA8, png, level)) {
+		fprintf(stderr, "could not encode the benchmark frame\n");
+		return 1;
+	}
+
+	char name[MAX_PATH];
+	LARGE_INTEGER start, end;
+	QueryPerformanceCounter(&start);
+	for (int i = 0; i < frames; ++i) {
+		sprintf_s(name, "%s\\frame%06d.png", directory.c_str(), i);
+		if (lodepng::save_file(png, name) != 0) {
+			fprintf(stderr, "%s: could not write\n", name);
+			return 1;
+		}
+	}
+	QueryPerformanceCounter(&end);
+	double filesSeconds = Seconds(start, end);
+
+	CaptureArchive archive;
+	std::string archivePath = directory + "\\frames.pack";
+	QueryPerformanceCounter(&start);
+	bool ok = archive.Open(archivePath);
+	for (int i = 0; i < frames && ok; ++i) {
+		sprintf_s(name, "%s\\frame%06d.png", directory.c_str(), i);
+		ok = archive.Append(name, &png[0], png.size(), i, 0);
+	}
+	archive.Close();
+	QueryPerformanceCounter(&end);
+	double archiveSeconds = Seconds(start, end);
+	if (!ok) {
+		fprintf(stderr, "%s: could not write\n", archivePath.c_str());
+		return 1;
+	}
+
+	printf("%d frames of %u bytes\n", frames, (unsigned)png.size());
+	printf("files:   %10.1f files/s, %8.1f MB/s\n", frames / filesSeconds, frames * (double)png.size() / filesSeconds / 1e6);
+	printf("archive: %10.1f files/s, %8.1f MB/s\n", frames / archiveSeconds, frames * (double)png.size() / archiveSeconds / 1e6);
+	return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	if (argc >= 3 && strcmp(argv[1], "--list") == 0)
+		return List(argv[2]);
+	if (argc >= 3 && strcmp(argv[1], "--rebuild") == 0)
+		return Rebuild(argv[2]);
+	if (argc >= 3 && strcmp(argv[1], "--benchmark") == 0) {
+		int frames = argc > 3 ? atoi(argv[3]) : 10000;
+		unsigned width = argc > 4 ? (unsigned)atoi(argv[4]) : 256;
+		unsigned height = argc > 5 ? (unsigned)atoi(argv[5]) : 256;
+		int level = argc > 6 ? atoi(argv[6]) : kPngDefaultLevel;
+		if (frames <= 0 || width == 0 || height == 0) {
+			fprintf(stderr, "frames, width and height must be positive\n");
+			return 2;
+		}
+		return Benchmark(argv[2], frames, width, height, level);
+	}
+	if (argc < 2 || argv[1][0] == '-') {
+		fprintf(stderr, "usage: Archive2Png <archive> [outputDirectory]\n"
+			"       Archive2Png --list <archive>\n"
+			"       Archive2Png --rebuild <archive>\n"
+			"       Archive2Png --benchmark <directory> [frames] [width] [height] [pngLevel]\n");
+		return 2;
+	}
+	return Extract(argv[1], argc > 2 ? argv[2] : std::string());
+}
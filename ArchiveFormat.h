@@ -0,0 +1,53 @@
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#pragma warning(push)
+#pragma warning(disable : 4005)
+#include <stdint.h>
+#pragma warning(pop)
+
+// On-disk layout of a capture archive, shared by the plugin's CaptureArchive and Archive2Png.
+//
+// An archive is one file: an ArchiveFileHeader, then a record per frame in the order the frames
+// were written, then, once the archive is closed, the index and an ArchiveTrailer as its last
+// bytes. A record is an ArchiveRecordHeader, the frame's file path (not terminated) and the
+// contents of that file. A link record carries no contents; its header points at the contents of
+// an earlier record. The index holds, for every record, its offset followed by a copy of its
+// header and path. An archive without a trailer, left by a crash, is read by walking the records
+// from the start up to the first incomplete one. Everything is little-endian.
+
+static const uint32_t kArchiveFileMagic = 0x4B434150;   // "PACK"
+static const uint32_t kArchiveRecordMagic = 0x43455250; // "PREC"
+static const uint32_t kArchiveIndexMagic = 0x58444E49;  // "INDX"
+static const uint32_t kArchiveVersion = 1;
+
+// ArchiveRecordHeader::flags
+static const uint32_t kArchiveRecordLink = 1;
+
+struct ArchiveFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t timestampFrequency; // ticks per second of ArchiveRecordHeader::timestamp
+};
+
+struct ArchiveRecordHeader
+{
+	uint32_t magic;
+	uint32_t flags;
+	int64_t sequence;
+	int64_t timestamp;   // QueryPerformanceCounter when the capture was queued
+	uint64_t dataOffset; // from the start of the file; a link's is that of the record it repeats
+	uint64_t dataSize;
+	uint32_t nameLength;
+	uint32_t reserved;
+};
+
+struct ArchiveTrailer
+{
+	uint32_t magic;
+	uint32_t reserved;
+	uint64_t indexOffset;
+	uint64_t recordCount;
+};
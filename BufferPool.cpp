@@ -0,0 +1,107 @@
+#include "BufferPool.h"
+
+#include <malloc.h>
+
+// Every buffer starts with this header; the caller's pointer is kBufferHeaderSize bytes in,
+// which keeps it on a cache line boundary
+struct BufferHeader
+{
+	SLIST_ENTRY entry;
+	size_t sizeClass;
+	size_t capacity;
+};
+
+static const size_t kBufferAlignment = 64;
+static const size_t kBufferHeaderSize = 64;
+static const size_t kMinBufferSize = 64 * 1024;
+static const size_t kPageSize = 4096;
+static const size_t kSizeClassCount = 4 * 64;
+
+static SLIST_HEADER sizeClasses[kSizeClassCount];
+static volatile LONG64 poolHits = 0;
+static volatile LONG64 poolMisses = 0;
+
+static bool InitializeSizeClasses()
+{
+	for (size_t i = 0; i < kSizeClassCount; ++i)
+		InitializeSListHead(&sizeClasses[i]);
+	return true;
+}
+static bool sizeClassesInitialized = InitializeSizeClasses();
+
+// Rounds size up to its class: four steps between consecutive powers of two
+static size_t GetSizeClass(size_t size, size_t* capacity)
+{
+	size_t v = (size < kMinBufferSize ? kMinBufferSize : size) - 1;
+	size_t log2 = 0;
+	while ((v >> log2) > 1)
+		++log2;
+
+	size_t shift = log2 - 2;
+	size_t step = v >> shift; // 4..7
+	*capacity = (step + 1) << shift;
+	return log2 * 4 + (step - 4);
+}
+
+
+//--------------------------------------------------------------------------------------
+uint8_t* AcquirePixelBuffer(size_t size)
+{
+	size_t capacity;
+	size_t sizeClass = GetSizeClass(size, &capacity);
+
+	BufferHeader* header = reinterpret_cast<BufferHeader*>( InterlockedPopEntrySList( &sizeClasses[sizeClass] ) );
+	if (header)
+	{
+		InterlockedIncrement64(&poolHits);
+		return reinterpret_cast<uint8_t*>(header) + kBufferHeaderSize;
+	}
+
+	InterlockedIncrement64(&poolMisses);
+	uint8_t* memory = static_cast<uint8_t*>( _aligned_malloc( kBufferHeaderSize + capacity, kBufferAlignment ) );
+	if (!memory)
+		return NULL;
+
+	// Fault every page in now, on first allocation, rather than while copying a frame
+	for (size_t offset = 0; offset < kBufferHeaderSize + capacity; offset += kPageSize)
+		memory[offset] = 0;
+	memory[kBufferHeaderSize + capacity - 1] = 0;
+
+	header = reinterpret_cast<BufferHeader*>(memory);
+	header->sizeClass = sizeClass;
+	header->capacity = capacity;
+	return memory + kBufferHeaderSize;
+}
+
+void ReleasePixelBuffer(uint8_t* buffer)
+{
+	if (!buffer)
+		return;
+
+	BufferHeader* header = reinterpret_cast<BufferHeader*>( buffer - kBufferHeaderSize );
+	InterlockedPushEntrySList( &sizeClasses[header->sizeClass], &header->entry );
+}
+
+void TrimPixelBufferPool()
+{
+	for (size_t i = 0; i < kSizeClassCount; ++i)
+	{
+		SLIST_ENTRY* entry = InterlockedFlushSList( &sizeClasses[i] );
+		while (entry)
+		{
+			SLIST_ENTRY* next = entry->Next;
+			_aligned_free(entry);
+			entry = next;
+		}
+	}
+}
+
+LONG64 GetPixelBufferPoolHits()
+{
+	return poolHits;
+}
+
+LONG64 GetPixelBufferPoolMisses()
+{
+	return poolMisses;
+}
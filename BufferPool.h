@@ -0,0 +1,61 @@
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <windows.h>
+#include <stdint.h>
+
+// Size-classed pool of pixel buffers shared by the render thread and the encoder workers.
+// Buffers are 64-byte aligned and have every page touched before first use, so a recycled
+// buffer costs neither a heap allocation nor page faults. Requests are rounded up to one of
+// four classes per power of two, wasting at most a quarter of the buffer.
+
+// Returns a buffer of at least `size` bytes, or NULL if memory is exhausted
+uint8_t* AcquirePixelBuffer(size_t size);
+
+// Returns a buffer from AcquirePixelBuffer to its size class; NULL is ignored
+void ReleasePixelBuffer(uint8_t* buffer);
+
+// Frees every idle buffer held by the pool
+void TrimPixelBufferPool();
+
+// Acquires served from an idle buffer, and those that had to allocate
+LONG64 GetPixelBufferPoolHits();
+LONG64 GetPixelBufferPoolMisses();
+
+// Move-only owner of a pooled buffer; the buffer goes back to the pool when the owner dies
+class PixelBuffer
+{
+public:
+	PixelBuffer() : data(NULL), size(0) {}
+	explicit PixelBuffer(size_t bytes) : data(AcquirePixelBuffer(bytes)), size(data ? bytes : 0) {}
+	PixelBuffer(PixelBuffer&& other) : data(other.data), size(other.size)
+	{
+		other.data = NULL;
+		other.size = 0;
+	}
+	~PixelBuffer() { ReleasePixelBuffer(data); }
+
+	PixelBuffer& operator=(PixelBuffer&& other)
+	{
+		if (this != &other)
+		{
+			ReleasePixelBuffer(data);
+			data = other.data;
+			size = other.size;
+			other.data = NULL;
+			other.size = 0;
+		}
+		return *this;
+	}
+
+	uint8_t* Get() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+	uint8_t* data;
+	size_t size;
+
+	PixelBuffer(const PixelBuffer&);
+	PixelBuffer& operator=(const PixelBuffer&);
+};
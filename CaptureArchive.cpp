@@ -0,0 +1,158 @@
+#include "CaptureArchive.h"
+
+#include <string.h>
+#include <algorithm>
+
+//--------------------------------------------------------------------------------------
+CaptureArchive::CaptureArchive()
+	: file(INVALID_HANDLE_VALUE), endOffset(0)
+{
+	InitializeCriticalSection(&lock);
+}
+
+CaptureArchive::~CaptureArchive()
+{
+	Close();
+	DeleteCriticalSection(&lock);
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CaptureArchive::Open(const std::string& path)
+{
+	Close();
+
+	EnterCriticalSection(&lock);
+	file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	bool ok = file != INVALID_HANDLE_VALUE;
+	if (ok) {
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		ArchiveFileHeader header;
+		header.magic = kArchiveFileMagic;
+		header.version = kArchiveVersion;
+		header.timestampFrequency = (uint64_t)frequency.QuadPart;
+		endOffset = 0;
+		ok = Write(&header, sizeof(header));
+		endOffset = sizeof(header);
+	}
+	LeaveCriticalSection(&lock);
+
+	if (!ok)
+		Close();
+	return ok;
+}
+
+void CaptureArchive::Close()
+{
+	EnterCriticalSection(&lock);
+	if (file != INVALID_HANDLE_VALUE) {
+		// The index goes where the next record would have, so a crash while writing it still
+		// leaves every record readable
+		ArchiveTrailer trailer;
+		trailer.magic = kArchiveIndexMagic;
+		trailer.reserved = 0;
+		trailer.indexOffset = endOffset;
+		trailer.recordCount = entries.size();
+		bool ok = true;
+		for (size_t i = 0; i < entries.size() && ok; ++i) {
+			const Entry& entry = entries[i];
+			ok = Write(&entry.offset, sizeof(entry.offset)) && Write(&entry.header, sizeof(entry.header))
+				&& Write(entry.name.data(), entry.name.size());
+		}
+		if (ok)
+			Write(&trailer, sizeof(trailer));
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+	entries.clear();
+	entryBySequence.clear();
+	LeaveCriticalSection(&lock);
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CaptureArchive::Append(const std::string& name, const void* data, size_t size, int64_t sequence, int64_t timestamp)
+{
+	Entry entry;
+	memset(&entry.header, 0, sizeof(entry.header));
+	entry.header.magic = kArchiveRecordMagic;
+	entry.header.sequence = sequence;
+	entry.header.timestamp = timestamp;
+	entry.header.dataSize = size;
+	entry.header.nameLength = (uint32_t)name.size();
+	entry.name = name;
+
+	EnterCriticalSection(&lock);
+	bool ok = AddRecord(entry, data);
+	LeaveCriticalSection(&lock);
+	return ok;
+}
+
+bool CaptureArchive::AppendLink(const std::string& name, int64_t originalSequence, int64_t sequence,
+								int64_t timestamp)
+{
+	EnterCriticalSection(&lock);
+	auto original = entryBySequence.find(originalSequence);
+	bool ok = original != entryBySequence.end();
+	if (ok) {
+		Entry entry;
+		entry.header = entries[original->second].header;
+		entry.header.flags = kArchiveRecordLink;
+		entry.header.sequence = sequence;
+		entry.header.timestamp = timestamp;
+		entry.header.nameLength = (uint32_t)name.size();
+		entry.name = name;
+		ok = AddRecord(entry, NULL);
+	}
+	LeaveCriticalSection(&lock);
+	return ok;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Called with the lock held. The data of a link is left out; the others get their dataOffset here.
+bool CaptureArchive::AddRecord(Entry& entry, const void* data)
+{
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	entry.offset = endOffset;
+	uint64_t end = endOffset + sizeof(ArchiveRecordHeader) + entry.name.size();
+	if (!(entry.header.flags & kArchiveRecordLink)) {
+		entry.header.dataOffset = end;
+		end += entry.header.dataSize;
+	}
+
+	bool ok = Write(&entry.header, sizeof(entry.header)) && Write(entry.name.data(), entry.name.size());
+	if (ok && !(entry.header.flags & kArchiveRecordLink))
+		ok = Write(data, (size_t)entry.header.dataSize);
+	if (!ok) {
+		// Back to the end of the last complete record, the next one overwrites what got written
+		LARGE_INTEGER position;
+		position.QuadPart = (LONGLONG)endOffset;
+		SetFilePointerEx(file, position, NULL, FILE_BEGIN);
+		SetEndOfFile(file);
+		return false;
+	}
+
+	endOffset = end;
+	entryBySequence[entry.header.sequence] = entries.size();
+	entries.push_back(entry);
+	return true;
+}
+
+bool CaptureArchive::Write(const void* data, size_t size)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	while (size > 0) {
+		DWORD chunk = (DWORD)std::min<size_t>(size, 1u << 30);
+		DWORD written = 0;
+		if (!WriteFile(file, bytes, chunk, &written, NULL) || written != chunk)
+			return false;
+		bytes += chunk;
+		size -= chunk;
+	}
+	return true;
+}
@@ -0,0 +1,56 @@
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <windows.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ArchiveFormat.h"
+
+// Appends encoded frames to a single archive file (see ArchiveFormat.h) instead of creating a
+// file per frame, which costs more in file system metadata than in data once there are tens of
+// thousands of small frames. The index is written when the archive closes; Archive2Png extracts
+// the frames and rebuilds the index of an archive that was never closed.
+class CaptureArchive
+{
+public:
+	CaptureArchive();
+	~CaptureArchive();
+
+	// Creates the archive at path, closing any archive already open
+	bool Open(const std::string& path);
+
+	// Writes the index and closes the file
+	void Close();
+
+	// Appends the contents of the file frame `sequence` would have been written to as name
+	bool Append(const std::string& name, const void* data, size_t size, int64_t sequence, int64_t timestamp);
+
+	// Appends a record for name that shares the contents of the record of frame originalSequence.
+	// Returns false when there is no such record.
+	bool AppendLink(const std::string& name, int64_t originalSequence, int64_t sequence, int64_t timestamp);
+
+	bool IsOpen() const { return file != INVALID_HANDLE_VALUE; }
+
+private:
+	struct Entry
+	{
+		uint64_t offset;
+		ArchiveRecordHeader header;
+		std::string name;
+	};
+
+	bool AddRecord(Entry& entry, const void* data);
+	bool Write(const void* data, size_t size);
+
+	CRITICAL_SECTION lock;
+	HANDLE file;
+	uint64_t endOffset;
+	std::vector<Entry> entries;
+	std::map<int64_t, size_t> entryBySequence;
+
+	CaptureArchive(const CaptureArchive&);
+	CaptureArchive& operator=(const CaptureArchive&);
+};
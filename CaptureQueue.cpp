@@ -0,0 +1,128 @@
+#include "CaptureQueue.h"
+
+#include <limits.h>
+
+//--------------------------------------------------------------------------------------
+CaptureQueue::CaptureQueue(size_t capacity)
+{
+	size_t size = 2;
+	while (size < capacity)
+		size <<= 1;
+
+	cells = new Cell[size];
+	mask = size - 1;
+	for (size_t i = 0; i < size; ++i)
+		cells[i].sequence = (LONG64)i;
+
+	available = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+	closed = 0;
+	enqueuePos = 0;
+	dequeuePos = 0;
+}
+
+CaptureQueue::~CaptureQueue()
+{
+	CloseHandle(available);
+	delete[] cells;
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CaptureQueue::Push(TextureInfo& item)
+{
+	LONG64 pos = enqueuePos;
+	Cell* cell;
+	for (;;)
+	{
+		cell = &cells[pos & mask];
+		LONG64 diff = cell->sequence - pos;
+		if (diff == 0)
+		{
+			// The slot is free for this lap; claim it. With a single producer this never retries
+			LONG64 prev = InterlockedCompareExchange64(&enqueuePos, pos + 1, pos);
+			if (prev == pos)
+				break;
+			pos = prev;
+		}
+		else if (diff < 0)
+		{
+			// The consumer has not released this slot yet, the ring is full
+			return false;
+		}
+		else
+		{
+			pos = enqueuePos;
+		}
+	}
+
+	cell->data = std::move(item);
+	InterlockedExchange64(&cell->sequence, pos + 1);
+	ReleaseSemaphore(available, 1, NULL);
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CaptureQueue::TryPop(TextureInfo& item)
+{
+	LONG64 pos = dequeuePos;
+	Cell* cell;
+	for (;;)
+	{
+		cell = &cells[pos & mask];
+		LONG64 diff = cell->sequence - (pos + 1);
+		if (diff == 0)
+		{
+			LONG64 prev = InterlockedCompareExchange64(&dequeuePos, pos + 1, pos);
+			if (prev == pos)
+				break;
+			pos = prev;
+		}
+		else if (diff < 0)
+		{
+			return false;
+		}
+		else
+		{
+			pos = dequeuePos;
+		}
+	}
+
+	item = std::move(cell->data);
+	InterlockedExchange64(&cell->sequence, pos + mask + 1);
+	return true;
+}
+
+bool CaptureQueue::Take(TextureInfo& item)
+{
+	// Each semaphore count matches one published frame, but a producer that claimed an
+	// earlier slot may still be filling it in; the frame shows up within a few instructions.
+	while (!TryPop(item))
+	{
+		if (closed)
+			return false;
+		SwitchToThread();
+	}
+	return true;
+}
+
+bool CaptureQueue::Pop(TextureInfo& item)
+{
+	if (WaitForSingleObject(available, INFINITE) != WAIT_OBJECT_0)
+		return false;
+	return Take(item);
+}
+
+bool CaptureQueue::Steal(TextureInfo& item)
+{
+	// Take the frame's semaphore count as well, or a consumer would wake up to an empty ring
+	if (WaitForSingleObject(available, 0) != WAIT_OBJECT_0)
+		return false;
+	return Take(item);
+}
+
+void CaptureQueue::Close()
+{
+	if (InterlockedExchange(&closed, 1) == 0)
+		ReleaseSemaphore(available, (LONG)(mask + 1), NULL);
+}
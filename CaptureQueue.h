@@ -0,0 +1,56 @@
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <windows.h>
+
+#include "ScreenGrab.h"
+
+// Bounded multi-producer queue of captured frames, handed from the render thread to the writer.
+// Based on Dmitry Vyukov's bounded MPMC ring: every cell carries a sequence number, so producers
+// claim a slot with a single compare-exchange and never take a lock. Consumers sleep on a
+// semaphore that counts published frames instead of polling.
+class CaptureQueue
+{
+public:
+	// capacity is rounded up to a power of two
+	explicit CaptureQueue(size_t capacity);
+	~CaptureQueue();
+
+	// Moves item into the ring. Returns false without blocking when the ring is full, leaving
+	// item with the caller
+	bool Push(TextureInfo& item);
+
+	// Blocks until a frame is available. Returns false once the queue is closed and drained
+	bool Pop(TextureInfo& item);
+
+	// Takes the oldest frame without blocking, so a producer can make room under backpressure
+	bool Steal(TextureInfo& item);
+
+	// Wakes every waiting consumer; Pop keeps returning the remaining frames, then false
+	void Close();
+
+	size_t Capacity() const { return mask + 1; }
+
+private:
+	struct Cell
+	{
+		volatile LONG64 sequence;
+		TextureInfo data;
+	};
+
+	bool TryPop(TextureInfo& item);
+	bool Take(TextureInfo& item);
+
+	Cell* cells;
+	size_t mask;
+	HANDLE available;
+	volatile LONG closed;
+
+	// Producer and consumer cursors live on separate cache lines
+	__declspec(align(64)) volatile LONG64 enqueuePos;
+	__declspec(align(64)) volatile LONG64 dequeuePos;
+
+	CaptureQueue(const CaptureQueue&);
+	CaptureQueue& operator=(const CaptureQueue&);
+};
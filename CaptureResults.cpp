@@ -0,0 +1,152 @@
+#include "CaptureResults.h"
+
+//--------------------------------------------------------------------------------------
+CaptureResults::Result& CaptureResults::Result::operator=(Result&& other)
+{
+	if (this != &other)
+	{
+		pixels = std::move(other.pixels);
+		encoded = std::move(other.encoded);
+		path.swap(other.path);
+		sequence = other.sequence;
+		width = other.width;
+		height = other.height;
+		rowPitch = other.rowPitch;
+		layout = other.layout;
+		duplicateOf = other.duplicateOf;
+	}
+	return *this;
+}
+
+const void* CaptureResults::Result::Data() const
+{
+	return pixels.Get() != NULL ? (const void*)pixels.Get() : (const void*)encoded.Data();
+}
+
+size_t CaptureResults::Result::Size() const
+{
+	return pixels.Get() != NULL ? pixels.Size() : encoded.size;
+}
+
+
+//--------------------------------------------------------------------------------------
+CaptureResults::CaptureResults()
+{
+	InitializeCriticalSection(&lock);
+}
+
+CaptureResults::~CaptureResults()
+{
+	DeleteCriticalSection(&lock);
+}
+
+
+//--------------------------------------------------------------------------------------
+void CaptureResults::AddPixels(TextureInfo& frame)
+{
+	if (frame.pixels.Get() == NULL)
+		return;
+
+	Result result;
+	result.pixels = std::move(frame.pixels);
+	result.path = frame.filePath;
+	result.sequence = frame.sequence;
+	result.width = frame.width;
+	result.height = frame.height;
+	result.rowPitch = frame.rowPitch;
+	result.layout = frame.layout;
+
+	EnterCriticalSection(&lock);
+	completed.push_back(std::move(result));
+	LeaveCriticalSection(&lock);
+}
+
+void CaptureResults::AddEncoded(const TextureInfo& frame, EncodedFrame& encoded)
+{
+	if (encoded.Data() == NULL || encoded.size == 0)
+		return;
+
+	Result result;
+	result.encoded = std::move(encoded);
+	result.path = frame.filePath;
+	result.sequence = frame.sequence;
+	result.width = frame.width;
+	result.height = frame.height;
+	result.rowPitch = 0;
+	result.layout = frame.layout;
+
+	EnterCriticalSection(&lock);
+	completed.push_back(std::move(result));
+	LeaveCriticalSection(&lock);
+}
+
+void CaptureResults::AddDuplicate(const TextureInfo& frame)
+{
+	Result result;
+	result.path = frame.filePath;
+	result.sequence = frame.sequence;
+	result.width = frame.width;
+	result.height = frame.height;
+	result.rowPitch = 0;
+	result.layout = frame.layout;
+	result.duplicateOf = frame.duplicateOfSequence;
+
+	EnterCriticalSection(&lock);
+	completed.push_back(std::move(result));
+	LeaveCriticalSection(&lock);
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CaptureResults::Poll(CaptureResultInfo& info)
+{
+	EnterCriticalSection(&lock);
+	bool found = !completed.empty();
+	if (found) {
+		const void* data = completed.front().Data();
+		// Nothing to lend for a duplicate; it is kept until the next Poll so its path stays valid
+		Result& result = data == NULL ? (polledDuplicate = std::move(completed.front()))
+			: lent.insert(std::make_pair(data, std::move(completed.front()))).first->second;
+		completed.pop_front();
+
+		info.data = data;
+		info.path = result.path.c_str();
+		info.size = (long long)result.Size();
+		info.sequence = result.sequence;
+		info.width = (int)result.width;
+		info.height = (int)result.height;
+		info.rowPitch = (int)result.rowPitch;
+		info.layout = result.pixels.Get() != NULL ? (int)result.layout : -1;
+		info.duplicateOf = result.duplicateOf;
+	}
+	LeaveCriticalSection(&lock);
+	return found;
+}
+
+size_t CaptureResults::Release(const void* data)
+{
+	size_t size = 0;
+	EnterCriticalSection(&lock);
+	auto it = lent.find(data);
+	if (it != lent.end()) {
+		size = it->second.Size();
+		lent.erase(it);
+	}
+	LeaveCriticalSection(&lock);
+	return size;
+}
+
+size_t CaptureResults::Clear()
+{
+	size_t size = 0;
+	EnterCriticalSection(&lock);
+	for (size_t i = 0; i < completed.size(); ++i)
+		size += completed[i].Size();
+	for (auto it = lent.begin(); it != lent.end(); ++it)
+		size += it->second.Size();
+	completed.clear();
+	lent.clear();
+	polledDuplicate = Result();
+	LeaveCriticalSection(&lock);
+	return size;
+}
@@ -0,0 +1,122 @@
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <windows.h>
+#include <stdlib.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "ScreenGrab.h"
+
+// What PollCaptureResult hands to the application. Mirrored field for field on the C# side.
+// A duplicate has no data; its path stays valid until the next poll.
+struct CaptureResultInfo
+{
+	const void* data;  // valid until the result is released
+	const char* path;  // the path the frame was captured for, valid as long as data
+	long long size;
+	long long sequence;
+	int width;
+	int height;
+	int rowPitch;      // of pixel results; 0 for encoded ones
+	int layout;        // PixelLayout of pixel results; -1 for encoded ones
+	long long duplicateOf; // sequence of the frame a duplicate repeats; -1 otherwise
+};
+
+// Encoded file contents in whichever buffer the encoder made them in: the one lodepng malloc'd
+// for a PNG, or a pooled buffer QOI was written into. Move-only; frees the buffer when it dies.
+struct EncodedFrame
+{
+	unsigned char* png;
+	PixelBuffer pooled;
+	size_t size;
+
+	EncodedFrame() : png(NULL), size(0) {}
+	EncodedFrame(EncodedFrame&& other) : png(NULL), size(0) { *this = std::move(other); }
+	~EncodedFrame() { free(png); }
+	EncodedFrame& operator=(EncodedFrame&& other)
+	{
+		if (this != &other)
+		{
+			std::swap(png, other.png);
+			pooled = std::move(other.pooled);
+			size = other.size;
+			other.size = 0;
+		}
+		return *this;
+	}
+
+	const unsigned char* Data() const { return png != NULL ? png : pooled.Get(); }
+
+private:
+	EncodedFrame(const EncodedFrame&);
+	EncodedFrame& operator=(const EncodedFrame&);
+};
+
+// Completed captures waiting for the application, when frames are delivered in memory instead
+// of written to files. A result takes over the buffer it was made in, the encoded file contents
+// or the converted pixels themselves, so nothing is copied on the way. Poll lends the buffer to
+// the caller until Release; pooled buffers then go back to the pool. A duplicate frame has no
+// buffer, only the sequence of the one it repeats, and is done with once polled.
+class CaptureResults
+{
+public:
+	CaptureResults();
+	~CaptureResults();
+
+	// Queues the frame's pixels, moving them out of the frame
+	void AddPixels(TextureInfo& frame);
+
+	// Queues encoded file contents for the frame, moving them out of encoded
+	void AddEncoded(const TextureInfo& frame, EncodedFrame& encoded);
+
+	// Queues an empty result for a frame that repeats frame frame.duplicateOfSequence
+	void AddDuplicate(const TextureInfo& frame);
+
+	// Takes the oldest completed result and lends its buffer. Returns false when there is none.
+	bool Poll(CaptureResultInfo& info);
+
+	// Ends the loan of a buffer from Poll and frees it. Returns the bytes freed, 0 for a pointer
+	// that isn't on loan.
+	size_t Release(const void* data);
+
+	// Frees every queued and lent result, once the application no longer holds any. Returns the
+	// bytes freed.
+	size_t Clear();
+
+private:
+	struct Result
+	{
+		PixelBuffer pixels;
+		EncodedFrame encoded;
+		std::string path;
+		int64_t sequence;
+		unsigned width;
+		unsigned height;
+		size_t rowPitch;
+		PixelLayout layout;
+		int64_t duplicateOf;
+
+		Result() : duplicateOf(-1) {}
+		Result(Result&& other) : duplicateOf(-1) { *this = std::move(other); }
+		Result& operator=(Result&& other);
+
+		const void* Data() const;
+		size_t Size() const;
+
+	private:
+		Result(const Result&);
+		Result& operator=(const Result&);
+	};
+
+	CRITICAL_SECTION lock;
+	std::deque<Result> completed;
+	std::map<const void*, Result> lent;
+	Result polledDuplicate;
+
+	CaptureResults(const CaptureResults&);
+	CaptureResults& operator=(const CaptureResults&);
+};
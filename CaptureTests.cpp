@@ -0,0 +1,458 @@
+// Stress and regression checks for the capture pipeline's threaded pieces, run without Unity or
+// a GPU. Each check prints what it did and the program returns nonzero if any of them fails.
+//
+//   CaptureTests [check...]
+//
+// With no arguments every check runs. --queue hammers CaptureQueue with several producers, a
+// thief and several consumers, and checks that every frame comes out exactly once, intact, and
+// in the order its producer pushed it. --staging reads textures back through ScreenGrab on a
+// stand-in device and checks the staging and resolve textures are created once and then reused.
+// --readback runs the asynchronous readback ring against copies of different speeds and checks
+// frames come out in capture order, with the render thread only waiting when the ring is full.
+// --archive hands an archive link to FrameCommitter before its original is appended and checks
+// the link record is only written once the original is in.
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "CaptureArchive.h"
+#include "CaptureQueue.h"
+#include "D3D11StandIn.h"
+#include "FrameCommitter.h"
+#include "ScreenGrab.h"
+
+static int failures = 0;
+
+static void Check(bool condition, const char* what)
+{
+	if (!condition) {
+		fprintf(stderr, "FAILED: %s\n", what);
+		++failures;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Producers tag each frame with who pushed it and its index in the path, the sequence and the
+// timestamp; consumers check the three agree and that each producer's frames come in order.
+static const int kQueueProducers = 4;
+static const int kQueueConsumers = 3;
+static const int kQueueFramesPerProducer = 200000;
+
+struct QueueStress
+{
+	CaptureQueue* queue;
+	volatile LONG* seen; // per frame, how often it came out
+	volatile LONG corrupt;
+	volatile LONG reordered;
+	volatile LONG stolen;
+	volatile LONG producersLeft;
+};
+
+struct QueueWorker
+{
+	QueueStress* stress;
+	int index;
+};
+
+static bool CheckFrame(QueueStress& stress, const TextureInfo& frame, std::vector<int64_t>& lastIndex)
+{
+	int producer = 0, index = 0;
+	if (sscanf(frame.filePath, "p%d/%d", &producer, &index) != 2 || producer < 0 || producer >= kQueueProducers
+		|| index < 0 || index >= kQueueFramesPerProducer
+		|| frame.sequence != (int64_t)producer * kQueueFramesPerProducer + index || frame.timestamp != index) {
+		InterlockedIncrement(&stress.corrupt);
+		return false;
+	}
+	if (index <= lastIndex[producer])
+		InterlockedIncrement(&stress.reordered);
+	lastIndex[producer] = index;
+	InterlockedIncrement(&stress.seen[frame.sequence]);
+	return true;
+}
+
+static DWORD WINAPI QueueProducer(LPVOID parameter)
+{
+	QueueWorker& worker = *static_cast<QueueWorker*>(parameter);
+	for (int i = 0; i < kQueueFramesPerProducer; ++i) {
+		TextureInfo frame;
+		char path[64];
+		sprintf_s(path, "p%d/%d", worker.index, i);
+		frame.SetFilePath(path);
+		frame.sequence = (int64_t)worker.index * kQueueFramesPerProducer + i;
+		frame.timestamp = i;
+		while (!worker.stress->queue->Push(frame))
+			SwitchToThread();
+	}
+	InterlockedDecrement(&worker.stress->producersLeft);
+	return 0;
+}
+
+static DWORD WINAPI QueueConsumer(LPVOID parameter)
+{
+	QueueWorker& worker = *static_cast<QueueWorker*>(parameter);
+	std::vector<int64_t> lastIndex(kQueueProducers, -1);
+	TextureInfo frame;
+	while (worker.stress->queue->Pop(frame))
+		CheckFrame(*worker.stress, frame, lastIndex);
+	return 0;
+}
+
+// Steals a frame now and then while the producers run, the way the render thread does under
+// backpressure
+static DWORD WINAPI QueueThief(LPVOID parameter)
+{
+	QueueWorker& worker = *static_cast<QueueWorker*>(parameter);
+	std::vector<int64_t> lastIndex(kQueueProducers, -1);
+	TextureInfo frame;
+	while (worker.stress->producersLeft > 0) {
+		if (worker.stress->queue->Steal(frame) && CheckFrame(*worker.stress, frame, lastIndex))
+			InterlockedIncrement(&worker.stress->stolen);
+		SwitchToThread();
+	}
+	return 0;
+}
+
+static void TestQueue()
+{
+	const int total = kQueueProducers * kQueueFramesPerProducer;
+	CaptureQueue queue(64);
+	std::vector<LONG> seen(total, 0);
+	QueueStress stress;
+	stress.queue = &queue;
+	stress.seen = &seen[0];
+	stress.corrupt = 0;
+	stress.reordered = 0;
+	stress.stolen = 0;
+	stress.producersLeft = kQueueProducers;
+
+	LARGE_INTEGER start, end, frequency;
+	QueryPerformanceCounter(&start);
+	const int threadCount = kQueueProducers + kQueueConsumers + 1;
+	QueueWorker workers[threadCount];
+	HANDLE consumers[kQueueConsumers];
+	HANDLE others[kQueueProducers + 1];
+	for (int i = 0; i < threadCount; ++i) {
+		workers[i].stress = &stress;
+		workers[i].index = i < kQueueProducers ? i : 0;
+	}
+	for (int i = 0; i < kQueueConsumers; ++i)
+		consumers[i] = CreateThread(NULL, 0, QueueConsumer, &workers[kQueueProducers + i], 0, NULL);
+	for (int i = 0; i < kQueueProducers; ++i)
+		others[i] = CreateThread(NULL, 0, QueueProducer, &workers[i], 0, NULL);
+	others[kQueueProducers] = CreateThread(NULL, 0, QueueThief, &workers[threadCount - 1], 0, NULL);
+
+	WaitForMultipleObjects(kQueueProducers + 1, others, TRUE, INFINITE);
+	queue.Close();
+	WaitForMultipleObjects(kQueueConsumers, consumers, TRUE, INFINITE);
+	QueryPerformanceCounter(&end);
+	QueryPerformanceFrequency(&frequency);
+	for (int i = 0; i < kQueueProducers + 1; ++i)
+		CloseHandle(others[i]);
+	for (int i = 0; i < kQueueConsumers; ++i)
+		CloseHandle(consumers[i]);
+
+	int lost = 0, repeated = 0;
+	for (int i = 0; i < total; ++i) {
+		if (seen[i] == 0)
+			++lost;
+		else if (seen[i] > 1)
+			++repeated;
+	}
+	double seconds = (double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+	printf("queue: %d producers, %d consumers, %d frames (%ld stolen) in %.2f s, %.1f M frames/s\n",
+		kQueueProducers, kQueueConsumers, total, (long)stress.stolen, seconds, total / seconds / 1e6);
+	Check(lost == 0, "queue: every frame comes out");
+	Check(repeated == 0, "queue: no frame comes out twice");
+	Check(stress.corrupt == 0, "queue: frames come out intact");
+	Check(stress.reordered == 0, "queue: each producer's frames keep their order");
+
+	// Closing wakes consumers once the ring is drained, and Pop keeps failing after that
+	TextureInfo frame;
+	frame.SetFilePath("last");
+	CaptureQueue closing(4);
+	Check(closing.Push(frame), "queue: push into an empty ring");
+	closing.Close();
+	Check(closing.Pop(frame) && strcmp(frame.filePath, "last") == 0, "queue: a closed ring still drains");
+	Check(!closing.Pop(frame), "queue: a drained closed ring returns false");
+	Check(!closing.Steal(frame), "queue: nothing left to steal");
+}
+
+
+//--------------------------------------------------------------------------------------
+// Source textures for the readback checks; pixel (x, y) holds x, y, fill and 255 so a readback
+// shows both where every pixel landed and which capture it came from
+static StandInTexture* MakeSource(StandInDevice& device, UINT width, UINT height, UINT samples)
+{
+	D3D11_TEXTURE2D_DESC desc;
+	memset(&desc, 0, sizeof(desc));
+	desc.Width = width;
+	desc.Height = height;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = samples;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	return device.MakeTexture(desc);
+}
+
+static void FillSource(StandInTexture* source, int fill)
+{
+	for (UINT y = 0; y < source->desc.Height; ++y) {
+		for (UINT x = 0; x < source->desc.Width; ++x) {
+			unsigned char* pixel = &source->bytes[y * source->rowPitch + x * 4];
+			pixel[0] = (unsigned char)x;
+			pixel[1] = (unsigned char)y;
+			pixel[2] = (unsigned char)fill;
+			pixel[3] = 255;
+		}
+	}
+}
+
+// Converted frames are RGBA8 with the bottom row first
+static bool ReadBackIntact(const TextureInfo& frame, UINT width, UINT height, int fill)
+{
+	if (!frame.pixels.Get() || frame.layout != kPixelRGBA8 || frame.width != width || frame.height != height)
+		return false;
+	for (UINT row = 0; row < height; ++row) {
+		const unsigned char* pixels = frame.pixels.Get() + row * frame.rowPitch;
+		for (UINT x = 0; x < width; ++x) {
+			const unsigned char* pixel = pixels + x * 4;
+			if (pixel[0] != (unsigned char)x || pixel[1] != (unsigned char)(height - 1 - row)
+				|| pixel[2] != (unsigned char)fill || pixel[3] != 255)
+				return false;
+		}
+	}
+	return true;
+}
+
+static void TestStaging()
+{
+	StandInDevice device;
+	StandInContext& context = device.context;
+	StandInTexture* large = MakeSource(device, 64, 32, 1);
+	StandInTexture* small = MakeSource(device, 24, 16, 1);
+	StandInTexture* msaa = MakeSource(device, 64, 32, 4);
+	const int captures = 20;
+
+	// One staging texture per source size, made by the first capture and reused after that
+	bool intact = true;
+	for (int i = 0; i < captures; ++i) {
+		FillSource(large, i);
+		intact = ReadBackIntact(GetTextureData(&context, large), 64, 32, i) && intact;
+	}
+	Check(intact, "staging: frames read back intact and flipped");
+	Check(device.texturesCreated == 1, "staging: repeated captures reuse one staging texture");
+
+	for (int i = 0; i < captures; ++i) {
+		StandInTexture* source = i % 2 ? small : large;
+		FillSource(source, i);
+		intact = ReadBackIntact(GetTextureData(&context, source), source->desc.Width, source->desc.Height, i)
+			&& intact;
+	}
+	Check(intact, "staging: alternating sizes read back intact");
+	Check(device.texturesCreated == 2, "staging: alternating sizes keep a staging texture each");
+
+	// MSAA adds a resolve texture; once resolved, it shares the staging texture of the single
+	// sampled source of the same size
+	int before = device.texturesCreated;
+	for (int i = 0; i < captures; ++i) {
+		FillSource(msaa, i);
+		intact = ReadBackIntact(GetTextureData(&context, msaa), 64, 32, i) && intact;
+	}
+	Check(intact, "staging: MSAA frames resolve and read back intact");
+	Check(device.texturesCreated == before + 1, "staging: MSAA captures reuse one resolve texture");
+	Check(context.stalls == 0, "staging: no copy outlives its map");
+
+	printf("staging: %d captures, %d copies, %d textures created\n", 3 * captures, context.copies,
+		device.texturesCreated);
+
+	ReleaseCaptureResources();
+	large->Release();
+	small->Release();
+	msaa->Release();
+	Check(device.liveTextures == 0, "staging: ReleaseCaptureResources frees every cached texture");
+}
+
+
+//--------------------------------------------------------------------------------------
+// The readback ring delivers to a plain function, so what it delivered is kept here
+static std::vector<int64_t> readbackOrder;
+static bool readbackIntact = true;
+
+static void CollectReadback(TextureInfo& frame)
+{
+	readbackOrder.push_back(frame.sequence);
+	readbackIntact = ReadBackIntact(frame, 64, 32, (int)(frame.sequence & 0xFF)) && readbackIntact;
+}
+
+static bool DeliveredInOrder(int count)
+{
+	if (readbackOrder.size() != (size_t)count)
+		return false;
+	for (int i = 0; i < count; ++i) {
+		if (readbackOrder[i] != i)
+			return false;
+	}
+	return true;
+}
+
+// One capture per frame, queued and then collected the way OnRenderEvent does it
+static void CaptureFrames(StandInContext& context, StandInTexture* source, int first, int count, int copyLatency)
+{
+	context.copyLatency = copyLatency;
+	for (int i = first; i < first + count; ++i) {
+		++context.frame;
+		FillSource(source, i);
+		TextureInfo frame;
+		frame.sequence = i;
+		QueueTextureReadback(&context, source, frame, CollectReadback);
+		CollectTextureReadbacks(&context, false, CollectReadback);
+	}
+}
+
+static void StartReadbacks(StandInContext& context, UINT latency)
+{
+	ReleaseCaptureResources();
+	SetTextureReadbackLatency(latency);
+	readbackOrder.clear();
+	context.stalls = 0;
+}
+
+static void TestReadback()
+{
+	StandInDevice device;
+	StandInContext& context = device.context;
+	StandInTexture* source = MakeSource(device, 64, 32, 1);
+	const int frames = 100;
+
+	// Copies take two frames and three may be in flight, so nothing ever waits, and once the
+	// ring has gone round no more staging textures are made
+	StartReadbacks(context, 3);
+	CaptureFrames(context, source, 0, 10, 2);
+	int warmedUp = device.texturesCreated;
+	CaptureFrames(context, source, 10, frames - 10, 2);
+	Check(readbackOrder.size() == frames - 2, "readback: frames are delivered once their copy is done");
+	Check(device.texturesCreated == warmedUp && warmedUp == 3, "readback: the ring reuses its staging textures");
+	Check(context.stalls == 0, "readback: a deep enough ring never waits for the GPU");
+	CollectTextureReadbacks(&context, true, CollectReadback);
+	Check(DeliveredInOrder(frames), "readback: waiting delivers the rest, all in capture order");
+
+	// A slow copy holds back the quick ones queued after it until it is done, then they all
+	// come out in order
+	StartReadbacks(context, 8);
+	CaptureFrames(context, source, 0, 20, 1);
+	CaptureFrames(context, source, 20, 1, 5);
+	size_t beforeSlow = readbackOrder.size();
+	CaptureFrames(context, source, 21, 4, 1);
+	Check(readbackOrder.size() == beforeSlow, "readback: a busy frame holds back the frames after it");
+	CaptureFrames(context, source, 25, 5, 1);
+	Check(context.stalls == 0, "readback: a slow copy doesn't stall a ring with room to spare");
+	CollectTextureReadbacks(&context, true, CollectReadback);
+	Check(DeliveredInOrder(30), "readback: held back frames keep their order");
+
+	// Copies slower than the ring is deep make each capture wait for the oldest one
+	StartReadbacks(context, 2);
+	CaptureFrames(context, source, 0, 20, 4);
+	Check(context.stalls > 0, "readback: a full ring waits for its oldest copy");
+	CollectTextureReadbacks(&context, true, CollectReadback);
+	Check(DeliveredInOrder(20), "readback: a full ring still delivers in order");
+
+	// Latency 0 reads every frame back before QueueTextureReadback returns
+	StartReadbacks(context, 0);
+	CaptureFrames(context, source, 0, 5, 4);
+	Check(DeliveredInOrder(5), "readback: latency 0 delivers each frame right away");
+	Check(readbackIntact, "readback: frames read back intact");
+
+	printf("readback: %d copies, %d maps, %d textures created\n", context.copies, context.maps,
+		device.texturesCreated);
+
+	StartReadbacks(context, 2);
+	source->Release();
+	Check(device.liveTextures == 0, "readback: ReleaseCaptureResources frees the ring");
+}
+
+
+//--------------------------------------------------------------------------------------
+// A link to a record only succeeds once that record is in the archive, which is how these
+// checks look inside it
+static bool HasRecord(CaptureArchive& archive, int64_t sequence)
+{
+	static int64_t probes = 1000000;
+	return archive.AppendLink("probe", sequence, ++probes, 0);
+}
+
+static void TestArchive()
+{
+	char directory[MAX_PATH], path[MAX_PATH];
+	if (GetTempPathA(MAX_PATH, directory) == 0 || GetTempFileNameA(directory, "arc", 0, path) == 0) {
+		Check(false, "archive: make a temporary file");
+		return;
+	}
+	CaptureArchive archive;
+	FrameCommitter committer(16);
+	Check(archive.Open(path), "archive: open");
+
+	// Frame 1 repeats frame 0, which another worker is still encoding
+	static const char original[] = "original";
+	committer.CommitArchiveLink(1, &archive, 0, 1, "frame0.png", "frame1.png", false);
+	Check(!HasRecord(archive, 1), "archive: a link waits for its original");
+	Check(archive.Append("frame0.png", original, sizeof(original), 0, 0), "archive: append the original");
+	Check(!HasRecord(archive, 1), "archive: a link waits for the original's turn");
+	committer.Skip(0);
+	Check(HasRecord(archive, 1), "archive: the link is written once the original is in");
+
+	// The original of frame 3 never makes it in, so there is nothing to link to
+	committer.CommitArchiveLink(3, &archive, 2, 3, "frame2.png", "frame3.png", false);
+	committer.Skip(2);
+	Check(!HasRecord(archive, 3), "archive: no link to an original that never landed");
+	Check(committer.FailedCount() == 1, "archive: the lost duplicate is counted");
+
+	archive.Close();
+	DeleteFileA(path);
+	printf("archive: links follow their originals\n");
+}
+
+
+//--------------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	static const struct
+	{
+		const char* name;
+		void (*run)();
+	} checks[] = {
+		{ "--queue", TestQueue },
+		{ "--staging", TestStaging },
+		{ "--readback", TestReadback },
+		{ "--archive", TestArchive },
+	};
+	const size_t checkCount = sizeof(checks) / sizeof(checks[0]);
+
+	for (int i = 1; i < argc; ++i) {
+		bool known = false;
+		for (size_t c = 0; c < checkCount; ++c)
+			known = known || strcmp(argv[i], checks[c].name) == 0;
+		if (!known) {
+			fprintf(stderr, "usage: CaptureTests [--queue] [--staging] [--readback] [--archive]\n");
+			return 2;
+		}
+	}
+	for (size_t c = 0; c < checkCount; ++c) {
+		bool selected = argc == 1;
+		for (int i = 1; i < argc; ++i)
+			selected = selected || strcmp(argv[i], checks[c].name) == 0;
+		if (selected)
+			checks[c].run();
+	}
+
+	if (failures != 0) {
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
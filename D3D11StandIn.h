@@ -0,0 +1,406 @@
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <d3d11.h>
+#include <string.h>
+#include <vector>
+
+// Stand-ins for a D3D11 device, its immediate context and 2D textures, just enough for
+// CaptureTests to run ScreenGrab's staging texture cache and readback ring without a GPU.
+// Textures keep their bytes in memory and CopyResource and ResolveSubresource copy them at once,
+// but the GPU is pretended to finish a copy only copyLatency frames later: until the test has
+// advanced the context's frame that far, a Map with D3D11_MAP_FLAG_DO_NOT_WAIT of the destination
+// returns DXGI_ERROR_WAS_STILL_DRAWING, and a Map without it counts as a stall. Everything a
+// capture doesn't call fails or does nothing.
+// Only 4-byte formats are supported, with rows padded to 256 bytes like a real driver's.
+
+class StandInDevice;
+
+class StandInTexture : public ID3D11Texture2D
+{
+public:
+	StandInTexture(StandInDevice* device, const D3D11_TEXTURE2D_DESC& desc);
+	~StandInTexture();
+
+	D3D11_TEXTURE2D_DESC desc;
+	std::vector<unsigned char> bytes;
+	UINT rowPitch;
+	int readyAt; // frame the last copy into the texture completes
+
+	// IUnknown
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject)
+	{
+		if (!ppvObject)
+			return E_POINTER;
+		if (riid == __uuidof(ID3D11Texture2D) || riid == __uuidof(ID3D11Resource)
+			|| riid == __uuidof(ID3D11DeviceChild) || riid == __uuidof(IUnknown)) {
+			AddRef();
+			*ppvObject = static_cast<ID3D11Texture2D*>(this);
+			return S_OK;
+		}
+		*ppvObject = NULL;
+		return E_NOINTERFACE;
+	}
+	ULONG STDMETHODCALLTYPE AddRef() { return ++references; }
+	ULONG STDMETHODCALLTYPE Release()
+	{
+		ULONG left = --references;
+		if (left == 0)
+			delete this;
+		return left;
+	}
+
+	// ID3D11DeviceChild
+	void STDMETHODCALLTYPE GetDevice(ID3D11Device** ppDevice);
+	HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID, UINT*, void*) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID, UINT, const void*) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID, const IUnknown*) { return E_NOTIMPL; }
+
+	// ID3D11Resource
+	void STDMETHODCALLTYPE GetType(D3D11_RESOURCE_DIMENSION* pResourceDimension)
+	{
+		*pResourceDimension = D3D11_RESOURCE_DIMENSION_TEXTURE2D;
+	}
+	void STDMETHODCALLTYPE SetEvictionPriority(UINT) {}
+	UINT STDMETHODCALLTYPE GetEvictionPriority() { return 0; }
+
+	// ID3D11Texture2D
+	void STDMETHODCALLTYPE GetDesc(D3D11_TEXTURE2D_DESC* pDesc) { *pDesc = desc; }
+
+private:
+	StandInDevice* device;
+	ULONG references;
+
+	StandInTexture(const StandInTexture&);
+	StandInTexture& operator=(const StandInTexture&);
+};
+
+
+//--------------------------------------------------------------------------------------
+// Stage methods of the context, the same for all six shader stages
+#define STAND_IN_SHADER_STAGE(Stage, Shader) \
+	void STDMETHODCALLTYPE Stage##SetShaderResources(UINT, UINT, ID3D11ShaderResourceView* const*) {} \
+	void STDMETHODCALLTYPE Stage##SetShader(Shader*, ID3D11ClassInstance* const*, UINT) {} \
+	void STDMETHODCALLTYPE Stage##SetSamplers(UINT, UINT, ID3D11SamplerState* const*) {} \
+	void STDMETHODCALLTYPE Stage##SetConstantBuffers(UINT, UINT, ID3D11Buffer* const*) {} \
+	void STDMETHODCALLTYPE Stage##GetShaderResources(UINT, UINT, ID3D11ShaderResourceView**) {} \
+	void STDMETHODCALLTYPE Stage##GetShader(Shader**, ID3D11ClassInstance**, UINT*) {} \
+	void STDMETHODCALLTYPE Stage##GetSamplers(UINT, UINT, ID3D11SamplerState**) {} \
+	void STDMETHODCALLTYPE Stage##GetConstantBuffers(UINT, UINT, ID3D11Buffer**) {}
+
+class StandInContext : public ID3D11DeviceContext
+{
+public:
+	explicit StandInContext(StandInDevice* device)
+		: frame(0), copyLatency(0), copies(0), maps(0), stalls(0), device(device)
+	{
+	}
+
+	int frame;       // advanced by the test, as Present would
+	int copyLatency; // frames a copy takes on the pretend GPU
+	int copies;
+	int maps;
+	int stalls; // Maps that had to wait for a busy texture
+
+	// IUnknown; the context lives as long as the test that made it
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, void** ppvObject)
+	{
+		*ppvObject = NULL;
+		return E_NOINTERFACE;
+	}
+	ULONG STDMETHODCALLTYPE AddRef() { return 1; }
+	ULONG STDMETHODCALLTYPE Release() { return 1; }
+
+	// ID3D11DeviceChild
+	void STDMETHODCALLTYPE GetDevice(ID3D11Device** ppDevice);
+	HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID, UINT*, void*) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID, UINT, const void*) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID, const IUnknown*) { return E_NOTIMPL; }
+
+	// What a capture uses
+	HRESULT STDMETHODCALLTYPE Map(ID3D11Resource* pResource, UINT Subresource, D3D11_MAP, UINT MapFlags,
+								  D3D11_MAPPED_SUBRESOURCE* pMappedResource)
+	{
+		StandInTexture* texture = static_cast<StandInTexture*>(pResource);
+		if (Subresource != 0 || !(texture->desc.CPUAccessFlags & D3D11_CPU_ACCESS_READ))
+			return E_INVALIDARG;
+		if (frame < texture->readyAt) {
+			if (MapFlags & D3D11_MAP_FLAG_DO_NOT_WAIT)
+				return DXGI_ERROR_WAS_STILL_DRAWING;
+			texture->readyAt = frame;
+			++stalls;
+		}
+		++maps;
+		pMappedResource->pData = &texture->bytes[0];
+		pMappedResource->RowPitch = texture->rowPitch;
+		pMappedResource->DepthPitch = (UINT)texture->bytes.size();
+		return S_OK;
+	}
+	void STDMETHODCALLTYPE Unmap(ID3D11Resource*, UINT) {}
+	void STDMETHODCALLTYPE CopyResource(ID3D11Resource* pDstResource, ID3D11Resource* pSrcResource)
+	{
+		Copy(static_cast<StandInTexture*>(pDstResource), static_cast<StandInTexture*>(pSrcResource));
+	}
+	void STDMETHODCALLTYPE ResolveSubresource(ID3D11Resource* pDstResource, UINT, ID3D11Resource* pSrcResource, UINT,
+											  DXGI_FORMAT)
+	{
+		Copy(static_cast<StandInTexture*>(pDstResource), static_cast<StandInTexture*>(pSrcResource));
+	}
+
+	// The rest of ID3D11DeviceContext
+	STAND_IN_SHADER_STAGE(VS, ID3D11VertexShader)
+	STAND_IN_SHADER_STAGE(HS, ID3D11HullShader)
+	STAND_IN_SHADER_STAGE(DS, ID3D11DomainShader)
+	STAND_IN_SHADER_STAGE(GS, ID3D11GeometryShader)
+	STAND_IN_SHADER_STAGE(PS, ID3D11PixelShader)
+	STAND_IN_SHADER_STAGE(CS, ID3D11ComputeShader)
+	void STDMETHODCALLTYPE DrawIndexed(UINT, UINT, INT) {}
+	void STDMETHODCALLTYPE Draw(UINT, UINT) {}
+	void STDMETHODCALLTYPE IASetInputLayout(ID3D11InputLayout*) {}
+	void STDMETHODCALLTYPE IASetVertexBuffers(UINT, UINT, ID3D11Buffer* const*, const UINT*, const UINT*) {}
+	void STDMETHODCALLTYPE IASetIndexBuffer(ID3D11Buffer*, DXGI_FORMAT, UINT) {}
+	void STDMETHODCALLTYPE DrawIndexedInstanced(UINT, UINT, UINT, INT, UINT) {}
+	void STDMETHODCALLTYPE DrawInstanced(UINT, UINT, UINT, UINT) {}
+	void STDMETHODCALLTYPE IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY) {}
+	void STDMETHODCALLTYPE Begin(ID3D11Asynchronous*) {}
+	void STDMETHODCALLTYPE End(ID3D11Asynchronous*) {}
+	HRESULT STDMETHODCALLTYPE GetData(ID3D11Asynchronous*, void*, UINT, UINT) { return E_NOTIMPL; }
+	void STDMETHODCALLTYPE SetPredication(ID3D11Predicate*, BOOL) {}
+	void STDMETHODCALLTYPE OMSetRenderTargets(UINT, ID3D11RenderTargetView* const*, ID3D11DepthStencilView*) {}
+	void STDMETHODCALLTYPE OMSetRenderTargetsAndUnorderedAccessViews(UINT, ID3D11RenderTargetView* const*,
+		ID3D11DepthStencilView*, UINT, UINT, ID3D11UnorderedAccessView* const*, const UINT*) {}
+	void STDMETHODCALLTYPE OMSetBlendState(ID3D11BlendState*, const FLOAT[4], UINT) {}
+	void STDMETHODCALLTYPE OMSetDepthStencilState(ID3D11DepthStencilState*, UINT) {}
+	void STDMETHODCALLTYPE SOSetTargets(UINT, ID3D11Buffer* const*, const UINT*) {}
+	void STDMETHODCALLTYPE DrawAuto() {}
+	void STDMETHODCALLTYPE DrawIndexedInstancedIndirect(ID3D11Buffer*, UINT) {}
+	void STDMETHODCALLTYPE DrawInstancedIndirect(ID3D11Buffer*, UINT) {}
+	void STDMETHODCALLTYPE Dispatch(UINT, UINT, UINT) {}
+	void STDMETHODCALLTYPE DispatchIndirect(ID3D11Buffer*, UINT) {}
+	void STDMETHODCALLTYPE RSSetState(ID3D11RasterizerState*) {}
+	void STDMETHODCALLTYPE RSSetViewports(UINT, const D3D11_VIEWPORT*) {}
+	void STDMETHODCALLTYPE RSSetScissorRects(UINT, const D3D11_RECT*) {}
+	void STDMETHODCALLTYPE CopySubresourceRegion(ID3D11Resource*, UINT, UINT, UINT, UINT, ID3D11Resource*, UINT,
+		const D3D11_BOX*) {}
+	void STDMETHODCALLTYPE UpdateSubresource(ID3D11Resource*, UINT, const D3D11_BOX*, const void*, UINT, UINT) {}
+	void STDMETHODCALLTYPE CopyStructureCount(ID3D11Buffer*, UINT, ID3D11UnorderedAccessView*) {}
+	void STDMETHODCALLTYPE ClearRenderTargetView(ID3D11RenderTargetView*, const FLOAT[4]) {}
+	void STDMETHODCALLTYPE ClearUnorderedAccessViewUint(ID3D11UnorderedAccessView*, const UINT[4]) {}
+	void STDMETHODCALLTYPE ClearUnorderedAccessViewFloat(ID3D11UnorderedAccessView*, const FLOAT[4]) {}
+	void STDMETHODCALLTYPE ClearDepthStencilView(ID3D11DepthStencilView*, UINT, FLOAT, UINT8) {}
+	void STDMETHODCALLTYPE GenerateMips(ID3D11ShaderResourceView*) {}
+	void STDMETHODCALLTYPE SetResourceMinLOD(ID3D11Resource*, FLOAT) {}
+	FLOAT STDMETHODCALLTYPE GetResourceMinLOD(ID3D11Resource*) { return 0; }
+	void STDMETHODCALLTYPE ExecuteCommandList(ID3D11CommandList*, BOOL) {}
+	void STDMETHODCALLTYPE CSSetUnorderedAccessViews(UINT, UINT, ID3D11UnorderedAccessView* const*, const UINT*) {}
+	void STDMETHODCALLTYPE IAGetInputLayout(ID3D11InputLayout**) {}
+	void STDMETHODCALLTYPE IAGetVertexBuffers(UINT, UINT, ID3D11Buffer**, UINT*, UINT*) {}
+	void STDMETHODCALLTYPE IAGetIndexBuffer(ID3D11Buffer**, DXGI_FORMAT*, UINT*) {}
+	void STDMETHODCALLTYPE IAGetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY*) {}
+	void STDMETHODCALLTYPE GetPredication(ID3D11Predicate**, BOOL*) {}
+	void STDMETHODCALLTYPE OMGetRenderTargets(UINT, ID3D11RenderTargetView**, ID3D11DepthStencilView**) {}
+	void STDMETHODCALLTYPE OMGetRenderTargetsAndUnorderedAccessViews(UINT, ID3D11RenderTargetView**,
+		ID3D11DepthStencilView**, UINT, UINT, ID3D11UnorderedAccessView**) {}
+	void STDMETHODCALLTYPE OMGetBlendState(ID3D11BlendState**, FLOAT[4], UINT*) {}
+	void STDMETHODCALLTYPE OMGetDepthStencilState(ID3D11DepthStencilState**, UINT*) {}
+	void STDMETHODCALLTYPE SOGetTargets(UINT, ID3D11Buffer**) {}
+	void STDMETHODCALLTYPE RSGetState(ID3D11RasterizerState**) {}
+	void STDMETHODCALLTYPE RSGetViewports(UINT*, D3D11_VIEWPORT*) {}
+	void STDMETHODCALLTYPE RSGetScissorRects(UINT*, D3D11_RECT*) {}
+	void STDMETHODCALLTYPE CSGetUnorderedAccessViews(UINT, UINT, ID3D11UnorderedAccessView**) {}
+	void STDMETHODCALLTYPE ClearState() {}
+	void STDMETHODCALLTYPE Flush() {}
+	D3D11_DEVICE_CONTEXT_TYPE STDMETHODCALLTYPE GetType() { return D3D11_DEVICE_CONTEXT_IMMEDIATE; }
+	UINT STDMETHODCALLTYPE GetContextFlags() { return 0; }
+	HRESULT STDMETHODCALLTYPE FinishCommandList(BOOL, ID3D11CommandList**) { return E_NOTIMPL; }
+
+private:
+	StandInDevice* device;
+
+	// Copies the whole texture now, but leaves it busy for copyLatency frames
+	void Copy(StandInTexture* destination, StandInTexture* source)
+	{
+		++copies;
+		if (destination->bytes.size() == source->bytes.size())
+			memcpy(&destination->bytes[0], &source->bytes[0], source->bytes.size());
+		destination->readyAt = frame + copyLatency;
+	}
+
+	StandInContext(const StandInContext&);
+	StandInContext& operator=(const StandInContext&);
+};
+
+#undef STAND_IN_SHADER_STAGE
+
+
+//--------------------------------------------------------------------------------------
+class StandInDevice : public ID3D11Device
+{
+public:
+	StandInDevice() : texturesCreated(0), liveTextures(0), context(this) {}
+
+	int texturesCreated; // by CreateTexture2D
+	int liveTextures;    // StandInTextures not yet released, however they were made
+	StandInContext context;
+
+	// Textures made by the test itself, which don't count as created by the capture code
+	StandInTexture* MakeTexture(const D3D11_TEXTURE2D_DESC& desc) { return new StandInTexture(this, desc); }
+
+	// IUnknown; the device lives as long as the test that made it
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, void** ppvObject)
+	{
+		*ppvObject = NULL;
+		return E_NOINTERFACE;
+	}
+	ULONG STDMETHODCALLTYPE AddRef() { return 1; }
+	ULONG STDMETHODCALLTYPE Release() { return 1; }
+
+	// What a capture uses
+	HRESULT STDMETHODCALLTYPE CreateTexture2D(const D3D11_TEXTURE2D_DESC* pDesc, const D3D11_SUBRESOURCE_DATA*,
+											  ID3D11Texture2D** ppTexture2D)
+	{
+		++texturesCreated;
+		*ppTexture2D = MakeTexture(*pDesc);
+		return S_OK;
+	}
+	HRESULT STDMETHODCALLTYPE CheckFormatSupport(DXGI_FORMAT, UINT* pFormatSupport)
+	{
+		*pFormatSupport = D3D11_FORMAT_SUPPORT_TEXTURE2D | D3D11_FORMAT_SUPPORT_MULTISAMPLE_RESOLVE;
+		return S_OK;
+	}
+	void STDMETHODCALLTYPE GetImmediateContext(ID3D11DeviceContext** ppImmediateContext)
+	{
+		*ppImmediateContext = &context;
+	}
+
+	// The rest of ID3D11Device
+	HRESULT STDMETHODCALLTYPE CreateBuffer(const D3D11_BUFFER_DESC*, const D3D11_SUBRESOURCE_DATA*, ID3D11Buffer**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreateTexture1D(const D3D11_TEXTURE1D_DESC*, const D3D11_SUBRESOURCE_DATA*,
+											  ID3D11Texture1D**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreateTexture3D(const D3D11_TEXTURE3D_DESC*, const D3D11_SUBRESOURCE_DATA*,
+											  ID3D11Texture3D**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreateShaderResourceView(ID3D11Resource*, const D3D11_SHADER_RESOURCE_VIEW_DESC*,
+													   ID3D11ShaderResourceView**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreateUnorderedAccessView(ID3D11Resource*, const D3D11_UNORDERED_ACCESS_VIEW_DESC*,
+														ID3D11UnorderedAccessView**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreateRenderTargetView(ID3D11Resource*, const D3D11_RENDER_TARGET_VIEW_DESC*,
+													 ID3D11RenderTargetView**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreateDepthStencilView(ID3D11Resource*, const D3D11_DEPTH_STENCIL_VIEW_DESC*,
+													 ID3D11DepthStencilView**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC*, UINT, const void*, SIZE_T,
+												ID3D11InputLayout**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreateVertexShader(const void*, SIZE_T, ID3D11ClassLinkage*, ID3D11VertexShader**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreateGeometryShader(const void*, SIZE_T, ID3D11ClassLinkage*, ID3D11GeometryShader**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreateGeometryShaderWithStreamOutput(const void*, SIZE_T,
+		const D3D11_SO_DECLARATION_ENTRY*, UINT, const UINT*, UINT, UINT, ID3D11ClassLinkage*, ID3D11GeometryShader**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreatePixelShader(const void*, SIZE_T, ID3D11ClassLinkage*, ID3D11PixelShader**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreateHullShader(const void*, SIZE_T, ID3D11ClassLinkage*, ID3D11HullShader**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreateDomainShader(const void*, SIZE_T, ID3D11ClassLinkage*, ID3D11DomainShader**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreateComputeShader(const void*, SIZE_T, ID3D11ClassLinkage*, ID3D11ComputeShader**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreateClassLinkage(ID3D11ClassLinkage**) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateBlendState(const D3D11_BLEND_DESC*, ID3D11BlendState**) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateDepthStencilState(const D3D11_DEPTH_STENCIL_DESC*, ID3D11DepthStencilState**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreateRasterizerState(const D3D11_RASTERIZER_DESC*, ID3D11RasterizerState**)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CreateSamplerState(const D3D11_SAMPLER_DESC*, ID3D11SamplerState**) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateQuery(const D3D11_QUERY_DESC*, ID3D11Query**) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreatePredicate(const D3D11_QUERY_DESC*, ID3D11Predicate**) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateCounter(const D3D11_COUNTER_DESC*, ID3D11Counter**) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateDeferredContext(UINT, ID3D11DeviceContext**) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE OpenSharedResource(HANDLE, REFIID, void**) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CheckMultisampleQualityLevels(DXGI_FORMAT, UINT, UINT*) { return E_NOTIMPL; }
+	void STDMETHODCALLTYPE CheckCounterInfo(D3D11_COUNTER_INFO*) {}
+	HRESULT STDMETHODCALLTYPE CheckCounter(const D3D11_COUNTER_DESC*, D3D11_COUNTER_TYPE*, UINT*, LPSTR, UINT*, LPSTR,
+										   UINT*, LPSTR, UINT*)
+	{
+		return E_NOTIMPL;
+	}
+	HRESULT STDMETHODCALLTYPE CheckFeatureSupport(D3D11_FEATURE, void*, UINT) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID, UINT*, void*) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID, UINT, const void*) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID, const IUnknown*) { return E_NOTIMPL; }
+	D3D_FEATURE_LEVEL STDMETHODCALLTYPE GetFeatureLevel() { return D3D_FEATURE_LEVEL_11_0; }
+	UINT STDMETHODCALLTYPE GetCreationFlags() { return 0; }
+	HRESULT STDMETHODCALLTYPE GetDeviceRemovedReason() { return S_OK; }
+	HRESULT STDMETHODCALLTYPE SetExceptionMode(UINT) { return S_OK; }
+	UINT STDMETHODCALLTYPE GetExceptionMode() { return 0; }
+
+private:
+	StandInDevice(const StandInDevice&);
+	StandInDevice& operator=(const StandInDevice&);
+};
+
+
+//--------------------------------------------------------------------------------------
+inline StandInTexture::StandInTexture(StandInDevice* device, const D3D11_TEXTURE2D_DESC& desc)
+	: desc(desc), rowPitch((desc.Width * 4 + 255) & ~255u), readyAt(0), device(device), references(1)
+{
+	bytes.resize((size_t)rowPitch * desc.Height);
+	++device->liveTextures;
+}
+
+inline StandInTexture::~StandInTexture()
+{
+	--device->liveTextures;
+}
+
+inline void StandInTexture::GetDevice(ID3D11Device** ppDevice)
+{
+	*ppDevice = device;
+}
+
+inline void StandInContext::GetDevice(ID3D11Device** ppDevice)
+{
+	*ppDevice = device;
+}
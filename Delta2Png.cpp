@@ -0,0 +1,176 @@
+// Rebuilds full PNG frames from a sequence captured with SetDeltaKeyframeInterval.
+//
+//   Delta2Png <outputDirectory> <frame.png>...
+//
+// Each frame is written to outputDirectory under its own file name. A delta frame names the
+// frame it was taken against in a text chunk; that frame is looked up in the same directory
+// and rebuilt first, so frames may be listed in any order, though capture order is fastest.
+// Keyframes are copied through unchanged.
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "PngEncoder.h"
+#include "lodepng.h"
+
+// The last frame rebuilt, which in capture order is the reference of the next one
+static std::string lastPath;
+static LodePNGColorType lastColorType;
+static unsigned lastBitDepth;
+static unsigned lastWidth;
+static unsigned lastHeight;
+static std::vector<unsigned char> lastPixels;
+
+static std::string DirectoryOf(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+static std::string FileNameOf(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Reads the file's delta reference, empty for a keyframe
+static bool ReadFrame(const std::string& path, std::vector<unsigned char>& file, lodepng::State& state,
+					  std::string& deltaOf)
+{
+	unsigned width, height;
+	lodepng::load_file(file, path);
+	if (file.empty() || lodepng_inspect(&width, &height, &state, &file[0], file.size()) != 0) {
+		fprintf(stderr, "%s: not a PNG file\n", path.c_str());
+		return false;
+	}
+
+	// The text chunks are only read by a full decode; this one is small, so look for it directly
+	deltaOf.clear();
+	const unsigned char* chunk = &file[0] + 8;
+	const unsigned char* end = &file[0] + file.size();
+	while (chunk + 12 <= end && !lodepng_chunk_type_equals(chunk, "IEND")) {
+		unsigned length = lodepng_chunk_length(chunk);
+		if (chunk + 12 + length > end)
+			break;
+		if (lodepng_chunk_type_equals(chunk, "tEXt")) {
+			std::string text((const char*)lodepng_chunk_data_const(chunk), length);
+			size_t separator = text.find('\0');
+			if (separator != std::string::npos && text.compare(0, separator, kDeltaTextKey) == 0) {
+				deltaOf = text.substr(separator + 1);
+				break;
+			}
+		}
+		chunk = lodepng_chunk_next_const(chunk);
+	}
+	return true;
+}
+
+// Decodes the frame at path into colorType/bitDepth, the layout of the delta that needs it, and
+// undoes the XOR chain back to its keyframe
+static bool Rebuild(const std::string& path, LodePNGColorType colorType, unsigned bitDepth,
+					std::vector<unsigned char>& pixels, unsigned& width, unsigned& height)
+{
+	// Walk back to a keyframe, or to the frame rebuilt last
+	std::vector<std::string> chain;
+	std::string current = path;
+	for (;;) {
+		chain.push_back(current);
+		if (current == lastPath && lastColorType == colorType && lastBitDepth == bitDepth)
+			break;
+		std::vector<unsigned char> file;
+		lodepng::State state;
+		std::string deltaOf;
+		if (!ReadFrame(current, file, state, deltaOf))
+			return false;
+		if (deltaOf.empty())
+			break;
+		current = DirectoryOf(current) + deltaOf;
+		if (chain.size() > 100000) {
+			fprintf(stderr, "%s: delta chain doesn't end\n", path.c_str());
+			return false;
+		}
+	}
+
+	// Then forward again, XORing each delta onto the frame before it
+	for (size_t i = chain.size(); i-- > 0; ) {
+		const std::string& framePath = chain[i];
+		if (i == chain.size() - 1 && framePath == lastPath && lastColorType == colorType && lastBitDepth == bitDepth) {
+			pixels = lastPixels;
+			width = lastWidth;
+			height = lastHeight;
+			continue;
+		}
+
+		std::vector<unsigned char> frame;
+		unsigned w, h;
+		if (lodepng::decode(frame, w, h, framePath, colorType, bitDepth) != 0) {
+			fprintf(stderr, "%s: can't decode as the layout of %s\n", framePath.c_str(), path.c_str());
+			return false;
+		}
+		if (i == chain.size() - 1) {
+			pixels.swap(frame);
+		} else if (frame.size() != pixels.size() || w != width || h != height) {
+			fprintf(stderr, "%s: size differs from the frame it refers to\n", framePath.c_str());
+			return false;
+		} else {
+			for (size_t b = 0; b < pixels.size(); ++b)
+				pixels[b] ^= frame[b];
+		}
+		width = w;
+		height = h;
+	}
+
+	lastPath = path;
+	lastColorType = colorType;
+	lastBitDepth = bitDepth;
+	lastWidth = width;
+	lastHeight = height;
+	lastPixels = pixels;
+	return true;
+}
+
+static bool WriteFrame(const std::string& path, const std::string& outputDirectory)
+{
+	std::vector<unsigned char> file;
+	lodepng::State state;
+	std::string deltaOf;
+	if (!ReadFrame(path, file, state, deltaOf))
+		return false;
+
+	std::string outputPath = outputDirectory + "\\" + FileNameOf(path);
+	if (deltaOf.empty())
+		return lodepng::save_file(file, outputPath) == 0;
+
+	// Deltas keep the layout they were captured in, so rebuild the whole chain in it
+	LodePNGColorType colorType = state.info_png.color.colortype;
+	unsigned bitDepth = state.info_png.color.bitdepth;
+	std::vector<unsigned char> pixels;
+	unsigned width = 0, height = 0;
+	if (!Rebuild(path, colorType, bitDepth, pixels, width, height))
+		return false;
+
+	std::vector<unsigned char> png;
+	return lodepng::encode(png, pixels, width, height, colorType, bitDepth) == 0
+		&& lodepng::save_file(png, outputPath) == 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	if (argc < 3) {
+		fprintf(stderr, "usage: Delta2Png <outputDirectory> <frame.png>...\n");
+		return 2;
+	}
+
+	std::string outputDirectory = argv[1];
+	int failed = 0;
+	for (int i = 2; i < argc; ++i) {
+		if (!WriteFrame(argv[i], outputDirectory)) {
+			fprintf(stderr, "%s: could not rebuild frame\n", argv[i]);
+			++failed;
+		}
+	}
+	printf("%d rebuilt, %d failed\n", argc - 2 - failed, failed);
+	return failed > 0 ? 1 : 0;
+}
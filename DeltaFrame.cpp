@@ -0,0 +1,75 @@
+#include "DeltaFrame.h"
+
+#include <emmintrin.h>
+
+#include "PngEncoder.h"
+
+// pixels ^= previous and previous = the old pixels, in one pass
+static void XorWithPrevious(uint8_t* pixels, uint8_t* previous, size_t size)
+{
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16) {
+		__m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+		__m128i before = _mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(previous + i), current);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i), _mm_xor_si128(current, before));
+	}
+	for (; i < size; ++i) {
+		uint8_t current = pixels[i];
+		pixels[i] ^= previous[i];
+		previous[i] = current;
+	}
+}
+
+static std::string FileName(const char* path)
+{
+	const char* name = path;
+	for (const char* p = path; *p; ++p) {
+		if (*p == '/' || *p == '\\')
+			name = p + 1;
+	}
+	return name;
+}
+
+
+//--------------------------------------------------------------------------------------
+DeltaEncoder::DeltaEncoder()
+{
+}
+
+void DeltaEncoder::Apply(TextureInfo& frame, int keyframeInterval)
+{
+	if (frame.output != kOutputPNG || !IsPngLayout(frame.layout) || frame.pixels.Get() == NULL)
+		return;
+
+	Sequence& sequence = sequences[frame.texture];
+	std::string name = FileName(frame.filePath);
+	bool continues = sequence.previous.Get() != NULL
+		&& sequence.previous.Size() == frame.pixels.Size()
+		&& sequence.width == frame.width && sequence.height == frame.height
+		&& sequence.layout == frame.layout
+		&& sequence.previousName != name
+		&& sequence.sinceKeyframe + 1 < keyframeInterval;
+
+	if (continues) {
+		XorWithPrevious(frame.pixels.Get(), sequence.previous.Get(), frame.pixels.Size());
+		strcpy_s(frame.deltaOf, sequence.previousName.c_str());
+		++sequence.sinceKeyframe;
+	} else {
+		if (sequence.previous.Size() != frame.pixels.Size())
+			sequence.previous = PixelBuffer(frame.pixels.Size());
+		if (sequence.previous.Get() == NULL)
+			return;
+		memcpy(sequence.previous.Get(), frame.pixels.Get(), frame.pixels.Size());
+		sequence.width = frame.width;
+		sequence.height = frame.height;
+		sequence.layout = frame.layout;
+		sequence.sinceKeyframe = 0;
+	}
+	sequence.previousName = name;
+}
+
+void DeltaEncoder::Reset()
+{
+	sequences.clear();
+}
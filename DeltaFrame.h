@@ -0,0 +1,44 @@
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <map>
+#include <string>
+
+#include "ScreenGrab.h"
+
+// Turns consecutive frames of the same texture into XOR differences against the frame before.
+// A difference is mostly zero bytes, which deflate compresses much faster and smaller than
+// the frame itself. Every keyframeInterval-th frame is kept whole, as is any frame whose size,
+// layout or path doesn't continue the sequence. Delta2Png rebuilds the full frames.
+//
+// Frames must arrive in capture order, so this runs on the render thread.
+class DeltaEncoder
+{
+public:
+	DeltaEncoder();
+
+	// Stores the frame as a delta when a keyframe isn't due, filling in frame.deltaOf. Frames
+	// that aren't headed for a PNG pass through untouched.
+	void Apply(TextureInfo& frame, int keyframeInterval);
+
+	// Makes the next frame of every texture a keyframe. Needed whenever a frame is lost after
+	// Apply, since the frame following it would refer to it.
+	void Reset();
+
+private:
+	struct Sequence
+	{
+		PixelBuffer previous;
+		std::string previousName;
+		unsigned width;
+		unsigned height;
+		PixelLayout layout;
+		int sinceKeyframe;
+	};
+
+	std::map<const void*, Sequence> sequences;
+
+	DeltaEncoder(const DeltaEncoder&);
+	DeltaEncoder& operator=(const DeltaEncoder&);
+};
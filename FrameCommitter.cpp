@@ -0,0 +1,155 @@
+#include "FrameCommitter.h"
+#include "CaptureArchive.h"
+
+#include <stdio.h>
+
+//--------------------------------------------------------------------------------------
+FrameCommitter::FrameCommitter(size_t window)
+	: nextSequence(0), window(window), failed(0)
+{
+	InitializeCriticalSection(&lock);
+}
+
+FrameCommitter::~FrameCommitter()
+{
+	DeleteCriticalSection(&lock);
+}
+
+
+//--------------------------------------------------------------------------------------
+void FrameCommitter::Commit(LONG64 sequence, const std::string& tempPath, const std::string& finalPath)
+{
+	Pending frame;
+	frame.tempPath = tempPath;
+	frame.finalPath = finalPath;
+	Add(sequence, frame);
+}
+
+void FrameCommitter::Skip(LONG64 sequence)
+{
+	Pending frame;
+	frame.skipped = true;
+	Add(sequence, frame);
+}
+
+void FrameCommitter::CommitDuplicate(LONG64 sequence, const std::string& originalPath, const std::string& finalPath,
+									 bool listOnly)
+{
+	Pending frame;
+	frame.finalPath = finalPath;
+	frame.duplicateOf = originalPath;
+	frame.listOnly = listOnly;
+	Add(sequence, frame);
+}
+
+void FrameCommitter::CommitArchiveLink(LONG64 sequence, CaptureArchive* archive, LONG64 originalSequence,
+									   LONG64 timestamp, const std::string& originalPath, const std::string& finalPath,
+									   bool listOnly)
+{
+	Pending frame;
+	frame.finalPath = finalPath;
+	frame.duplicateOf = originalPath;
+	frame.listOnly = listOnly;
+	frame.archive = archive;
+	frame.sequence = sequence;
+	frame.originalSequence = originalSequence;
+	frame.timestamp = timestamp;
+	Add(sequence, frame);
+}
+
+std::string FrameCommitter::TempPath(const std::string& finalPath, LONG64 sequence)
+{
+	char suffix[32];
+	sprintf_s(suffix, ".%lld.tmp", (long long)sequence);
+	return finalPath + suffix;
+}
+
+LONG64 FrameCommitter::FailedCount()
+{
+	EnterCriticalSection(&lock);
+	LONG64 count = failed;
+	LeaveCriticalSection(&lock);
+	return count;
+}
+
+void FrameCommitter::Flush()
+{
+	EnterCriticalSection(&lock);
+	for (auto it = pending.begin(); it != pending.end(); ++it) {
+		Publish(it->second);
+		nextSequence = it->first + 1;
+	}
+	pending.clear();
+	LeaveCriticalSection(&lock);
+}
+
+
+//--------------------------------------------------------------------------------------
+void FrameCommitter::Add(LONG64 sequence, const Pending& frame)
+{
+	EnterCriticalSection(&lock);
+	if (sequence < nextSequence) {
+		// The window already moved past this frame, don't hold anything back for it
+		Publish(frame);
+	} else {
+		pending[sequence] = frame;
+		Advance();
+	}
+	LeaveCriticalSection(&lock);
+}
+
+void FrameCommitter::Advance()
+{
+	while (!pending.empty()) {
+		auto first = pending.begin();
+		if (first->first != nextSequence) {
+			if (pending.size() <= window)
+				break;
+			// Too many frames are waiting on a slow one; give up on the gap
+			nextSequence = first->first;
+		}
+		Publish(first->second);
+		pending.erase(first);
+		++nextSequence;
+	}
+}
+
+void FrameCommitter::Publish(const Pending& frame)
+{
+	if (frame.skipped)
+		return;
+	if (frame.archive != NULL
+		&& frame.archive->AppendLink(frame.finalPath, frame.originalSequence, frame.sequence, frame.timestamp))
+		return;
+	if (!frame.duplicateOf.empty()) {
+		if (!PublishDuplicate(frame))
+			++failed;
+		return;
+	}
+	if (!MoveFileExA(frame.tempPath.c_str(), frame.finalPath.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		DeleteFileA(frame.tempPath.c_str());
+		++failed;
+	}
+}
+
+// The original has an earlier sequence number, so it is already in place unless the window gave
+// up on it
+bool FrameCommitter::PublishDuplicate(const Pending& frame)
+{
+	if (frame.listOnly) {
+		size_t slash = frame.finalPath.find_last_of("/\\");
+		std::string manifestPath = (slash == std::string::npos ? std::string() : frame.finalPath.substr(0, slash + 1))
+			+ "duplicates.txt";
+		FILE* manifest = fopen(manifestPath.c_str(), "a");
+		if (!manifest)
+			return false;
+		bool ok = fprintf(manifest, "%s\t%s\n", frame.finalPath.c_str(), frame.duplicateOf.c_str()) > 0;
+		return fclose(manifest) == 0 && ok;
+	}
+
+	if (frame.finalPath == frame.duplicateOf)
+		return true;
+	DeleteFileA(frame.finalPath.c_str());
+	return CreateHardLinkA(frame.finalPath.c_str(), frame.duplicateOf.c_str(), NULL)
+		|| CopyFileA(frame.duplicateOf.c_str(), frame.finalPath.c_str(), FALSE);
+}
@@ -0,0 +1,79 @@
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <windows.h>
+#include <map>
+#include <string>
+
+class CaptureArchive;
+
+// Makes encoded frames visible in capture order. Workers write each frame to a temporary file
+// and hand it over here; the committer renames them to their final paths strictly by sequence
+// number. If more than `window` frames are waiting on an earlier one, the committer stops
+// waiting for the gap, and that frame is renamed as soon as it arrives.
+class FrameCommitter
+{
+public:
+	explicit FrameCommitter(size_t window);
+	~FrameCommitter();
+
+	// Frame `sequence` was written to tempPath and should become visible as finalPath
+	void Commit(LONG64 sequence, const std::string& tempPath, const std::string& finalPath);
+
+	// Frame `sequence` produced no file, don't hold later frames back for it
+	void Skip(LONG64 sequence);
+
+	// Frame `sequence` is identical to the one written to originalPath. In its turn finalPath
+	// becomes a hard link to that file (a copy where links aren't supported), or with listOnly
+	// the pair is appended to a duplicates.txt in finalPath's directory instead.
+	void CommitDuplicate(LONG64 sequence, const std::string& originalPath, const std::string& finalPath,
+						 bool listOnly);
+
+	// Like CommitDuplicate while frames go to archive. Archived frames are appended as their
+	// workers finish them and only then skipped here, so in this frame's turn the original has
+	// either landed and finalPath becomes a link record to it, or it didn't make it into the
+	// archive and the duplicate is linked or listed on disk like any other.
+	void CommitArchiveLink(LONG64 sequence, CaptureArchive* archive, LONG64 originalSequence, LONG64 timestamp,
+						   const std::string& originalPath, const std::string& finalPath, bool listOnly);
+
+	// Commits every pending frame regardless of gaps, used once the workers are stopped
+	void Flush();
+
+	// Where frame `sequence` is written before it is renamed to finalPath. Frames captured to
+	// the same path can be encoded at the same time, so the sequence number keeps them apart.
+	static std::string TempPath(const std::string& finalPath, LONG64 sequence);
+
+	// Frames whose file, link or record couldn't be put in place
+	LONG64 FailedCount();
+
+private:
+	struct Pending
+	{
+		bool skipped;
+		std::string tempPath;
+		std::string finalPath;
+		std::string duplicateOf;
+		bool listOnly;
+		CaptureArchive* archive; // for a link record, with the three below
+		LONG64 sequence;
+		LONG64 originalSequence;
+		LONG64 timestamp;
+
+		Pending() : skipped(false), listOnly(false), archive(NULL), sequence(0), originalSequence(0), timestamp(0) {}
+	};
+
+	void Add(LONG64 sequence, const Pending& frame);
+	void Advance();
+	void Publish(const Pending& frame);
+	static bool PublishDuplicate(const Pending& frame);
+
+	CRITICAL_SECTION lock;
+	std::map<LONG64, Pending> pending;
+	LONG64 nextSequence;
+	size_t window;
+	LONG64 failed;
+
+	FrameCommitter(const FrameCommitter&);
+	FrameCommitter& operator=(const FrameCommitter&);
+};
@@ -0,0 +1,124 @@
+#include "FrameHash.h"
+
+#include <string.h>
+
+static const uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+static const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t RotateLeft(uint64_t x, int bits)
+{
+	return (x << bits) | (x >> (64 - bits));
+}
+
+static inline uint64_t Read64(const uint8_t* p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t Read32(const uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t Round(uint64_t lane, uint64_t input)
+{
+	lane += input * kPrime2;
+	return RotateLeft(lane, 31) * kPrime1;
+}
+
+static inline uint64_t MergeRound(uint64_t hash, uint64_t lane)
+{
+	hash ^= Round(0, lane);
+	return hash * kPrime1 + kPrime4;
+}
+
+// Consumes whole 32-byte stripes, returns the bytes left over
+static size_t Consume(uint64_t lanes[4], const uint8_t* p, size_t size)
+{
+	uint64_t l0 = lanes[0], l1 = lanes[1], l2 = lanes[2], l3 = lanes[3];
+	size_t stripes = size / 32;
+	for (size_t i = 0; i < stripes; ++i, p += 32) {
+		l0 = Round(l0, Read64(p));
+		l1 = Round(l1, Read64(p + 8));
+		l2 = Round(l2, Read64(p + 16));
+		l3 = Round(l3, Read64(p + 24));
+	}
+	lanes[0] = l0;
+	lanes[1] = l1;
+	lanes[2] = l2;
+	lanes[3] = l3;
+	return size - stripes * 32;
+}
+
+
+//--------------------------------------------------------------------------------------
+FrameHash::FrameHash(uint64_t seed)
+	: seed(seed), totalSize(0), buffered(0)
+{
+	lanes[0] = seed + kPrime1 + kPrime2;
+	lanes[1] = seed + kPrime2;
+	lanes[2] = seed;
+	lanes[3] = seed - kPrime1;
+}
+
+void FrameHash::Update(const void* data, size_t size)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	totalSize += size;
+
+	// Top up a partial stripe left by the previous row first
+	if (buffered > 0) {
+		size_t take = 32 - buffered < size ? 32 - buffered : size;
+		memcpy(buffer + buffered, p, take);
+		buffered += take;
+		p += take;
+		size -= take;
+		if (buffered < 32)
+			return;
+		Consume(lanes, buffer, 32);
+		buffered = 0;
+	}
+
+	size_t rest = Consume(lanes, p, size);
+	memcpy(buffer, p + size - rest, rest);
+	buffered = rest;
+}
+
+uint64_t FrameHash::Digest() const
+{
+	uint64_t hash;
+	if (totalSize >= 32) {
+		hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+		for (int i = 0; i < 4; ++i)
+			hash = MergeRound(hash, lanes[i]);
+	} else {
+		hash = seed + kPrime5;
+	}
+	hash += totalSize;
+
+	const uint8_t* p = buffer;
+	size_t size = buffered;
+	for (; size >= 8; size -= 8, p += 8)
+		hash = RotateLeft(hash ^ Round(0, Read64(p)), 27) * kPrime1 + kPrime4;
+	if (size >= 4) {
+		hash = RotateLeft(hash ^ (Read32(p) * kPrime1), 23) * kPrime2 + kPrime3;
+		size -= 4;
+		p += 4;
+	}
+	for (; size > 0; --size, ++p)
+		hash = RotateLeft(hash ^ (*p * kPrime5), 11) * kPrime1;
+
+	hash ^= hash >> 33;
+	hash *= kPrime2;
+	hash ^= hash >> 29;
+	hash *= kPrime3;
+	hash ^= hash >> 32;
+	return hash;
+}
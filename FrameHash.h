@@ -0,0 +1,31 @@
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <stddef.h>
+
+#pragma warning(push)
+#pragma warning(disable : 4005)
+#include <stdint.h>
+#pragma warning(pop)
+
+// Streaming XXH64 (https://github.com/Cyan4973/xxHash), fed one converted row at a time while
+// the row is still in cache. Four independent multiply chains keep it well ahead of the copy
+// it rides along with. Used to spot frames identical to the one before.
+class FrameHash
+{
+public:
+	explicit FrameHash(uint64_t seed = 0);
+
+	void Update(const void* data, size_t size);
+
+	// Hash of everything passed to Update so far; Update may continue afterwards
+	uint64_t Digest() const;
+
+private:
+	uint64_t lanes[4];
+	uint64_t seed;
+	uint64_t totalSize;
+	uint8_t buffer[32];
+	size_t buffered;
+};
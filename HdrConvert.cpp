@@ -0,0 +1,197 @@
+#include "HdrConvert.h"
+
+#include <math.h>
+#include <string.h>
+#include <immintrin.h>
+
+//--------------------------------------------------------------------------------------
+// Linear 16-bit value to sRGB 16-bit. One spare entry lets the AVX2 gather read 32 bits at
+// the last index.
+static uint16_t srgbTable[65536 + 1];
+
+static bool BuildSrgbTable()
+{
+	for (int i = 0; i < 65536; ++i) {
+		double v = i / 65535.0;
+		v = v <= 0.0031308 ? v * 12.92 : 1.055 * pow(v, 1.0 / 2.4) - 0.055;
+		srgbTable[i] = (uint16_t)(v * 65535.0 + 0.5);
+	}
+	srgbTable[65536] = 0;
+	return true;
+}
+static bool srgbTableBuilt = BuildSrgbTable();
+
+static float HalfToFloat(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1F;
+	uint32_t mantissa = h & 0x3FF;
+	uint32_t bits;
+	if (exponent == 0x1F) {
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	} else if (exponent != 0) {
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	} else if (mantissa != 0) {
+		// Denormal: shift the mantissa up until it has an implicit leading one
+		exponent = 113;
+		while (!(mantissa & 0x400)) {
+			mantissa <<= 1;
+			--exponent;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+	} else {
+		bits = sign;
+	}
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+static void LoadPixel(PixelLayout layout, const uint8_t* src, size_t index, float rgba[4])
+{
+	if (layout == kPixelRGBA16F) {
+		const uint16_t* h = reinterpret_cast<const uint16_t*>(src) + index * 4;
+		for (int c = 0; c < 4; ++c)
+			rgba[c] = HalfToFloat(h[c]);
+	} else {
+		memcpy(rgba, reinterpret_cast<const float*>(src) + index * 4, 4 * sizeof(float));
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+static const float kMaxInput = 65504.0f;
+
+static float ToneMapCurve(ToneMapOperator op, float x)
+{
+	// Clamping to the largest half keeps infinities out of the curves; also catches NaN
+	x = x > 0.0f ? (x < kMaxInput ? x : kMaxInput) : 0.0f;
+	if (op == kToneMapReinhard)
+		return x / (1.0f + x);
+	if (op == kToneMapACES)
+		return (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+	return x;
+}
+
+static uint16_t ToUnorm16(float x)
+{
+	x = x > 0.0f ? (x < 1.0f ? x : 1.0f) : 0.0f;
+	return (uint16_t)(int)(x * 65535.0f + 0.5f);
+}
+
+static void ToneMapScalar(PixelLayout layout, const uint8_t* src, uint8_t* dst, size_t pixels,
+						  ToneMapOperator op, float exposure)
+{
+	for (size_t i = 0; i < pixels; ++i) {
+		// Read the whole pixel before writing, dst may overlap it
+		float rgba[4];
+		LoadPixel(layout, src, i, rgba);
+		uint16_t out[4];
+		for (int c = 0; c < 3; ++c)
+			out[c] = srgbTable[ToUnorm16(ToneMapCurve(op, rgba[c] * exposure))];
+		out[3] = ToUnorm16(rgba[3]);
+
+		uint8_t* d = dst + i * 8;
+		for (int c = 0; c < 4; ++c) {
+			d[c * 2] = (uint8_t)(out[c] >> 8);
+			d[c * 2 + 1] = (uint8_t)out[c];
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Two RGBA pixels per 8-wide vector; the alpha lanes (3 and 7) skip the curve and sRGB table
+template <ToneMapOperator op>
+static inline __m256 ToneMapCurveAVX2(__m256 x)
+{
+	if (op == kToneMapReinhard)
+		return _mm256_div_ps(x, _mm256_add_ps(_mm256_set1_ps(1.0f), x));
+	if (op == kToneMapACES) {
+		__m256 num = _mm256_mul_ps(x, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.51f), x), _mm256_set1_ps(0.03f)));
+		__m256 den = _mm256_add_ps(_mm256_mul_ps(x, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.43f), x), _mm256_set1_ps(0.59f))), _mm256_set1_ps(0.14f));
+		return _mm256_div_ps(num, den);
+	}
+	return x;
+}
+
+template <ToneMapOperator op>
+static void ToneMapAVX2(PixelLayout layout, const uint8_t* src, uint8_t* dst, size_t pixels,
+						float exposure)
+{
+	const __m256 scale = _mm256_setr_ps(exposure, exposure, exposure, 1.0f, exposure, exposure, exposure, 1.0f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 maxInput = _mm256_set1_ps(kMaxInput);
+	const __m256 maxValue = _mm256_set1_ps(65535.0f);
+	const __m256i low16 = _mm256_set1_epi32(0xFFFF);
+	const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	const bool half = layout == kPixelRGBA16F;
+
+	size_t i = 0;
+	for (; i + 2 <= pixels; i += 2) {
+		__m256 v = half
+			? _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 8)))
+			: _mm256_loadu_ps(reinterpret_cast<const float*>(src + i * 16));
+
+		// max with zero first, it also turns NaN into 0
+		__m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(v, scale), zero), maxInput);
+		__m256 c = ToneMapCurveAVX2<op>(x);
+		c = _mm256_blend_ps(c, _mm256_max_ps(v, zero), 0x88);
+		c = _mm256_min_ps(c, one);
+
+		__m256i linear = _mm256_cvtps_epi32(_mm256_mul_ps(c, maxValue));
+		__m256i encoded = _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int*>(srgbTable), linear, 2), low16);
+		encoded = _mm256_blend_epi32(encoded, linear, 0x88);
+
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(encoded, encoded), 0x08);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 8), _mm_shuffle_epi8(_mm256_castsi256_si128(packed), swap));
+	}
+
+	size_t done = i;
+	const uint8_t* rest = src + done * (half ? 8 : 16);
+	ToneMapScalar(layout, rest, dst + done * 8, pixels - done, op, exposure);
+}
+
+
+//--------------------------------------------------------------------------------------
+static bool hasAVX2AndF16C = GetCpuFeatures().avx2 && GetCpuFeatures().f16c;
+
+void ToneMapPixels(PixelLayout layout, const uint8_t* src, uint8_t* dst, size_t pixels,
+				   ToneMapOperator op, float exposure)
+{
+	if (!hasAVX2AndF16C) {
+		ToneMapScalar(layout, src, dst, pixels, op, exposure);
+		return;
+	}
+
+	switch (op) {
+	case kToneMapReinhard:
+		ToneMapAVX2<kToneMapReinhard>(layout, src, dst, pixels, exposure);
+		break;
+	case kToneMapACES:
+		ToneMapAVX2<kToneMapACES>(layout, src, dst, pixels, exposure);
+		break;
+	default:
+		ToneMapAVX2<kToneMapClamp>(layout, src, dst, pixels, exposure);
+		break;
+	}
+}
+
+void ExtractFloatRGB(PixelLayout layout, const uint8_t* src, float* dst, size_t pixels)
+{
+	size_t i = 0;
+	if (layout == kPixelRGBA16F && hasAVX2AndF16C) {
+		for (; i + 2 <= pixels; i += 2) {
+			float rgba[8];
+			_mm256_storeu_ps(rgba, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 8))));
+			memcpy(dst + i * 3, rgba, 3 * sizeof(float));
+			memcpy(dst + i * 3 + 3, rgba + 4, 3 * sizeof(float));
+		}
+	}
+	for (; i < pixels; ++i) {
+		float rgba[4];
+		LoadPixel(layout, src, i, rgba);
+		memcpy(dst + i * 3, rgba, 3 * sizeof(float));
+	}
+}
@@ -0,0 +1,28 @@
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include "PixelConvert.h"
+
+// Conversion of float captures (kPixelRGBA16F and kPixelRGBA32F) for the encoder workers.
+// Half floats are widened with F16C and tone mapped with AVX2 where the CPU has both.
+
+enum ToneMapOperator
+{
+	kToneMapClamp = 0, // linear, clipped at 1
+	kToneMapReinhard,  // x / (1 + x)
+	kToneMapACES,      // Narkowicz's fit of the ACES filmic curve
+};
+
+inline bool IsFloatLayout(PixelLayout layout)
+{
+	return layout == kPixelRGBA16F || layout == kPixelRGBA32F;
+}
+
+// Scales color by exposure, tone maps it and writes sRGB-encoded, big-endian RGBA16; alpha is
+// only clamped. dst may be src, the output is never larger than the input.
+void ToneMapPixels(PixelLayout layout, const uint8_t* src, uint8_t* dst, size_t pixels,
+				   ToneMapOperator op, float exposure);
+
+// Widens pixels to 32-bit float RGB, dropping alpha
+void ExtractFloatRGB(PixelLayout layout, const uint8_t* src, float* dst, size_t pixels);
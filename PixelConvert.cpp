@@ -0,0 +1,455 @@
+#include "PixelConvert.h"
+#include "FrameHash.h"
+
+#include <string.h>
+#include <intrin.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+
+//--------------------------------------------------------------------------------------
+// Scalar kernels, also used for the tail of every row
+static void SwapRBScalar(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+	for (size_t i = 0; i < pixels; ++i) {
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+		dst[3] = src[3];
+		src += 4;
+		dst += 4;
+	}
+}
+
+static void SwapRBDropAlphaScalar(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+	for (size_t i = 0; i < pixels; ++i) {
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+		src += 4;
+		dst += 3;
+	}
+}
+
+static void Swap16Scalar(const uint8_t* src, uint8_t* dst, size_t values)
+{
+	for (size_t i = 0; i < values; ++i) {
+		dst[0] = src[1];
+		dst[1] = src[0];
+		src += 2;
+		dst += 2;
+	}
+}
+
+static void RG8ToRGB8Scalar(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+	for (size_t i = 0; i < pixels; ++i) {
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = 0;
+		src += 2;
+		dst += 3;
+	}
+}
+
+static void RG16ToRGB16Scalar(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+	for (size_t i = 0; i < pixels; ++i) {
+		dst[0] = src[1];
+		dst[1] = src[0];
+		dst[2] = src[3];
+		dst[3] = src[2];
+		dst[4] = 0;
+		dst[5] = 0;
+		src += 4;
+		dst += 6;
+	}
+}
+
+// Widens a 10-bit channel by repeating its top bits, so 0 and the maximum map onto 0 and 65535
+static inline uint32_t Expand10To16(uint32_t v) { return (v << 6) | (v >> 4); }
+
+static void RGB10A2ToRGBA16Scalar(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+	for (size_t i = 0; i < pixels; ++i) {
+		uint32_t p = src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t)src[3] << 24);
+		uint32_t c[4] = {
+			Expand10To16(p & 0x3FF),
+			Expand10To16((p >> 10) & 0x3FF),
+			Expand10To16((p >> 20) & 0x3FF),
+			(p >> 30) * 0x5555
+		};
+		for (int k = 0; k < 4; ++k) {
+			dst[k * 2] = (uint8_t)(c[k] >> 8);
+			dst[k * 2 + 1] = (uint8_t)c[k];
+		}
+		src += 4;
+		dst += 8;
+	}
+}
+
+static void B5G6R5ToRGB8Scalar(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+	for (size_t i = 0; i < pixels; ++i) {
+		unsigned v = src[0] | (src[1] << 8);
+		unsigned r = v >> 11, g = (v >> 5) & 0x3F, b = v & 0x1F;
+		dst[0] = (uint8_t)((r << 3) | (r >> 2));
+		dst[1] = (uint8_t)((g << 2) | (g >> 4));
+		dst[2] = (uint8_t)((b << 3) | (b >> 2));
+		src += 2;
+		dst += 3;
+	}
+}
+
+static void BGR5A1ToRGBA8Scalar(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+	for (size_t i = 0; i < pixels; ++i) {
+		unsigned v = src[0] | (src[1] << 8);
+		unsigned r = (v >> 10) & 0x1F, g = (v >> 5) & 0x1F, b = v & 0x1F;
+		dst[0] = (uint8_t)((r << 3) | (r >> 2));
+		dst[1] = (uint8_t)((g << 3) | (g >> 2));
+		dst[2] = (uint8_t)((b << 3) | (b >> 2));
+		dst[3] = (v & 0x8000) ? 255 : 0;
+		src += 2;
+		dst += 4;
+	}
+}
+
+static void BGRA4ToRGBA8Scalar(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+	for (size_t i = 0; i < pixels; ++i) {
+		dst[0] = (uint8_t)((src[1] & 0x0F) * 17);
+		dst[1] = (uint8_t)((src[0] >> 4) * 17);
+		dst[2] = (uint8_t)((src[0] & 0x0F) * 17);
+		dst[3] = (uint8_t)((src[1] >> 4) * 17);
+		src += 2;
+		dst += 4;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// SSE2 has no byte shuffle; red and blue trade places with shifts and masks, 4 pixels at a time
+static void SwapRBSSE2(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+	const __m128i keep = _mm_set1_epi32(0xFF00FF00);
+	const __m128i low = _mm_set1_epi32(0x000000FF);
+	size_t i = 0;
+	for (; i + 4 <= pixels; i += 4) {
+		__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+		__m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), low);
+		__m128i b = _mm_slli_epi32(_mm_and_si128(p, low), 16);
+		p = _mm_or_si128(_mm_and_si128(p, keep), _mm_or_si128(r, b));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), p);
+	}
+	SwapRBScalar(src + i * 4, dst + i * 4, pixels - i);
+}
+
+// Packing 4-byte pixels into 3 needs a byte shuffle, so without AVX2 this stays scalar
+static void SwapRBDropAlphaSSE2(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+	SwapRBDropAlphaScalar(src, dst, pixels);
+}
+
+static void Swap16SSE2(const uint8_t* src, uint8_t* dst, size_t values)
+{
+	size_t i = 0;
+	for (; i + 8 <= values; i += 8) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2), v);
+	}
+	Swap16Scalar(src + i * 2, dst + i * 2, values - i);
+}
+
+static void RGB10A2ToRGBA16SSE2(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+	const __m128i mask = _mm_set1_epi32(0x3FF);
+	const __m128i alphaScale = _mm_set1_epi32(0x5555);
+	size_t i = 0;
+	for (; i + 4 <= pixels; i += 4) {
+		__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+		__m128i r = _mm_and_si128(p, mask);
+		__m128i g = _mm_and_si128(_mm_srli_epi32(p, 10), mask);
+		__m128i b = _mm_and_si128(_mm_srli_epi32(p, 20), mask);
+		__m128i a = _mm_mullo_epi16(_mm_srli_epi32(p, 30), alphaScale);
+		r = _mm_or_si128(_mm_slli_epi32(r, 6), _mm_srli_epi32(r, 4));
+		g = _mm_or_si128(_mm_slli_epi32(g, 6), _mm_srli_epi32(g, 4));
+		b = _mm_or_si128(_mm_slli_epi32(b, 6), _mm_srli_epi32(b, 4));
+
+		// Interleave into R G B A words, then make them big-endian
+		__m128i rg = _mm_or_si128(r, _mm_slli_epi32(g, 16));
+		__m128i ba = _mm_or_si128(b, _mm_slli_epi32(a, 16));
+		__m128i lo = _mm_unpacklo_epi32(rg, ba);
+		__m128i hi = _mm_unpackhi_epi32(rg, ba);
+		lo = _mm_or_si128(_mm_slli_epi16(lo, 8), _mm_srli_epi16(lo, 8));
+		hi = _mm_or_si128(_mm_slli_epi16(hi, 8), _mm_srli_epi16(hi, 8));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 8), lo);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 8 + 16), hi);
+	}
+	RGB10A2ToRGBA16Scalar(src + i * 4, dst + i * 8, pixels - i);
+}
+
+
+//--------------------------------------------------------------------------------------
+static void SwapRBAVX2(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+	const __m256i order = _mm256_setr_epi8(
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	size_t i = 0;
+	for (; i + 8 <= pixels; i += 8) {
+		__m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_shuffle_epi8(p, order));
+	}
+	SwapRBScalar(src + i * 4, dst + i * 4, pixels - i);
+}
+
+static void SwapRBDropAlphaAVX2(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+	// Each lane packs its 4 pixels into its low 12 bytes, then the two halves are joined
+	const __m256i order = _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+	size_t i = 0;
+	for (; i + 8 <= pixels; i += 8) {
+		__m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+		p = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(p, order), join);
+		uint8_t* out = dst + i * 3;
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(p));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(out + 16), _mm256_extracti128_si256(p, 1));
+	}
+	SwapRBDropAlphaScalar(src + i * 4, dst + i * 3, pixels - i);
+}
+
+static void Swap16AVX2(const uint8_t* src, uint8_t* dst, size_t values)
+{
+	const __m256i order = _mm256_setr_epi8(
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	size_t i = 0;
+	for (; i + 16 <= values; i += 16) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 2));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 2), _mm256_shuffle_epi8(v, order));
+	}
+	Swap16Scalar(src + i * 2, dst + i * 2, values - i);
+}
+
+static void RGB10A2ToRGBA16AVX2(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+	const __m256i mask = _mm256_set1_epi32(0x3FF);
+	const __m256i alphaScale = _mm256_set1_epi32(0x5555);
+	const __m256i order = _mm256_setr_epi8(
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	size_t i = 0;
+	for (; i + 8 <= pixels; i += 8) {
+		__m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+		__m256i r = _mm256_and_si256(p, mask);
+		__m256i g = _mm256_and_si256(_mm256_srli_epi32(p, 10), mask);
+		__m256i b = _mm256_and_si256(_mm256_srli_epi32(p, 20), mask);
+		__m256i a = _mm256_mullo_epi16(_mm256_srli_epi32(p, 30), alphaScale);
+		r = _mm256_or_si256(_mm256_slli_epi32(r, 6), _mm256_srli_epi32(r, 4));
+		g = _mm256_or_si256(_mm256_slli_epi32(g, 6), _mm256_srli_epi32(g, 4));
+		b = _mm256_or_si256(_mm256_slli_epi32(b, 6), _mm256_srli_epi32(b, 4));
+
+		// Unpacking works within each lane, so pixels 0-1,4-5 and 2-3,6-7 get regrouped after
+		__m256i rg = _mm256_or_si256(r, _mm256_slli_epi32(g, 16));
+		__m256i ba = _mm256_or_si256(b, _mm256_slli_epi32(a, 16));
+		__m256i lo = _mm256_unpacklo_epi32(rg, ba);
+		__m256i hi = _mm256_unpackhi_epi32(rg, ba);
+		__m256i first = _mm256_shuffle_epi8(_mm256_permute2x128_si256(lo, hi, 0x20), order);
+		__m256i second = _mm256_shuffle_epi8(_mm256_permute2x128_si256(lo, hi, 0x31), order);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 8), first);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 8 + 32), second);
+	}
+	RGB10A2ToRGBA16Scalar(src + i * 4, dst + i * 8, pixels - i);
+}
+
+
+//--------------------------------------------------------------------------------------
+typedef void (*RowKernel)(const uint8_t* src, uint8_t* dst, size_t pixels);
+
+// Bytes per source and per converted unit, in RowConversion order
+static const struct { size_t src, dst; } kConversionSizes[kRowConversionCount] = {
+	{ 1, 1 }, // kRowCopy
+	{ 4, 4 }, // kRowSwapRB
+	{ 4, 3 }, // kRowSwapRBDropAlpha
+	{ 2, 2 }, // kRowSwap16
+	{ 2, 3 }, // kRowRG8ToRGB8
+	{ 4, 6 }, // kRowRG16ToRGB16
+	{ 4, 8 }, // kRowRGB10A2ToRGBA16
+	{ 2, 3 }, // kRowB5G6R5ToRGB8
+	{ 2, 4 }, // kRowBGR5A1ToRGBA8
+	{ 2, 4 }, // kRowBGRA4ToRGBA8
+};
+
+static CpuFeatures ProbeCpuFeatures()
+{
+	CpuFeatures features = { false, false, false };
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+#if defined(_M_X64)
+	features.sse2 = true;
+#else
+	features.sse2 = (info[3] & (1 << 26)) != 0;
+#endif
+
+	// The OS has to save the YMM registers too, not just the CPU support them
+	const int osxsave = 1 << 27, avx = 1 << 28, f16c = 1 << 29;
+	if ((info[2] & (osxsave | avx)) != (osxsave | avx) || (_xgetbv(0) & 6) != 6)
+		return features;
+	features.f16c = (info[2] & f16c) != 0;
+
+	if (maxLeaf >= 7) {
+		__cpuidex(info, 7, 0);
+		features.avx2 = (info[1] & (1 << 5)) != 0;
+	}
+	return features;
+}
+
+const CpuFeatures& GetCpuFeatures()
+{
+	// Also called while other files' statics are initialized, so it can't be a static here
+	static CpuFeatures features = ProbeCpuFeatures();
+	return features;
+}
+
+// The rarer, 16-bit packed formats only have a scalar kernel
+static RowKernel rowKernels[kRowConversionCount];
+
+static bool SelectRowKernels()
+{
+	rowKernels[kRowCopy] = NULL;
+	rowKernels[kRowSwapRB] = SwapRBScalar;
+	rowKernels[kRowSwapRBDropAlpha] = SwapRBDropAlphaScalar;
+	rowKernels[kRowSwap16] = Swap16Scalar;
+	rowKernels[kRowRG8ToRGB8] = RG8ToRGB8Scalar;
+	rowKernels[kRowRG16ToRGB16] = RG16ToRGB16Scalar;
+	rowKernels[kRowRGB10A2ToRGBA16] = RGB10A2ToRGBA16Scalar;
+	rowKernels[kRowB5G6R5ToRGB8] = B5G6R5ToRGB8Scalar;
+	rowKernels[kRowBGR5A1ToRGBA8] = BGR5A1ToRGBA8Scalar;
+	rowKernels[kRowBGRA4ToRGBA8] = BGRA4ToRGBA8Scalar;
+
+	const CpuFeatures& cpu = GetCpuFeatures();
+	if (cpu.avx2) {
+		rowKernels[kRowSwapRB] = SwapRBAVX2;
+		rowKernels[kRowSwapRBDropAlpha] = SwapRBDropAlphaAVX2;
+		rowKernels[kRowSwap16] = Swap16AVX2;
+		rowKernels[kRowRGB10A2ToRGBA16] = RGB10A2ToRGBA16AVX2;
+	} else if (cpu.sse2) {
+		rowKernels[kRowSwapRB] = SwapRBSSE2;
+		rowKernels[kRowSwapRBDropAlpha] = SwapRBDropAlphaSSE2;
+		rowKernels[kRowSwap16] = Swap16SSE2;
+		rowKernels[kRowRGB10A2ToRGBA16] = RGB10A2ToRGBA16SSE2;
+	}
+	return true;
+}
+static bool rowKernelsSelected = SelectRowKernels();
+
+
+//--------------------------------------------------------------------------------------
+// Every format with a lossless PNG layout, plus the float formats. UINT formats keep their raw values, which is what
+// a debug capture of an integer target wants to see.
+struct FormatConversion
+{
+	DXGI_FORMAT format;
+	RowConversion conversion;
+	PixelLayout layout;
+};
+
+static const FormatConversion kFormatConversions[] = {
+	{ DXGI_FORMAT_R8_TYPELESS,           kRowCopy,             kPixelGrey8 },
+	{ DXGI_FORMAT_R8_UNORM,              kRowCopy,             kPixelGrey8 },
+	{ DXGI_FORMAT_R8_UINT,               kRowCopy,             kPixelGrey8 },
+	{ DXGI_FORMAT_A8_UNORM,              kRowCopy,             kPixelGrey8 },
+
+	{ DXGI_FORMAT_R16_TYPELESS,          kRowSwap16,           kPixelGrey16 },
+	{ DXGI_FORMAT_R16_UNORM,             kRowSwap16,           kPixelGrey16 },
+	{ DXGI_FORMAT_R16_UINT,              kRowSwap16,           kPixelGrey16 },
+	{ DXGI_FORMAT_D16_UNORM,             kRowSwap16,           kPixelGrey16 },
+
+	{ DXGI_FORMAT_R8G8_TYPELESS,         kRowRG8ToRGB8,        kPixelRGB8 },
+	{ DXGI_FORMAT_R8G8_UNORM,            kRowRG8ToRGB8,        kPixelRGB8 },
+	{ DXGI_FORMAT_R8G8_UINT,             kRowRG8ToRGB8,        kPixelRGB8 },
+	{ DXGI_FORMAT_B5G6R5_UNORM,          kRowB5G6R5ToRGB8,     kPixelRGB8 },
+	{ DXGI_FORMAT_B8G8R8X8_TYPELESS,     kRowSwapRBDropAlpha,  kPixelRGB8 },
+	{ DXGI_FORMAT_B8G8R8X8_UNORM,        kRowSwapRBDropAlpha,  kPixelRGB8 },
+	{ DXGI_FORMAT_B8G8R8X8_UNORM_SRGB,   kRowSwapRBDropAlpha,  kPixelRGB8 },
+
+	{ DXGI_FORMAT_R8G8B8A8_TYPELESS,     kRowCopy,             kPixelRGBA8 },
+	{ DXGI_FORMAT_R8G8B8A8_UNORM,        kRowCopy,             kPixelRGBA8 },
+	{ DXGI_FORMAT_R8G8B8A8_UNORM_SRGB,   kRowCopy,             kPixelRGBA8 },
+	{ DXGI_FORMAT_R8G8B8A8_UINT,         kRowCopy,             kPixelRGBA8 },
+	{ DXGI_FORMAT_B8G8R8A8_TYPELESS,     kRowSwapRB,           kPixelRGBA8 },
+	{ DXGI_FORMAT_B8G8R8A8_UNORM,        kRowSwapRB,           kPixelRGBA8 },
+	{ DXGI_FORMAT_B8G8R8A8_UNORM_SRGB,   kRowSwapRB,           kPixelRGBA8 },
+	{ DXGI_FORMAT_B5G5R5A1_UNORM,        kRowBGR5A1ToRGBA8,    kPixelRGBA8 },
+	{ DXGI_FORMAT_B4G4R4A4_UNORM,        kRowBGRA4ToRGBA8,     kPixelRGBA8 },
+
+	{ DXGI_FORMAT_R16G16_TYPELESS,       kRowRG16ToRGB16,      kPixelRGB16 },
+	{ DXGI_FORMAT_R16G16_UNORM,          kRowRG16ToRGB16,      kPixelRGB16 },
+	{ DXGI_FORMAT_R16G16_UINT,           kRowRG16ToRGB16,      kPixelRGB16 },
+
+	{ DXGI_FORMAT_R16G16B16A16_TYPELESS, kRowSwap16,           kPixelRGBA16 },
+	{ DXGI_FORMAT_R16G16B16A16_UNORM,    kRowSwap16,           kPixelRGBA16 },
+	{ DXGI_FORMAT_R16G16B16A16_UINT,     kRowSwap16,           kPixelRGBA16 },
+	{ DXGI_FORMAT_R10G10B10A2_TYPELESS,  kRowRGB10A2ToRGBA16,  kPixelRGBA16 },
+	{ DXGI_FORMAT_R10G10B10A2_UNORM,     kRowRGB10A2ToRGBA16,  kPixelRGBA16 },
+
+	// Float targets are only copied here, converting them is left to the encoder workers
+	{ DXGI_FORMAT_R16G16B16A16_FLOAT,    kRowCopy,             kPixelRGBA16F },
+	{ DXGI_FORMAT_R32G32B32A32_FLOAT,    kRowCopy,             kPixelRGBA32F },
+};
+
+
+//--------------------------------------------------------------------------------------
+RowConversion GetRowConversion(DXGI_FORMAT format, PixelLayout* layout)
+{
+	for (size_t i = 0; i < sizeof(kFormatConversions) / sizeof(kFormatConversions[0]); ++i) {
+		if (kFormatConversions[i].format == format) {
+			*layout = kFormatConversions[i].layout;
+			return kFormatConversions[i].conversion;
+		}
+	}
+	*layout = kPixelRaw;
+	return kRowCopy;
+}
+
+size_t GetConvertedRowBytes(RowConversion conversion, size_t srcRowBytes)
+{
+	return srcRowBytes / kConversionSizes[conversion].src * kConversionSizes[conversion].dst;
+}
+
+void ConvertRows(RowConversion conversion,
+				 const uint8_t* src, size_t srcPitch, size_t srcRowBytes,
+				 uint8_t* dst, size_t dstPitch,
+				 size_t rowCount, bool flip, FrameHash* hash)
+{
+	if (rowCount == 0)
+		return;
+
+	ptrdiff_t dstStep = (ptrdiff_t)dstPitch;
+	if (flip) {
+		dst += (rowCount - 1) * dstPitch;
+		dstStep = -dstStep;
+	}
+
+	RowKernel kernel = rowKernels[conversion];
+	size_t pixels = srcRowBytes / kConversionSizes[conversion].src;
+	size_t dstRowBytes = pixels * kConversionSizes[conversion].dst;
+	for (size_t row = 0; row < rowCount; ++row) {
+		if (kernel)
+			kernel(src, dst, pixels);
+		else
+			memcpy(dst, src, srcRowBytes);
+		if (hash)
+			hash->Update(dst, dstRowBytes);
+		src += srcPitch;
+		dst += dstStep;
+	}
+}
@@ -0,0 +1,73 @@
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <dxgiformat.h>
+#include <stddef.h>
+
+#pragma warning(push)
+#pragma warning(disable : 4005)
+#include <stdint.h>
+#pragma warning(pop)
+
+// Converts mapped texture rows into the layout the encoders take, in a single pass over the
+// frame: the copy out of the staging texture, the vertical flip and the channel swizzle are
+// fused into one row kernel. SSE2 and AVX2 versions are picked at runtime.
+
+// Layout of the pixels carried by a captured frame. 16-bit channels are stored big-endian,
+// the way PNG keeps them.
+enum PixelLayout
+{
+	kPixelRaw = 0, // texture rows as mapped, no conversion
+	kPixelGrey8,
+	kPixelGrey16,
+	kPixelRGB8,
+	kPixelRGBA8,
+	kPixelRGB16,
+	kPixelRGBA16,
+	kPixelRGBA16F, // half floats, little-endian; tone mapped by the encoders
+	kPixelRGBA32F, // floats, little-endian; tone mapped by the encoders
+};
+
+// What happens to each row on its way out of the staging texture
+enum RowConversion
+{
+	kRowCopy = 0,
+	kRowSwapRB,           // BGRA8 -> RGBA8
+	kRowSwapRBDropAlpha,  // BGRX8 -> RGB8
+	kRowSwap16,           // 16-bit little-endian channels -> big-endian
+	kRowRG8ToRGB8,        // blue left at zero
+	kRowRG16ToRGB16,      // blue left at zero
+	kRowRGB10A2ToRGBA16,
+	kRowB5G6R5ToRGB8,
+	kRowBGR5A1ToRGBA8,
+	kRowBGRA4ToRGBA8,
+	kRowConversionCount
+};
+
+// Picks the conversion for a texture format and the cheapest layout that holds it without
+// loss. Formats without a PNG layout come back as kRowCopy and kPixelRaw.
+RowConversion GetRowConversion(DXGI_FORMAT format, PixelLayout* layout);
+
+// Bytes a source row of srcRowBytes takes once converted
+size_t GetConvertedRowBytes(RowConversion conversion, size_t srcRowBytes);
+
+class FrameHash;
+
+// Converts rowCount rows of srcRowBytes each. With flip the first source row lands in the
+// last destination row. If hash is given, each converted row is added to it right after it is
+// written, in source row order.
+void ConvertRows(RowConversion conversion,
+				 const uint8_t* src, size_t srcPitch, size_t srcRowBytes,
+				 uint8_t* dst, size_t dstPitch,
+				 size_t rowCount, bool flip, FrameHash* hash = NULL);
+
+// Instruction sets both the CPU and the OS support, probed once. The row kernels here and the
+// tone mapping in HdrConvert pick their versions from it.
+struct CpuFeatures
+{
+	bool sse2;
+	bool avx2;
+	bool f16c;
+};
+const CpuFeatures& GetCpuFeatures();
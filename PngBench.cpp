@@ -0,0 +1,861 @@
+// Microbenchmarks for the PNG encoder in lodepng and the conversions that feed it.
+//
+//   PngBench --filters [width] [height]
+//   PngBench --minsum [width] [height]
+//   PngBench --convert [width] [height]
+//   PngBench --hdr [width] [height]
+//   PngBench --encode [png...]
+//   PngBench --qoi [png...]
+//   PngBench --lz77 [png...]
+//   PngBench --threads [png...]
+//   PngBench --deflate-threads [png...]
+//
+// --filters runs each PNG filter over a width x height frame with 1 to 8 bytes per pixel, with
+// the SIMD kernels the encoder picked for this CPU and with the plain C version, checks that both
+// give the same bytes and reports MB/s of each. --minsum does the same for choosing the filter of
+// each row with the minimum sum heuristic: the one pass sums the encoder uses against filtering
+// every row five times and summing each attempt.
+//
+// --convert takes a width x height frame of each texture format through ConvertRows the way a
+// readback does, from rows padded to 256 bytes and flipped, and reports GB/s of texture read
+// alone and with the content hash that duplicate detection adds. --hdr converts a half and a float
+// frame the way the encoder workers do, tone mapped with each operator and widened to RGB for a
+// PFM, and reports milliseconds per megapixel.
+//
+// --encode encodes a corpus with EncodePng at every compression level and reports MB/s of pixels
+// against the size of the PNGs, then does the same with EncodePngFile into a temporary file,
+// which streams except at levels 8 and 9 below kPngStreamingBytes. The corpus is the given PNG
+// files, decoded to RGBA, or else a synthetic frame; compare runs before and after an encoder
+// change on the same corpus. --qoi encodes the same corpus as QOI and as a PNG at the default
+// level, checks the QOI files decode back to the pixels and reports MB/s and size of both.
+// --lz77 takes the same corpus through the Up filter and deflates it with a range of match
+// finder settings, from a single probe to whole hash chains, for deflate MB/s against ratio
+// alone.
+// --threads encodes the corpus at the default level on 1 up to one thread per CPU, each thread
+// taking the next frame as it finishes one the way the plugin's encoder workers do, and reports
+// frames/s for each thread count SetEncoderThreadCount could be given. --deflate-threads encodes
+// each image of the corpus as grey, RGB, RGBA and 16-bit RGBA at levels 1, 6 and 8 with 1 up to
+// one deflate thread per CPU (at least 4), reports ms per frame and the size against one thread,
+// and fails unless lodepng::decode gives back the pixels of every file.
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include "FrameHash.h"
+#include "HdrConvert.h"
+#include "PixelConvert.h"
+#include "PngEncoder.h"
+#include "QoiCodec.h"
+#include "lodepng.h"
+
+//--------------------------------------------------------------------------------------
+static double Seconds(const LARGE_INTEGER& start, const LARGE_INTEGER& end)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return (double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+}
+
+// A gradient with some noise, like Archive2Png's benchmark frame
+static void MakeFrame(std::vector<unsigned char>& pixels, size_t rowBytes, unsigned height)
+{
+	pixels.resize(rowBytes * height);
+	for (size_t i = 0; i < pixels.size(); ++i)
+		pixels[i] = (unsigned char)((i % rowBytes) + (i / rowBytes) + (rand() & 15));
+}
+
+
+//--------------------------------------------------------------------------------------
+typedef void (*FilterFunction)(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+							   size_t length, size_t bytewidth, unsigned char filterType);
+
+static double FilterSeconds(FilterFunction filter, const std::vector<unsigned char>& pixels,
+							std::vector<unsigned char>& out, size_t rowBytes, unsigned height, size_t bytewidth,
+							unsigned char filterType)
+{
+	LARGE_INTEGER start, end;
+	QueryPerformanceCounter(&start);
+	for (unsigned y = 0; y < height; ++y) {
+		const unsigned char* prevline = y == 0 ? NULL : &pixels[(y - 1) * rowBytes];
+		filter(&out[y * rowBytes], &pixels[y * rowBytes], prevline, rowBytes, bytewidth, filterType);
+	}
+	QueryPerformanceCounter(&end);
+	return Seconds(start, end);
+}
+
+static int Filters(unsigned width, unsigned height)
+{
+	static const char* const names[5] = { "None", "Sub", "Up", "Average", "Paeth" };
+	static const size_t bytewidths[6] = { 1, 2, 3, 4, 6, 8 };
+	const int repeats = 5;
+
+	printf("%ux%u, kernels: %s\n", width, height, lodepng_filter_kernels());
+	printf("bpp  filter     scalar MB/s    kernel MB/s  speedup\n");
+	int mismatches = 0;
+	for (size_t b = 0; b < 6; ++b) {
+		size_t rowBytes = (size_t)width * bytewidths[b];
+		std::vector<unsigned char> pixels, scalar(rowBytes * height), kernel(rowBytes * height);
+		MakeFrame(pixels, rowBytes, height);
+		for (unsigned char type = 0; type < 5; ++type) {
+			// Best of a few runs, the first one also warms the caches
+			double scalarSeconds = 1e30, kernelSeconds = 1e30;
+			for (int r = 0; r < repeats; ++r) {
+				double s = FilterSeconds(lodepng_filter_scanline_scalar, pixels, scalar, rowBytes, height,
+					bytewidths[b], type);
+				double k = FilterSeconds(lodepng_filter_scanline, pixels, kernel, rowBytes, height,
+					bytewidths[b], type);
+				if (s < scalarSeconds) scalarSeconds = s;
+				if (k < kernelSeconds) kernelSeconds = k;
+			}
+			bool same = scalar == kernel;
+			if (!same)
+				++mismatches;
+			double megabytes = (double)pixels.size() / 1e6;
+			printf("%3u  %-8s %13.1f  %13.1f  %6.2fx%s\n", (unsigned)bytewidths[b], names[type],
+				megabytes / scalarSeconds, megabytes / kernelSeconds, scalarSeconds / kernelSeconds,
+				same ? "" : "  MISMATCH");
+		}
+	}
+	if (mismatches != 0) {
+		fprintf(stderr, "%d filters differ from the scalar version\n", mismatches);
+		return 1;
+	}
+	return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Filters each row with every filter type into its own scratch row, sums those and keeps the best
+static void MinSumAttempts(const std::vector<unsigned char>& pixels, std::vector<unsigned char>& out,
+						   size_t rowBytes, unsigned height, size_t bytewidth)
+{
+	std::vector<unsigned char> attempt[5];
+	for (int type = 0; type < 5; ++type)
+		attempt[type].resize(rowBytes);
+	for (unsigned y = 0; y < height; ++y) {
+		const unsigned char* prevline = y == 0 ? NULL : &pixels[(y - 1) * rowBytes];
+		size_t smallest = 0;
+		int best = 0;
+		for (int type = 0; type < 5; ++type) {
+			lodepng_filter_scanline(&attempt[type][0], &pixels[y * rowBytes], prevline, rowBytes, bytewidth,
+				(unsigned char)type);
+			size_t sum = 0;
+			for (size_t x = 0; x < rowBytes; ++x) {
+				unsigned char s = attempt[type][x];
+				sum += type == 0 ? s : s < 128 ? s : 255u - s;
+			}
+			if (type == 0 || sum < smallest) {
+				best = type;
+				smallest = sum;
+			}
+		}
+		out[y * (rowBytes + 1)] = (unsigned char)best;
+		memcpy(&out[y * (rowBytes + 1) + 1], &attempt[best][0], rowBytes);
+	}
+}
+
+typedef void (*SumsFunction)(size_t sum[5], const unsigned char* scanline, const unsigned char* prevline,
+							 size_t length, size_t bytewidth);
+
+// Sums all filters in one pass and filters the row once, the way the encoder does
+static void MinSumFused(SumsFunction sums, const std::vector<unsigned char>& pixels, std::vector<unsigned char>& out,
+						size_t rowBytes, unsigned height, size_t bytewidth)
+{
+	for (unsigned y = 0; y < height; ++y) {
+		const unsigned char* prevline = y == 0 ? NULL : &pixels[(y - 1) * rowBytes];
+		size_t sum[5];
+		sums(sum, &pixels[y * rowBytes], prevline, rowBytes, bytewidth);
+		int best = 0;
+		for (int type = 1; type < 5; ++type)
+			if (sum[type] < sum[best])
+				best = type;
+		out[y * (rowBytes + 1)] = (unsigned char)best;
+		lodepng_filter_scanline(&out[y * (rowBytes + 1) + 1], &pixels[y * rowBytes], prevline, rowBytes, bytewidth,
+			(unsigned char)best);
+	}
+}
+
+static int MinSum(unsigned width, unsigned height)
+{
+	static const size_t bytewidths[6] = { 1, 2, 3, 4, 6, 8 };
+	const int repeats = 5;
+
+	printf("%ux%u, kernels: %s\n", width, height, lodepng_filter_kernels());
+	printf("bpp  attempts MB/s  fused scalar MB/s  fused kernel MB/s  speedup\n");
+	int mismatches = 0;
+	for (size_t b = 0; b < 6; ++b) {
+		size_t rowBytes = (size_t)width * bytewidths[b];
+		std::vector<unsigned char> pixels;
+		std::vector<unsigned char> attempts(height * (rowBytes + 1)), scalar(attempts.size()), kernel(attempts.size());
+		MakeFrame(pixels, rowBytes, height);
+		double seconds[3] = { 1e30, 1e30, 1e30 };
+		for (int r = 0; r < repeats; ++r) {
+			LARGE_INTEGER start, end;
+			double s;
+			QueryPerformanceCounter(&start);
+			MinSumAttempts(pixels, attempts, rowBytes, height, bytewidths[b]);
+			QueryPerformanceCounter(&end);
+			s = Seconds(start, end);
+			if (s < seconds[0]) seconds[0] = s;
+			QueryPerformanceCounter(&start);
+			MinSumFused(lodepng_filter_sums_scalar, pixels, scalar, rowBytes, height, bytewidths[b]);
+			QueryPerformanceCounter(&end);
+			s = Seconds(start, end);
+			if (s < seconds[1]) seconds[1] = s;
+			QueryPerformanceCounter(&start);
+			MinSumFused(lodepng_filter_sums, pixels, kernel, rowBytes, height, bytewidths[b]);
+			QueryPerformanceCounter(&end);
+			s = Seconds(start, end);
+			if (s < seconds[2]) seconds[2] = s;
+		}
+		bool same = attempts == scalar && attempts == kernel;
+		if (!same)
+			++mismatches;
+		double megabytes = (double)pixels.size() / 1e6;
+		printf("%3u  %13.1f  %17.1f  %17.1f  %6.2fx%s\n", (unsigned)bytewidths[b], megabytes / seconds[0],
+			megabytes / seconds[1], megabytes / seconds[2], seconds[0] / seconds[2], same ? "" : "  MISMATCH");
+	}
+	if (mismatches != 0) {
+		fprintf(stderr, "%d pixel sizes filtered differently from the five attempts\n", mismatches);
+		return 1;
+	}
+	return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// One format for each row conversion, and the float formats that are only copied
+static int Convert(unsigned width, unsigned height)
+{
+	static const struct
+	{
+		const char* name;
+		DXGI_FORMAT format;
+		size_t bytesPerPixel;
+	} formats[] = {
+		{ "R8G8B8A8_UNORM", DXGI_FORMAT_R8G8B8A8_UNORM, 4 },
+		{ "B8G8R8A8_UNORM", DXGI_FORMAT_B8G8R8A8_UNORM, 4 },
+		{ "B8G8R8X8_UNORM", DXGI_FORMAT_B8G8R8X8_UNORM, 4 },
+		{ "R8G8_UNORM", DXGI_FORMAT_R8G8_UNORM, 2 },
+		{ "B5G6R5_UNORM", DXGI_FORMAT_B5G6R5_UNORM, 2 },
+		{ "B5G5R5A1_UNORM", DXGI_FORMAT_B5G5R5A1_UNORM, 2 },
+		{ "B4G4R4A4_UNORM", DXGI_FORMAT_B4G4R4A4_UNORM, 2 },
+		{ "R16_UNORM", DXGI_FORMAT_R16_UNORM, 2 },
+		{ "R16G16_UNORM", DXGI_FORMAT_R16G16_UNORM, 4 },
+		{ "R16G16B16A16_UNORM", DXGI_FORMAT_R16G16B16A16_UNORM, 8 },
+		{ "R10G10B10A2_UNORM", DXGI_FORMAT_R10G10B10A2_UNORM, 4 },
+		{ "R16G16B16A16_FLOAT", DXGI_FORMAT_R16G16B16A16_FLOAT, 8 },
+		{ "R32G32B32A32_FLOAT", DXGI_FORMAT_R32G32B32A32_FLOAT, 16 },
+	};
+	const int repeats = 5;
+
+	printf("%ux%u\n", width, height);
+	printf("format              bytes   GB/s  hashed GB/s\n");
+	for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
+		PixelLayout layout;
+		RowConversion conversion = GetRowConversion(formats[f].format, &layout);
+		size_t rowBytes = (size_t)width * formats[f].bytesPerPixel;
+		size_t srcPitch = (rowBytes + 255) & ~(size_t)255;
+		size_t dstPitch = GetConvertedRowBytes(conversion, rowBytes);
+		std::vector<unsigned char> texture, converted(dstPitch * height);
+		MakeFrame(texture, srcPitch, height);
+
+		double seconds[2] = { 1e30, 1e30 };
+		for (int r = 0; r < repeats; ++r) {
+			for (int hashed = 0; hashed < 2; ++hashed) {
+				LARGE_INTEGER start, end;
+				FrameHash hash;
+				QueryPerformanceCounter(&start);
+				ConvertRows(conversion, &texture[0], srcPitch, rowBytes, &converted[0], dstPitch, height, true,
+					hashed ? &hash : NULL);
+				QueryPerformanceCounter(&end);
+				double s = Seconds(start, end);
+				if (s < seconds[hashed]) seconds[hashed] = s;
+			}
+		}
+		double gigabytes = (double)rowBytes * height / 1e9;
+		printf("%-18s  %2u->%-2u  %5.1f  %11.1f\n", formats[f].name, (unsigned)formats[f].bytesPerPixel,
+			(unsigned)(dstPitch / width), gigabytes / seconds[0], gigabytes / seconds[1]);
+	}
+	return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Colors from about 1/32 up to 8, so every tone map operator has highlights to compress
+static void MakeHdrFrame(std::vector<unsigned char>& pixels, PixelLayout layout, size_t count)
+{
+	if (layout == kPixelRGBA16F) {
+		pixels.resize(count * 8);
+		uint16_t* halves = reinterpret_cast<uint16_t*>(&pixels[0]);
+		for (size_t i = 0; i < count * 4; ++i)
+			halves[i] = (uint16_t)(((10 + rand() % 8) << 10) | (rand() & 0x3FF));
+	} else {
+		pixels.resize(count * 16);
+		float* floats = reinterpret_cast<float*>(&pixels[0]);
+		for (size_t i = 0; i < count * 4; ++i)
+			floats[i] = 8.0f * rand() / RAND_MAX;
+	}
+}
+
+static int Hdr(unsigned width, unsigned height)
+{
+	static const struct
+	{
+		const char* name;
+		PixelLayout layout;
+	} layouts[] = {
+		{ "half", kPixelRGBA16F },
+		{ "float", kPixelRGBA32F },
+	};
+	static const char* const operators[3] = { "clamp", "Reinhard", "ACES" };
+	const int repeats = 5;
+
+	size_t count = (size_t)width * height;
+	double megapixels = count / 1e6;
+	printf("%ux%u\n", width, height);
+	printf("input  conversion  ms/MP\n");
+	for (size_t l = 0; l < sizeof(layouts) / sizeof(layouts[0]); ++l) {
+		std::vector<unsigned char> pixels, toneMapped(count * 8);
+		std::vector<float> rgb(count * 3);
+		MakeHdrFrame(pixels, layouts[l].layout, count);
+
+		// The three operators, then the widening to RGB floats that a PFM takes
+		for (int op = 0; op <= 3; ++op) {
+			double best = 1e30;
+			for (int r = 0; r < repeats; ++r) {
+				LARGE_INTEGER start, end;
+				QueryPerformanceCounter(&start);
+				if (op < 3)
+					ToneMapPixels(layouts[l].layout, &pixels[0], &toneMapped[0], count, (ToneMapOperator)op, 1.0f);
+				else
+					ExtractFloatRGB(layouts[l].layout, &pixels[0], &rgb[0], count);
+				QueryPerformanceCounter(&end);
+				double seconds = Seconds(start, end);
+				if (seconds < best) best = seconds;
+			}
+			printf("%-5s  %-10s  %5.2f\n", layouts[l].name, op < 3 ? operators[op] : "PFM RGB",
+				best * 1e3 / megapixels);
+		}
+	}
+	return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+struct CorpusImage
+{
+	std::vector<unsigned char> pixels;
+	unsigned width;
+	unsigned height;
+};
+
+// Something like a rendered frame: smooth gradients, flat panels and a noisy band
+static void MakeSyntheticImage(CorpusImage& image)
+{
+	image.width = 1920;
+	image.height = 1080;
+	image.pixels.resize((size_t)image.width * image.height * 4);
+	for (unsigned y = 0; y < image.height; ++y) {
+		for (unsigned x = 0; x < image.width; ++x) {
+			unsigned char* p = &image.pixels[((size_t)y * image.width + x) * 4];
+			bool panel = x / 240 % 2 == 0 && y / 135 % 2 == 0;
+			bool noise = y > image.height * 3 / 4;
+			p[0] = panel ? 40 : (unsigned char)(x / 8 + (noise ? rand() & 31 : 0));
+			p[1] = panel ? 40 : (unsigned char)(y / 5);
+			p[2] = panel ? 48 : (unsigned char)((x + y) / 12);
+			p[3] = 255;
+		}
+	}
+}
+
+static bool LoadCorpus(const std::vector<const char*>& files, std::vector<CorpusImage>& corpus, size_t& rawBytes)
+{
+	corpus.resize(files.empty() ? 1 : files.size());
+	rawBytes = 0;
+	for (size_t i = 0; i < corpus.size(); ++i) {
+		if (files.empty())
+			MakeSyntheticImage(corpus[i]);
+		else if (lodepng::decode(corpus[i].pixels, corpus[i].width, corpus[i].height, files[i]) != 0) {
+			fprintf(stderr, "%s: could not decode\n", files[i]);
+			return false;
+		}
+		rawBytes += corpus[i].pixels.size();
+	}
+	return true;
+}
+
+static size_t FileSize(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return 0;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fclose(file);
+	return size < 0 ? 0 : (size_t)size;
+}
+
+static int Encode(const std::vector<const char*>& files)
+{
+	const int repeats = 3;
+
+	std::vector<CorpusImage> corpus;
+	size_t rawBytes;
+	if (!LoadCorpus(files, corpus, rawBytes))
+		return 1;
+
+	char tempDirectory[MAX_PATH], tempPath[MAX_PATH];
+	if (GetTempPathA(MAX_PATH, tempDirectory) == 0 || GetTempFileNameA(tempDirectory, "png", 0, tempPath) == 0) {
+		fprintf(stderr, "could not make a temporary file\n");
+		return 1;
+	}
+
+	printf("%u images, %.1f MB of RGBA pixels\n", (unsigned)corpus.size(), rawBytes / 1e6);
+	printf("level      MB/s    size MB   ratio  file MB/s  file size MB\n");
+	std::vector<unsigned char> png;
+	for (int level = kPngMinLevel; level <= kPngMaxLevel; ++level) {
+		double best = 1e30;
+		size_t pngBytes = 0;
+		for (int r = 0; r < repeats; ++r) {
+			LARGE_INTEGER start, end;
+			pngBytes = 0;
+			QueryPerformanceCounter(&start);
+			for (size_t i = 0; i < corpus.size(); ++i) {
+				if (!EncodePng(&corpus[i].pixels[0], corpus[i].width, corpus[i].height, kPixelRGBA8, png, level)) {
+					fprintf(stderr, "could not encode at level %d\n", level);
+					DeleteFileA(tempPath);
+					return 1;
+				}
+				pngBytes += png.size();
+			}
+			QueryPerformanceCounter(&end);
+			double seconds = Seconds(start, end);
+			if (seconds < best) best = seconds;
+		}
+
+		// The same straight to a file, the way the plugin's writers and Spool2Png encode
+		double bestFile = 1e30;
+		size_t fileBytes = 0;
+		for (int r = 0; r < repeats; ++r) {
+			LARGE_INTEGER start, end;
+			fileBytes = 0;
+			QueryPerformanceCounter(&start);
+			for (size_t i = 0; i < corpus.size(); ++i) {
+				if (!EncodePngFile(&corpus[i].pixels[0], corpus[i].width, corpus[i].height, kPixelRGBA8, tempPath,
+					level)) {
+					fprintf(stderr, "could not encode to %s at level %d\n", tempPath, level);
+					DeleteFileA(tempPath);
+					return 1;
+				}
+				fileBytes += FileSize(tempPath);
+			}
+			QueryPerformanceCounter(&end);
+			double seconds = Seconds(start, end);
+			if (seconds < bestFile) bestFile = seconds;
+		}
+		printf("%5d  %8.1f  %9.2f  %5.1f%%  %9.1f  %12.2f\n", level, rawBytes / best / 1e6, pngBytes / 1e6,
+			100.0 * pngBytes / rawBytes, rawBytes / bestFile / 1e6, fileBytes / 1e6);
+	}
+	DeleteFileA(tempPath);
+	return 0;
+}
+
+
+static int Qoi(const std::vector<const char*>& files)
+{
+	const int repeats = 3;
+
+	std::vector<CorpusImage> corpus;
+	size_t rawBytes;
+	if (!LoadCorpus(files, corpus, rawBytes))
+		return 1;
+
+	printf("%u images, %.1f MB of RGBA pixels\n", (unsigned)corpus.size(), rawBytes / 1e6);
+	printf("codec        MB/s    size MB   ratio\n");
+	double seconds[2] = { 1e30, 1e30 };
+	size_t encodedBytes[2] = { 0, 0 };
+	std::vector<unsigned char> encoded;
+	for (int qoi = 0; qoi < 2; ++qoi) {
+		for (int r = 0; r < repeats; ++r) {
+			LARGE_INTEGER start, end;
+			encodedBytes[qoi] = 0;
+			QueryPerformanceCounter(&start);
+			for (size_t i = 0; i < corpus.size(); ++i) {
+				bool ok = qoi
+					? EncodeQoi(&corpus[i].pixels[0], corpus[i].width, corpus[i].height, kPixelRGBA8, encoded)
+					: EncodePng(&corpus[i].pixels[0], corpus[i].width, corpus[i].height, kPixelRGBA8, encoded,
+						kPngDefaultLevel);
+				if (!ok) {
+					fprintf(stderr, "could not encode as %s\n", qoi ? "QOI" : "PNG");
+					return 1;
+				}
+				encodedBytes[qoi] += encoded.size();
+			}
+			QueryPerformanceCounter(&end);
+			double s = Seconds(start, end);
+			if (s < seconds[qoi]) seconds[qoi] = s;
+		}
+		printf("%-9s  %8.1f  %9.2f  %5.1f%%\n", qoi ? "qoi" : "png", rawBytes / seconds[qoi] / 1e6,
+			encodedBytes[qoi] / 1e6, 100.0 * encodedBytes[qoi] / rawBytes);
+	}
+	printf("qoi is %.1fx as fast at %.2fx the size\n", seconds[0] / seconds[1],
+		(double)encodedBytes[1] / encodedBytes[0]);
+
+	// Lossless, or the speed means nothing
+	for (size_t i = 0; i < corpus.size(); ++i) {
+		std::vector<unsigned char> decoded;
+		unsigned width, height, channels;
+		if (!EncodeQoi(&corpus[i].pixels[0], corpus[i].width, corpus[i].height, kPixelRGBA8, encoded)
+			|| !DecodeQoi(&encoded[0], encoded.size(), decoded, width, height, channels)
+			|| width != corpus[i].width || height != corpus[i].height || channels != 4
+			|| decoded != corpus[i].pixels) {
+			fprintf(stderr, "image %u does not round trip through QOI\n", (unsigned)i);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+static int Lz77(const std::vector<const char*>& files)
+{
+	static const struct
+	{
+		const char* name;
+		unsigned singleProbe;
+		unsigned windowSize;
+		unsigned maxChainLength;
+		unsigned goodMatch;
+		unsigned niceMatch;
+		unsigned lazyMatching;
+	} sweep[] = {
+		{ "single probe", 1, 2048, 1, 0, 32, 0 },
+		{ "chain 1", 0, 2048, 1, 0, 32, 0 },
+		{ "chain 4", 0, 2048, 4, 0, 32, 0 },
+		{ "chain 16", 0, 2048, 16, 0, 64, 0 },
+		{ "chain 16 lazy", 0, 2048, 16, 0, 64, 1 },
+		{ "chain 128 lazy", 0, 2048, 128, 0, 128, 1 },
+		{ "chain 128 good 32", 0, 2048, 128, 32, 128, 1 },
+		{ "chain 1024 8K", 0, 8192, 1024, 0, 258, 1 },
+		{ "chain 1024 good 64", 0, 8192, 1024, 64, 258, 1 },
+		{ "chain 4096 32K", 0, 32768, 4096, 0, 258, 1 },
+		{ "chain 4096 good 64", 0, 32768, 4096, 64, 258, 1 },
+	};
+	const int repeats = 3;
+
+	std::vector<CorpusImage> corpus;
+	size_t rawBytes;
+	if (!LoadCorpus(files, corpus, rawBytes))
+		return 1;
+
+	// The scanlines as the encoder would deflate them, each with the Up filter and its type byte
+	std::vector<std::vector<unsigned char> > filtered(corpus.size());
+	size_t filteredBytes = 0;
+	for (size_t i = 0; i < corpus.size(); ++i) {
+		size_t rowBytes = (size_t)corpus[i].width * 4;
+		filtered[i].resize(corpus[i].height * (rowBytes + 1));
+		for (unsigned y = 0; y < corpus[i].height; ++y) {
+			filtered[i][y * (rowBytes + 1)] = 2;
+			lodepng_filter_scanline(&filtered[i][y * (rowBytes + 1) + 1], &corpus[i].pixels[y * rowBytes],
+				y == 0 ? NULL : &corpus[i].pixels[(y - 1) * rowBytes], rowBytes, 4, 2);
+		}
+		filteredBytes += filtered[i].size();
+	}
+
+	printf("%u images, %.1f MB of filtered scanlines\n", (unsigned)corpus.size(), filteredBytes / 1e6);
+	printf("settings                  MB/s    size MB   ratio\n");
+	for (size_t s = 0; s < sizeof(sweep) / sizeof(sweep[0]); ++s) {
+		LodePNGCompressSettings settings;
+		lodepng_compress_settings_init(&settings);
+		settings.singleprobe = sweep[s].singleProbe;
+		settings.windowsize = sweep[s].windowSize;
+		settings.maxchainlength = sweep[s].maxChainLength;
+		settings.goodmatch = sweep[s].goodMatch;
+		settings.nicematch = sweep[s].niceMatch;
+		settings.lazymatching = sweep[s].lazyMatching;
+
+		double best = 1e30;
+		size_t deflatedBytes = 0;
+		for (int r = 0; r < repeats; ++r) {
+			LARGE_INTEGER start, end;
+			deflatedBytes = 0;
+			QueryPerformanceCounter(&start);
+			for (size_t i = 0; i < filtered.size(); ++i) {
+				unsigned char* out = NULL;
+				size_t outSize = 0;
+				if (lodepng_deflate(&out, &outSize, &filtered[i][0], filtered[i].size(), &settings) != 0) {
+					fprintf(stderr, "could not deflate with %s\n", sweep[s].name);
+					return 1;
+				}
+				deflatedBytes += outSize;
+				free(out);
+			}
+			QueryPerformanceCounter(&end);
+			double seconds = Seconds(start, end);
+			if (seconds < best) best = seconds;
+		}
+		printf("%-20s  %8.1f  %9.2f  %5.1f%%\n", sweep[s].name, filteredBytes / best / 1e6, deflatedBytes / 1e6,
+			100.0 * deflatedBytes / filteredBytes);
+	}
+	return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Threads take frames off a shared counter, like the plugin's workers drain its queue
+struct ThreadedEncode
+{
+	const std::vector<CorpusImage>* corpus;
+	LONG frames;
+	volatile LONG next;
+	volatile LONG failed;
+};
+
+static DWORD WINAPI EncodeThread(LPVOID parameter)
+{
+	ThreadedEncode& work = *static_cast<ThreadedEncode*>(parameter);
+	std::vector<unsigned char> png;
+	for (;;) {
+		LONG frame = InterlockedIncrement(&work.next) - 1;
+		if (frame >= work.frames)
+			break;
+		const CorpusImage& image = (*work.corpus)[frame % work.corpus->size()];
+		if (!EncodePng(&image.pixels[0], image.width, image.height, kPixelRGBA8, png, kPngDefaultLevel))
+			InterlockedIncrement(&work.failed);
+	}
+	return 0;
+}
+
+static int Threads(const std::vector<const char*>& files)
+{
+	// The plugin's limit on encoder threads
+	const unsigned maxThreadCount = 32;
+	const int framesPerThread = 4;
+
+	std::vector<CorpusImage> corpus;
+	size_t rawBytes;
+	if (!LoadCorpus(files, corpus, rawBytes))
+		return 1;
+
+	SYSTEM_INFO system;
+	GetSystemInfo(&system);
+	unsigned threadCount = std::max<unsigned>(1, std::min<unsigned>(system.dwNumberOfProcessors, maxThreadCount));
+
+	printf("%u images, %u CPUs, level %d\n", (unsigned)corpus.size(), (unsigned)system.dwNumberOfProcessors,
+		kPngDefaultLevel);
+	printf("threads  frames  frames/s      MB/s  speedup\n");
+	double single = 0;
+	for (unsigned threads = 1; threads <= threadCount; ++threads) {
+		ThreadedEncode work;
+		work.corpus = &corpus;
+		work.frames = (LONG)std::max<size_t>(corpus.size(), threads * framesPerThread);
+		work.next = 0;
+		work.failed = 0;
+
+		LARGE_INTEGER start, end;
+		QueryPerformanceCounter(&start);
+		std::vector<HANDLE> handles;
+		for (unsigned i = 1; i < threads; ++i) {
+			HANDLE handle = CreateThread(NULL, 0, EncodeThread, &work, 0, NULL);
+			if (handle != NULL)
+				handles.push_back(handle);
+		}
+		EncodeThread(&work);
+		if (!handles.empty())
+			WaitForMultipleObjects((DWORD)handles.size(), &handles[0], TRUE, INFINITE);
+		QueryPerformanceCounter(&end);
+		for (size_t i = 0; i < handles.size(); ++i)
+			CloseHandle(handles[i]);
+		if (work.failed != 0) {
+			fprintf(stderr, "could not encode with %u threads\n", threads);
+			return 1;
+		}
+
+		// Frames cycle through the corpus, so the bytes are those of the frames actually encoded
+		size_t bytes = 0;
+		for (LONG i = 0; i < work.frames; ++i)
+			bytes += corpus[i % corpus.size()].pixels.size();
+		double seconds = Seconds(start, end);
+		double framesPerSecond = work.frames / seconds;
+		if (threads == 1)
+			single = framesPerSecond;
+		printf("%7u  %6ld  %8.2f  %8.1f  %6.2fx\n", threads, (long)work.frames, framesPerSecond, bytes / seconds / 1e6,
+			framesPerSecond / single);
+	}
+	return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+static const char* LayoutName(PixelLayout layout)
+{
+	switch (layout) {
+	case kPixelGrey8: return "grey8";
+	case kPixelRGB8: return "rgb8";
+	case kPixelRGBA8: return "rgba8";
+	default: return "rgba16";
+	}
+}
+
+// The image in a layout of 1 to 8 bytes per pixel; the low bytes of 16-bit samples get their own
+// pattern so they don't just repeat the high ones
+static void MakeLayout(const CorpusImage& image, PixelLayout layout, std::vector<unsigned char>& pixels)
+{
+	size_t count = (size_t)image.width * image.height;
+	size_t bytes = layout == kPixelGrey8 ? 1 : layout == kPixelRGB8 ? 3 : layout == kPixelRGBA8 ? 4 : 8;
+	pixels.resize(count * bytes);
+	for (size_t i = 0; i < count; ++i) {
+		const unsigned char* in = &image.pixels[i * 4];
+		unsigned char* out = &pixels[i * bytes];
+		if (layout == kPixelRGBA16) {
+			for (int c = 0; c < 4; ++c) {
+				out[c * 2] = in[c];
+				out[c * 2 + 1] = (unsigned char)(in[c] ^ (i >> 3));
+			}
+		} else {
+			memcpy(out, layout == kPixelGrey8 ? in + 1 : in, bytes);
+		}
+	}
+}
+
+static bool DecodesTo(const std::vector<unsigned char>& png, const std::vector<unsigned char>& pixels,
+					  unsigned width, unsigned height, PixelLayout layout)
+{
+	LodePNGColorType colorType = layout == kPixelGrey8 ? LCT_GREY : layout == kPixelRGB8 ? LCT_RGB : LCT_RGBA;
+	std::vector<unsigned char> decoded;
+	unsigned decodedWidth, decodedHeight;
+	return lodepng::decode(decoded, decodedWidth, decodedHeight, png, colorType, layout == kPixelRGBA16 ? 16 : 8) == 0
+		&& decodedWidth == width && decodedHeight == height && decoded == pixels;
+}
+
+static int DeflateThreads(const std::vector<const char*>& files)
+{
+	static const PixelLayout layouts[4] = { kPixelGrey8, kPixelRGB8, kPixelRGBA8, kPixelRGBA16 };
+	static const int levels[3] = { 1, kPngDefaultLevel, 8 };
+	const int repeats = 3;
+
+	std::vector<CorpusImage> corpus;
+	size_t rawBytes;
+	if (!LoadCorpus(files, corpus, rawBytes))
+		return 1;
+
+	// At least a few threads even on a small machine, so the joined stream is always checked
+	SYSTEM_INFO system;
+	GetSystemInfo(&system);
+	unsigned maxThreads = std::min<unsigned>(std::max<unsigned>(system.dwNumberOfProcessors, 4), kPngMaxDeflateThreads);
+	std::vector<unsigned> threadCounts;
+	for (unsigned threads = 1; threads < maxThreads; threads *= 2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(maxThreads);
+
+	printf("%u images, %u CPUs\n", (unsigned)corpus.size(), (unsigned)system.dwNumberOfProcessors);
+	printf("image  layout  level  threads  ms/frame  speedup   size MB  size\n");
+	int failures = 0;
+	std::vector<unsigned char> pixels, png;
+	for (size_t i = 0; i < corpus.size(); ++i) {
+		const CorpusImage& image = corpus[i];
+		for (size_t l = 0; l < 4; ++l) {
+			MakeLayout(image, layouts[l], pixels);
+			for (size_t v = 0; v < 3; ++v) {
+				double single = 0;
+				size_t singleSize = 0;
+				for (size_t t = 0; t < threadCounts.size(); ++t) {
+					unsigned threads = threadCounts[t];
+					// Best of a few runs; the first also starts the pool's threads
+					double seconds = 1e30;
+					bool ok = true;
+					for (int r = 0; r < repeats && ok; ++r) {
+						LARGE_INTEGER start, end;
+						QueryPerformanceCounter(&start);
+						ok = EncodePng(&pixels[0], image.width, image.height, layouts[l], png, levels[v], NULL,
+							threads);
+						QueryPerformanceCounter(&end);
+						seconds = std::min(seconds, Seconds(start, end));
+					}
+					ok = ok && DecodesTo(png, pixels, image.width, image.height, layouts[l]);
+					if (!ok)
+						++failures;
+					if (threads == 1) {
+						single = seconds;
+						singleSize = png.size();
+					}
+					printf("%5u  %-6s  %5d  %7u  %8.2f  %6.2fx  %8.2f  %+.2f%%%s\n", (unsigned)i, LayoutName(layouts[l]),
+						levels[v], threads, seconds * 1e3, single / seconds, png.size() / 1e6,
+						100.0 * ((double)png.size() / singleSize - 1), ok ? "" : "  FAILED");
+				}
+			}
+		}
+	}
+	StopPngDeflateThreads();
+	if (failures != 0) {
+		fprintf(stderr, "%d encodes failed or did not decode to their pixels\n", failures);
+		return 1;
+	}
+	return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	if (argc >= 2 && strcmp(argv[1], "--filters") == 0) {
+		unsigned width = argc > 2 ? (unsigned)atoi(argv[2]) : 1920;
+		unsigned height = argc > 3 ? (unsigned)atoi(argv[3]) : 1080;
+		if (width == 0 || height == 0) {
+			fprintf(stderr, "width and height must be positive\n");
+			return 2;
+		}
+		return Filters(width, height);
+	}
+	if (argc >= 2 && strcmp(argv[1], "--minsum") == 0) {
+		unsigned width = argc > 2 ? (unsigned)atoi(argv[2]) : 1920;
+		unsigned height = argc > 3 ? (unsigned)atoi(argv[3]) : 1080;
+		if (width == 0 || height == 0) {
+			fprintf(stderr, "width and height must be positive\n");
+			return 2;
+		}
+		return MinSum(width, height);
+	}
+	if (argc >= 2 && strcmp(argv[1], "--convert") == 0) {
+		unsigned width = argc > 2 ? (unsigned)atoi(argv[2]) : 1920;
+		unsigned height = argc > 3 ? (unsigned)atoi(argv[3]) : 1080;
+		if (width == 0 || height == 0) {
+			fprintf(stderr, "width and height must be positive\n");
+			return 2;
+		}
+		return Convert(width, height);
+	}
+	if (argc >= 2 && strcmp(argv[1], "--hdr") == 0) {
+		unsigned width = argc > 2 ? (unsigned)atoi(argv[2]) : 1920;
+		unsigned height = argc > 3 ? (unsigned)atoi(argv[3]) : 1080;
+		if (width == 0 || height == 0) {
+			fprintf(stderr, "width and height must be positive\n");
+			return 2;
+		}
+		return Hdr(width, height);
+	}
+	if (argc >= 2 && strcmp(argv[1], "--encode") == 0)
+		return Encode(std::vector<const char*>(argv + 2, argv + argc));
+	if (argc >= 2 && strcmp(argv[1], "--qoi") == 0)
+		return Qoi(std::vector<const char*>(argv + 2, argv + argc));
+	if (argc >= 2 && strcmp(argv[1], "--lz77") == 0)
+		return Lz77(std::vector<const char*>(argv + 2, argv + argc));
+	if (argc >= 2 && strcmp(argv[1], "--threads") == 0)
+		return Threads(std::vector<const char*>(argv + 2, argv + argc));
+	if (argc >= 2 && strcmp(argv[1], "--deflate-threads") == 0)
+		return DeflateThreads(std::vector<const char*>(argv + 2, argv + argc));
+	fprintf(stderr, "usage: PngBench --filters [width] [height]\n"
+		"       PngBench --minsum [width] [height]\n"
+		"       PngBench --convert [width] [height]\n"
+		"       PngBench --hdr [width] [height]\n"
+		"       PngBench --encode [png...]\n"
+		"       PngBench --qoi [png...]\n"
+		"       PngBench --lz77 [png...]\n"
+		"       PngBench --threads [png...]\n"
+		"       PngBench --deflate-threads [png...]\n");
+	return 2;
+}
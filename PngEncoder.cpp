@@ -0,0 +1,361 @@
+#include "PngEncoder.h"
+
+#include "lodepng.h"
+
+#include <windows.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+
+// PNG color type and bit depth of each PixelLayout
+static const struct { LodePNGColorType colorType; unsigned bitDepth; } kPngLayouts[] = {
+	{ LCT_RGBA, 8 },  // kPixelRaw, never encoded
+	{ LCT_GREY, 8 },  // kPixelGrey8
+	{ LCT_GREY, 16 }, // kPixelGrey16
+	{ LCT_RGB, 8 },   // kPixelRGB8
+	{ LCT_RGBA, 8 },  // kPixelRGBA8
+	{ LCT_RGB, 16 },  // kPixelRGB16
+	{ LCT_RGBA, 16 }, // kPixelRGBA16
+	{ LCT_RGBA, 16 }, // kPixelRGBA16F, never encoded
+	{ LCT_RGBA, 16 }, // kPixelRGBA32F, never encoded
+};
+
+// Deflate and filter settings of each compression level. MINSUM filtering tries all five
+// filters on every row, so the fast levels use the Up filter throughout instead. Level 1 looks
+// up only the newest position of each hash, and the deep searches of 5, 7 and 8 stop walking a
+// chain a quarter of the way in once they hold a match of goodMatch bytes.
+static const struct
+{
+	unsigned btype;
+	unsigned useLZ77;
+	unsigned windowSize;
+	unsigned minMatch;
+	unsigned niceMatch;
+	unsigned lazyMatching;
+	unsigned maxChainLength;
+	unsigned goodMatch;
+	unsigned singleProbe;
+	LodePNGFilterStrategy filterStrategy;
+	unsigned char filterType; // for LFS_PREDEFINED
+	unsigned autoConvert;
+} kPngLevels[] = {
+	{ 0, 0, 2048, 3, 128, 0, 0, 0, 0, LFS_ZERO, 0, 0 },         // 0: stored
+	{ 1, 1, 2048, 3, 32, 0, 1, 0, 1, LFS_PREDEFINED, 2, 0 },    // 1: fixed Huffman, single probe
+	{ 2, 1, 2048, 3, 32, 0, 4, 0, 0, LFS_PREDEFINED, 2, 0 },    // 2
+	{ 2, 1, 2048, 3, 64, 0, 16, 0, 0, LFS_MINSUM, 0, 0 },       // 3
+	{ 2, 1, 2048, 3, 64, 1, 32, 0, 0, LFS_MINSUM, 0, 0 },       // 4
+	{ 2, 1, 2048, 3, 128, 1, 128, 32, 0, LFS_MINSUM, 0, 0 },    // 5
+	{ 2, 1, 2048, 3, 128, 1, 0, 0, 0, LFS_MINSUM, 0, 0 },       // 6: lodepng's defaults
+	{ 2, 1, 8192, 3, 258, 1, 1024, 64, 0, LFS_MINSUM, 0, 0 },   // 7
+	{ 2, 1, 32768, 3, 258, 1, 4096, 64, 0, LFS_MINSUM, 0, 1 },  // 8
+	{ 2, 1, 32768, 3, 258, 1, 0, 0, 0, LFS_MINSUM, 0, 1 },      // 9: whole window, every chain
+};
+
+bool IsPngLayout(PixelLayout layout)
+{
+	return layout >= kPixelGrey8 && layout <= kPixelRGBA16;
+}
+
+// Parallel zlib compression, plugged into lodepng as custom_zlib. The filtered scanlines are cut
+// into one segment per thread; each is deflated on its own, primed with the window before it,
+// and ends in a sync flush, so the segments simply join into one zlib stream. Their Adler32
+// checksums are combined. Segments under kMinDeflateSegmentBytes aren't worth a thread.
+static const size_t kMinDeflateSegmentBytes = 256 << 10;
+
+struct DeflateSegment
+{
+	const unsigned char* in;
+	size_t start;
+	size_t end;
+	unsigned final;
+	const LodePNGCompressSettings* settings;
+	unsigned char* out;
+	size_t outSize;
+	unsigned adler;
+	unsigned error;
+	volatile LONG* remaining; // segments of the frame still being deflated
+	HANDLE done;              // set once remaining reaches 0
+};
+
+// The segments are deflated by a pool of threads shared by every encoder, started as frames ask
+// for more and kept until StopPngDeflateThreads, so a frame doesn't pay for starting threads.
+// Queued segments are taken in order, by the pool or by an encoder waiting on its own frame.
+static CRITICAL_SECTION deflatePoolLock;
+static std::deque<DeflateSegment*> deflateQueue;
+static std::vector<HANDLE> deflatePool;
+static HANDLE deflateWork = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+static volatile bool deflatePoolStopping = false;
+
+static bool InitializeDeflatePoolLock()
+{
+	InitializeCriticalSection(&deflatePoolLock);
+	return true;
+}
+static bool deflatePoolLockInitialized = InitializeDeflatePoolLock();
+
+static void DeflateSegmentNow(DeflateSegment& segment)
+{
+	segment.error = lodepng_deflate_segment(&segment.out, &segment.outSize, segment.in, segment.start, segment.end,
+		segment.final, segment.settings);
+	segment.adler = lodepng_adler32(segment.in + segment.start, segment.end - segment.start);
+	// The frame's encoder may return as soon as it sees the last one finish
+	HANDLE done = segment.done;
+	if (InterlockedDecrement(segment.remaining) == 0)
+		SetEvent(done);
+}
+
+static DeflateSegment* TakeQueuedSegment()
+{
+	DeflateSegment* segment = NULL;
+	EnterCriticalSection(&deflatePoolLock);
+	if (!deflateQueue.empty()) {
+		segment = deflateQueue.front();
+		deflateQueue.pop_front();
+	}
+	LeaveCriticalSection(&deflatePoolLock);
+	return segment;
+}
+
+// A wakeup may find the queue already emptied by an encoder helping out; it waits again
+static DWORD WINAPI DeflatePoolThread(LPVOID)
+{
+	while (WaitForSingleObject(deflateWork, INFINITE) == WAIT_OBJECT_0 && !deflatePoolStopping) {
+		DeflateSegment* segment = TakeQueuedSegment();
+		if (segment != NULL)
+			DeflateSegmentNow(*segment);
+	}
+	return 0;
+}
+
+// Queues segments 1 and up and deflates the first on this thread. Returns false, with nothing
+// queued, if the pool can't take them.
+static bool QueueSegments(std::vector<DeflateSegment>& segments)
+{
+	if (deflateWork == NULL)
+		return false;
+	EnterCriticalSection(&deflatePoolLock);
+	while (deflatePool.size() < segments.size() - 1) {
+		HANDLE thread = CreateThread(NULL, 0, DeflatePoolThread, NULL, 0, NULL);
+		if (thread == NULL)
+			break;
+		deflatePool.push_back(thread);
+	}
+	bool queued = !deflatePool.empty();
+	if (queued) {
+		for (size_t i = 1; i < segments.size(); ++i)
+			deflateQueue.push_back(&segments[i]);
+	}
+	LeaveCriticalSection(&deflatePoolLock);
+	if (queued)
+		ReleaseSemaphore(deflateWork, (LONG)segments.size() - 1, NULL);
+	return queued;
+}
+
+// The threads are joined outside the lock, which one of them may be waiting for
+void StopPngDeflateThreads()
+{
+	std::vector<HANDLE> threads;
+	EnterCriticalSection(&deflatePoolLock);
+	threads.swap(deflatePool);
+	deflatePoolStopping = true;
+	LeaveCriticalSection(&deflatePoolLock);
+
+	if (!threads.empty())
+		ReleaseSemaphore(deflateWork, (LONG)threads.size(), NULL);
+	for (size_t i = 0; i < threads.size(); ++i) {
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+	}
+	// Wakeups nobody consumed would otherwise count towards the next pool
+	while (WaitForSingleObject(deflateWork, 0) == WAIT_OBJECT_0)
+		;
+	deflatePoolStopping = false;
+}
+
+// custom_context points at the thread count
+static unsigned ParallelZlibCompress(unsigned char** out, size_t* outsize, const unsigned char* in, size_t insize,
+									 const LodePNGCompressSettings* settings)
+{
+	unsigned threads = std::min(*static_cast<const unsigned*>(settings->custom_context), kPngMaxDeflateThreads);
+	size_t count = std::max<size_t>(1, std::min<size_t>(threads, insize / kMinDeflateSegmentBytes));
+	HANDLE done = count > 1 ? CreateEvent(NULL, TRUE, FALSE, NULL) : NULL;
+	if (done == NULL) {
+		LodePNGCompressSettings serial = *settings;
+		serial.custom_zlib = NULL;
+		return lodepng_zlib_compress(out, outsize, in, insize, &serial);
+	}
+
+	std::vector<DeflateSegment> segments(count);
+	volatile LONG remaining = (LONG)count;
+	for (size_t i = 0; i < count; ++i) {
+		DeflateSegment& segment = segments[i];
+		segment.in = in;
+		// In 64 bits, insize * count can overflow a 32-bit size_t
+		segment.start = (size_t)((uint64_t)insize * i / count);
+		segment.end = (size_t)((uint64_t)insize * (i + 1) / count);
+		segment.final = i == count - 1;
+		segment.settings = settings;
+		segment.out = NULL;
+		segment.outSize = 0;
+		segment.remaining = &remaining;
+		segment.done = done;
+	}
+	if (QueueSegments(segments)) {
+		DeflateSegmentNow(segments[0]);
+		// Rather than idle, help with whatever is queued, this frame's segments or another's
+		while (InterlockedCompareExchange(&remaining, 0, 0) > 0) {
+			DeflateSegment* segment = TakeQueuedSegment();
+			if (segment == NULL)
+				break;
+			DeflateSegmentNow(*segment);
+		}
+	} else {
+		for (size_t i = 0; i < count; ++i)
+			DeflateSegmentNow(segments[i]);
+	}
+	WaitForSingleObject(done, INFINITE);
+	CloseHandle(done);
+
+	// zlib header as lodepng_zlib_compress writes it, the segments, then the big-endian Adler32
+	unsigned error = 0;
+	size_t total = 2 + 4;
+	unsigned adler = 1;
+	for (size_t i = 0; i < count; ++i) {
+		error = error ? error : segments[i].error;
+		total += segments[i].outSize;
+		adler = lodepng_adler32_combine(adler, segments[i].adler, segments[i].end - segments[i].start);
+	}
+	unsigned char* joined = error ? NULL : static_cast<unsigned char*>(realloc(*out, *outsize + total));
+	if (!error && !joined)
+		error = 83; // lodepng's "memory allocation failed"
+	if (!error) {
+		unsigned char* p = joined + *outsize;
+		*p++ = 120;
+		*p++ = 1;
+		for (size_t i = 0; i < count; ++i) {
+			if (segments[i].outSize > 0)
+				memcpy(p, segments[i].out, segments[i].outSize);
+			p += segments[i].outSize;
+		}
+		*p++ = (unsigned char)(adler >> 24);
+		*p++ = (unsigned char)(adler >> 16);
+		*p++ = (unsigned char)(adler >> 8);
+		*p++ = (unsigned char)adler;
+		*out = joined;
+		*outsize += total;
+	}
+	for (size_t i = 0; i < count; ++i)
+		free(segments[i].out);
+	return error;
+}
+
+// Sets up state for EncodePng and EncodePngFile; filters backs the predefined filter types
+static bool SetupState(lodepng::State& state, std::vector<unsigned char>& filters, unsigned height,
+					   PixelLayout layout, int level, const char* deltaOf, const unsigned& deflateThreads)
+{
+	if (!IsPngLayout(layout))
+		return false;
+
+	level = level < kPngMinLevel ? kPngMinLevel : level > kPngMaxLevel ? kPngMaxLevel : level;
+	LodePNGCompressSettings& zlib = state.encoder.zlibsettings;
+	zlib.btype = kPngLevels[level].btype;
+	zlib.use_lz77 = kPngLevels[level].useLZ77;
+	zlib.windowsize = kPngLevels[level].windowSize;
+	zlib.minmatch = kPngLevels[level].minMatch;
+	zlib.nicematch = kPngLevels[level].niceMatch;
+	zlib.lazymatching = kPngLevels[level].lazyMatching;
+	zlib.maxchainlength = kPngLevels[level].maxChainLength;
+	zlib.goodmatch = kPngLevels[level].goodMatch;
+	zlib.singleprobe = kPngLevels[level].singleProbe;
+	state.encoder.filter_strategy = kPngLevels[level].filterStrategy;
+	// Stored blocks are only copied, threads wouldn't gain anything
+	if (deflateThreads > 1 && zlib.btype != 0) {
+		zlib.custom_zlib = ParallelZlibCompress;
+		zlib.custom_context = &deflateThreads;
+	}
+	if (kPngLevels[level].filterStrategy == LFS_PREDEFINED) {
+		filters.assign(height, kPngLevels[level].filterType);
+		state.encoder.predefined_filters = &filters[0];
+	}
+	state.encoder.auto_convert = kPngLevels[level].autoConvert;
+	state.info_raw.colortype = kPngLayouts[layout].colorType;
+	state.info_raw.bitdepth = kPngLayouts[layout].bitDepth;
+	state.info_png.color.colortype = state.info_raw.colortype;
+	state.info_png.color.bitdepth = state.info_raw.bitdepth;
+	if (deltaOf && *deltaOf) {
+		state.encoder.auto_convert = 0;
+		state.encoder.text_compression = 0; // plain tEXt, so Delta2Png finds it without inflating
+		if (lodepng_add_text(&state.info_png, kDeltaTextKey, deltaOf) != 0)
+			return false;
+	}
+	return true;
+}
+
+bool EncodePng(const uint8_t* pixels, unsigned width, unsigned height, PixelLayout layout,
+			   std::vector<unsigned char>& png, int level, const char* deltaOf, unsigned deflateThreads)
+{
+	lodepng::State state;
+	std::vector<unsigned char> filters;
+	if (!SetupState(state, filters, height, layout, level, deltaOf, deflateThreads))
+		return false;
+
+	png.clear();
+	return lodepng::encode(png, pixels, width, height, state) == 0;
+}
+
+bool EncodePng(const uint8_t* pixels, unsigned width, unsigned height, PixelLayout layout,
+			   unsigned char*& png, size_t& pngSize, int level, const char* deltaOf, unsigned deflateThreads)
+{
+	png = NULL;
+	pngSize = 0;
+	lodepng::State state;
+	std::vector<unsigned char> filters;
+	if (!SetupState(state, filters, height, layout, level, deltaOf, deflateThreads))
+		return false;
+
+	// lodepng may have started the buffer before it failed
+	if (lodepng_encode(&png, &pngSize, pixels, width, height, &state) != 0) {
+		free(png);
+		png = NULL;
+		pngSize = 0;
+		return false;
+	}
+	return true;
+}
+
+static unsigned WriteToFile(void* file, const unsigned char* data, size_t size)
+{
+	return fwrite(data, 1, size, static_cast<FILE*>(file)) == size ? 0 : 79; // lodepng's "failed to open file for writing"
+}
+
+bool EncodePngFile(const uint8_t* pixels, unsigned width, unsigned height, PixelLayout layout,
+				   const std::string& path, int level, const char* deltaOf, unsigned deflateThreads)
+{
+	lodepng::State state;
+	std::vector<unsigned char> filters;
+	if (!SetupState(state, filters, height, layout, level, deltaOf, deflateThreads))
+		return false;
+
+	// The palette and grey reduction of the top levels and parallel deflate need the whole frame;
+	// below the streaming size they are kept, above it memory matters more
+	uint64_t frameBytes = (uint64_t)width * height * lodepng_get_bpp(&state.info_raw) / 8;
+	bool parallel = state.encoder.zlibsettings.custom_zlib != NULL;
+	if ((state.encoder.auto_convert || parallel) && frameBytes < kPngStreamingBytes) {
+		std::vector<unsigned char> png;
+		return lodepng::encode(png, pixels, width, height, state) == 0 && lodepng::save_file(png, path) == 0;
+	}
+	// The streaming encoder only has the built-in deflate, so a frame this large is compressed on
+	// this thread alone
+	state.encoder.auto_convert = 0;
+	state.encoder.zlibsettings.custom_zlib = NULL;
+	state.encoder.zlibsettings.custom_context = NULL;
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+	bool ok = lodepng_encode_stream(WriteToFile, file, pixels, width, height, &state) == 0;
+	return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,60 @@
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <string>
+#include <vector>
+
+#include "PixelConvert.h"
+
+// PNG encoding of converted frames, shared by the plugin's encoder workers and Spool2Png.
+// The pixels already are in the layout the PNG is written in, so lodepng's auto_convert pass,
+// which scans the whole frame looking for a smaller color type, is skipped below level 8.
+
+// Compression levels, zlib style: 0 stores, 1 is the fastest real compression, 9 the smallest
+// files. The default reproduces lodepng's own defaults.
+static const int kPngMinLevel = 0;
+static const int kPngMaxLevel = 9;
+static const int kPngDefaultLevel = 6;
+
+// From this many bytes of pixels EncodePngFile always streams, even at the levels that would
+// otherwise look for a smaller color type first
+static const uint64_t kPngStreamingBytes = 64 << 20;
+
+// Most threads a single PNG is deflated on
+static const unsigned kPngMaxDeflateThreads = 64;
+
+// Text chunk that marks a delta frame (see DeltaFrame.h); its text is the file name of the frame
+// the pixels are an XOR against, in the same directory
+static const char* const kDeltaTextKey = "TextureCaptureDelta";
+
+// False for layouts PNG can't hold: kPixelRaw and the float layouts, which need tone mapping
+bool IsPngLayout(PixelLayout layout);
+
+// Encodes width x height pixels, top row first and rows tightly packed, into png. A delta frame
+// is marked with deltaOf and always keeps its layout, since Delta2Png XORs the raw samples.
+// With deflateThreads above 1 the image data is compressed in that many segments at once, each
+// at least 256 KB; the file gets a few hundred bytes larger per segment. The segments go to a
+// pool of threads shared by every caller, started on first use.
+bool EncodePng(const uint8_t* pixels, unsigned width, unsigned height, PixelLayout layout,
+			   std::vector<unsigned char>& png, int level = kPngDefaultLevel,
+			   const char* deltaOf = NULL, unsigned deflateThreads = 1);
+
+// Like EncodePng, but hands over the buffer lodepng built the file in rather than copying it into
+// a vector. The caller releases png with free(); it is NULL when encoding fails.
+bool EncodePng(const uint8_t* pixels, unsigned width, unsigned height, PixelLayout layout,
+			   unsigned char*& png, size_t& pngSize, int level = kPngDefaultLevel,
+			   const char* deltaOf = NULL, unsigned deflateThreads = 1);
+
+// Encodes like EncodePng straight into the file at path, filtering and compressing a deflate
+// block at a time, so the encoder needs about 256 KB however large the frame. The result
+// decodes to the same pixels; only levels 8 and 9, or several deflateThreads, on frames under
+// kPngStreamingBytes still build the PNG in memory. Larger frames are deflated on one thread
+// whatever deflateThreads says.
+bool EncodePngFile(const uint8_t* pixels, unsigned width, unsigned height, PixelLayout layout,
+				   const std::string& path, int level = kPngDefaultLevel, const char* deltaOf = NULL,
+				   unsigned deflateThreads = 1);
+
+// Ends the threads EncodePng deflates segments on; the pool starts again when next needed. Only
+// call it while nothing is being encoded, such as before the module unloads.
+void StopPngDeflateThreads();
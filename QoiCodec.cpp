@@ -0,0 +1,241 @@
+#include "QoiCodec.h"
+
+#include <string.h>
+
+static const unsigned char kQoiOpIndex = 0x00;
+static const unsigned char kQoiOpDiff = 0x40;
+static const unsigned char kQoiOpLuma = 0x80;
+static const unsigned char kQoiOpRun = 0xC0;
+static const unsigned char kQoiOpRGB = 0xFE;
+static const unsigned char kQoiOpRGBA = 0xFF;
+static const unsigned char kQoiMask = 0xC0;
+
+static const size_t kQoiHeaderSize = 14;
+static const unsigned char kQoiPadding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+static const uint64_t kQoiMaxPixels = 400000000; // the spec's limit
+
+// A pixel packed as r | g << 8 | b << 16 | a << 24, so equality is one compare
+static inline uint32_t PackPixel(unsigned r, unsigned g, unsigned b, unsigned a)
+{
+	return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+static inline unsigned HashPixel(uint32_t px)
+{
+	return ((px & 0xFF) * 3 + ((px >> 8) & 0xFF) * 5 + ((px >> 16) & 0xFF) * 7 + (px >> 24) * 11) & 63;
+}
+
+static inline void WriteBE32(unsigned char* p, uint32_t v)
+{
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+}
+
+static inline uint32_t ReadBE32(const unsigned char* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+
+//--------------------------------------------------------------------------------------
+template <PixelLayout layout>
+static inline uint32_t LoadPixel(const uint8_t* p)
+{
+	if (layout == kPixelGrey8)
+		return PackPixel(p[0], p[0], p[0], 255);
+	if (layout == kPixelRGB8)
+		return PackPixel(p[0], p[1], p[2], 255);
+	uint32_t px;
+	memcpy(&px, p, 4);
+	return px;
+}
+
+// Returns the bytes written to out, which must hold the worst case of 5 bytes per pixel
+template <PixelLayout layout>
+static size_t EncodeChunks(const uint8_t* pixels, size_t pixelCount, unsigned char* out)
+{
+	const size_t stride = layout == kPixelGrey8 ? 1 : layout == kPixelRGB8 ? 3 : 4;
+	uint32_t index[64];
+	memset(index, 0, sizeof(index));
+
+	unsigned char* o = out;
+	uint32_t prev = PackPixel(0, 0, 0, 255);
+	unsigned run = 0;
+	for (size_t i = 0; i < pixelCount; ++i) {
+		uint32_t px = LoadPixel<layout>(pixels + i * stride);
+		if (px == prev) {
+			if (++run == 62) {
+				*o++ = (unsigned char)(kQoiOpRun | (run - 1));
+				run = 0;
+			}
+			continue;
+		}
+		if (run > 0) {
+			*o++ = (unsigned char)(kQoiOpRun | (run - 1));
+			run = 0;
+		}
+
+		unsigned hash = HashPixel(px);
+		if (index[hash] == px) {
+			*o++ = (unsigned char)(kQoiOpIndex | hash);
+		} else {
+			index[hash] = px;
+			if ((px ^ prev) >> 24) {
+				*o++ = kQoiOpRGBA;
+				memcpy(o, &px, 4);
+				o += 4;
+			} else {
+				signed char vr = (signed char)((px & 0xFF) - (prev & 0xFF));
+				signed char vg = (signed char)(((px >> 8) & 0xFF) - ((prev >> 8) & 0xFF));
+				signed char vb = (signed char)(((px >> 16) & 0xFF) - ((prev >> 16) & 0xFF));
+				signed char vgr = (signed char)(vr - vg);
+				signed char vgb = (signed char)(vb - vg);
+				if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+					*o++ = (unsigned char)(kQoiOpDiff | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+				} else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8) {
+					*o++ = (unsigned char)(kQoiOpLuma | (vg + 32));
+					*o++ = (unsigned char)((vgr + 8) << 4 | (vgb + 8));
+				} else {
+					*o++ = kQoiOpRGB;
+					*o++ = (unsigned char)px;
+					*o++ = (unsigned char)(px >> 8);
+					*o++ = (unsigned char)(px >> 16);
+				}
+			}
+		}
+		prev = px;
+	}
+	if (run > 0)
+		*o++ = (unsigned char)(kQoiOpRun | (run - 1));
+	return o - out;
+}
+
+
+//--------------------------------------------------------------------------------------
+bool IsQoiLayout(PixelLayout layout)
+{
+	return layout == kPixelGrey8 || layout == kPixelRGB8 || layout == kPixelRGBA8;
+}
+
+size_t MaxQoiSize(unsigned width, unsigned height)
+{
+	uint64_t pixelCount = (uint64_t)width * height;
+	if (pixelCount == 0 || pixelCount > kQoiMaxPixels)
+		return 0;
+	return kQoiHeaderSize + (size_t)pixelCount * 5 + sizeof(kQoiPadding);
+}
+
+bool EncodeQoi(const uint8_t* pixels, unsigned width, unsigned height, PixelLayout layout,
+			   std::vector<unsigned char>& qoi)
+{
+	size_t maxSize = MaxQoiSize(width, height);
+	if (!IsQoiLayout(layout) || maxSize == 0)
+		return false;
+
+	// Sized for the worst case up front, so the chunk loop never checks for room
+	qoi.resize(maxSize);
+	qoi.resize(EncodeQoi(pixels, width, height, layout, &qoi[0]));
+	return true;
+}
+
+size_t EncodeQoi(const uint8_t* pixels, unsigned width, unsigned height, PixelLayout layout,
+				 unsigned char* qoi)
+{
+	uint64_t pixelCount = (uint64_t)width * height;
+	if (!IsQoiLayout(layout) || MaxQoiSize(width, height) == 0)
+		return 0;
+
+	unsigned char* header = qoi;
+	memcpy(header, "qoif", 4);
+	WriteBE32(header + 4, width);
+	WriteBE32(header + 8, height);
+	header[12] = layout == kPixelRGBA8 ? 4 : 3;
+	header[13] = 0; // sRGB with linear alpha
+
+	unsigned char* chunks = header + kQoiHeaderSize;
+	size_t size;
+	if (layout == kPixelGrey8)
+		size = EncodeChunks<kPixelGrey8>(pixels, (size_t)pixelCount, chunks);
+	else if (layout == kPixelRGB8)
+		size = EncodeChunks<kPixelRGB8>(pixels, (size_t)pixelCount, chunks);
+	else
+		size = EncodeChunks<kPixelRGBA8>(pixels, (size_t)pixelCount, chunks);
+
+	memcpy(chunks + size, kQoiPadding, sizeof(kQoiPadding));
+	return kQoiHeaderSize + size + sizeof(kQoiPadding);
+}
+
+bool DecodeQoi(const unsigned char* qoi, size_t size, std::vector<unsigned char>& pixels,
+			   unsigned& width, unsigned& height, unsigned& channels)
+{
+	if (size < kQoiHeaderSize + sizeof(kQoiPadding) || memcmp(qoi, "qoif", 4) != 0)
+		return false;
+	width = ReadBE32(qoi + 4);
+	height = ReadBE32(qoi + 8);
+	channels = qoi[12];
+	uint64_t pixelCount = (uint64_t)width * height;
+	if ((channels != 3 && channels != 4) || pixelCount == 0 || pixelCount > kQoiMaxPixels)
+		return false;
+
+	pixels.resize((size_t)pixelCount * channels);
+	uint32_t index[64];
+	memset(index, 0, sizeof(index));
+
+	const unsigned char* p = qoi + kQoiHeaderSize;
+	const unsigned char* end = qoi + size - sizeof(kQoiPadding);
+	unsigned r = 0, g = 0, b = 0, a = 255;
+	unsigned run = 0;
+	unsigned char* out = &pixels[0];
+	for (size_t i = 0; i < (size_t)pixelCount; ++i) {
+		if (run > 0) {
+			--run;
+		} else {
+			if (p >= end)
+				return false;
+			unsigned char op = *p++;
+			if (op == kQoiOpRGB || op == kQoiOpRGBA) {
+				size_t count = op == kQoiOpRGB ? 3 : 4;
+				if ((size_t)(end - p) < count)
+					return false;
+				r = p[0];
+				g = p[1];
+				b = p[2];
+				if (op == kQoiOpRGBA)
+					a = p[3];
+				p += count;
+			} else if ((op & kQoiMask) == kQoiOpIndex) {
+				uint32_t px = index[op];
+				r = px & 0xFF;
+				g = (px >> 8) & 0xFF;
+				b = (px >> 16) & 0xFF;
+				a = px >> 24;
+			} else if ((op & kQoiMask) == kQoiOpDiff) {
+				r = (r + ((op >> 4) & 3) - 2) & 0xFF;
+				g = (g + ((op >> 2) & 3) - 2) & 0xFF;
+				b = (b + (op & 3) - 2) & 0xFF;
+			} else if ((op & kQoiMask) == kQoiOpLuma) {
+				if (p >= end)
+					return false;
+				int vg = (op & 0x3F) - 32;
+				unsigned char next = *p++;
+				r = (r + vg - 8 + ((next >> 4) & 0x0F)) & 0xFF;
+				g = (g + vg) & 0xFF;
+				b = (b + vg - 8 + (next & 0x0F)) & 0xFF;
+			} else {
+				run = op & 0x3F;
+			}
+			uint32_t px = PackPixel(r, g, b, a);
+			index[HashPixel(px)] = px;
+		}
+
+		out[0] = (unsigned char)r;
+		out[1] = (unsigned char)g;
+		out[2] = (unsigned char)b;
+		if (channels == 4)
+			out[3] = (unsigned char)a;
+		out += channels;
+	}
+	return true;
+}
@@ -0,0 +1,31 @@
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <vector>
+
+#include "PixelConvert.h"
+
+// QOI ("Quite OK Image", https://qoiformat.org) encoding and decoding of converted frames.
+// QOI is lossless like PNG but needs a single pass and no entropy coder, so it encodes several
+// times faster at a somewhat larger file size. It only holds 8-bit RGB and RGBA.
+
+// True for the layouts QOI can hold: kPixelRGB8, kPixelRGBA8, and kPixelGrey8 written as RGB
+bool IsQoiLayout(PixelLayout layout);
+
+// Encodes width x height pixels, top row first and rows tightly packed, into qoi
+bool EncodeQoi(const uint8_t* pixels, unsigned width, unsigned height, PixelLayout layout,
+			   std::vector<unsigned char>& qoi);
+
+// The most EncodeQoi can write for width x height pixels, 0 for frames QOI can't hold
+size_t MaxQoiSize(unsigned width, unsigned height);
+
+// Encodes like the above into a buffer of at least MaxQoiSize bytes, which needn't be
+// initialized, so a pooled buffer can be reused frame after frame. Returns the file size, 0 if
+// the frame can't be encoded.
+size_t EncodeQoi(const uint8_t* pixels, unsigned width, unsigned height, PixelLayout layout,
+				 unsigned char* qoi);
+
+// Decodes a QOI file into tightly packed pixels with the file's channel count (3 or 4)
+bool DecodeQoi(const unsigned char* qoi, size_t size, std::vector<unsigned char>& pixels,
+			   unsigned& width, unsigned& height, unsigned& channels);
@@ -17,8 +17,11 @@
 
 #include <wrl\client.h>
 #include <algorithm>
+#include <vector>
 
 #include "ScreenGrab.h"
+#include "BufferPool.h"
+#include "FrameHash.h"
 
 using Microsoft::WRL::ComPtr;
 
@@ -447,6 +450,40 @@ static void GetSurfaceInfo( _In_ size_t width,
 }
 
 
+//--------------------------------------------------------------------------------------
+static bool IsCompressed( _In_ DXGI_FORMAT fmt )
+{
+	switch ( fmt )
+	{
+	case DXGI_FORMAT_BC1_TYPELESS:
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC2_TYPELESS:
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_TYPELESS:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_TYPELESS:
+	case DXGI_FORMAT_BC4_UNORM:
+	case DXGI_FORMAT_BC4_SNORM:
+	case DXGI_FORMAT_BC5_TYPELESS:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC6H_TYPELESS:
+	case DXGI_FORMAT_BC6H_UF16:
+	case DXGI_FORMAT_BC6H_SF16:
+	case DXGI_FORMAT_BC7_TYPELESS:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+
 //--------------------------------------------------------------------------------------
 static DXGI_FORMAT EnsureNotTypeless( DXGI_FORMAT fmt )
 {
@@ -477,6 +514,79 @@ static DXGI_FORMAT EnsureNotTypeless( DXGI_FORMAT fmt )
 }
 
 
+//--------------------------------------------------------------------------------------
+// Staging and resolve textures are kept between captures instead of being created every
+// frame. Only the render thread touches the cache.
+struct CachedTexture
+{
+	D3D11_TEXTURE2D_DESC desc;
+	ComPtr<ID3D11Texture2D> texture;
+	bool inUse;
+};
+
+static const size_t kMaxCachedTextures = 8;
+static std::vector<CachedTexture> textureCache;
+
+static bool SameTextureKey( const D3D11_TEXTURE2D_DESC& a, const D3D11_TEXTURE2D_DESC& b )
+{
+	return a.Width == b.Width
+		&& a.Height == b.Height
+		&& a.Format == b.Format
+		&& a.ArraySize == b.ArraySize
+		&& a.MipLevels == b.MipLevels
+		&& a.SampleDesc.Count == b.SampleDesc.Count
+		&& a.Usage == b.Usage
+		&& a.BindFlags == b.BindFlags
+		&& a.CPUAccessFlags == b.CPUAccessFlags
+		&& a.MiscFlags == b.MiscFlags;
+}
+
+static HRESULT AcquireCachedTexture( _In_ ID3D11Device* d3dDevice,
+									_In_ const D3D11_TEXTURE2D_DESC& desc,
+									_Inout_ ComPtr<ID3D11Texture2D>& pTexture )
+{
+	for ( size_t i = 0; i < textureCache.size(); ++i )
+	{
+		CachedTexture& entry = textureCache[i];
+		if ( !entry.inUse && SameTextureKey( entry.desc, desc ) )
+		{
+			entry.inUse = true;
+			pTexture = entry.texture;
+			return S_OK;
+		}
+	}
+
+	// Make room by forgetting idle textures of other sizes and formats, oldest first
+	for ( size_t i = 0; i < textureCache.size() && textureCache.size() >= kMaxCachedTextures; )
+	{
+		if ( textureCache[i].inUse )
+			++i;
+		else
+			textureCache.erase( textureCache.begin() + i );
+	}
+
+	CachedTexture entry;
+	entry.desc = desc;
+	entry.inUse = true;
+	HRESULT hr = d3dDevice->CreateTexture2D( &desc, 0, entry.texture.GetAddressOf() );
+	if ( FAILED(hr) )
+		return hr;
+
+	pTexture = entry.texture;
+	textureCache.push_back( entry );
+	return S_OK;
+}
+
+// Textures that didn't come from the cache are ignored
+static void ReleaseCachedTexture( _In_ ID3D11Texture2D* pTexture )
+{
+	for ( size_t i = 0; i < textureCache.size(); ++i )
+	{
+		if ( textureCache[i].texture.Get() == pTexture )
+			textureCache[i].inUse = false;
+	}
+}
+
 //--------------------------------------------------------------------------------------
 static HRESULT CaptureTexture( _In_ ID3D11DeviceContext* pContext,
 							  _In_ ID3D11Resource* pSource,
@@ -510,13 +620,6 @@ static HRESULT CaptureTexture( _In_ ID3D11DeviceContext* pContext,
 		desc.SampleDesc.Count = 1;
 		desc.SampleDesc.Quality = 0;
 
-		ComPtr<ID3D11Texture2D> pTemp;
-		hr = d3dDevice->CreateTexture2D( &desc, 0, pTemp.GetAddressOf() );
-		if ( FAILED(hr) )
-			return hr;
-
-		assert( pTemp );
-
 		DXGI_FORMAT fmt = EnsureNotTypeless( desc.Format );
 
 		UINT support = 0;
@@ -527,6 +630,13 @@ static HRESULT CaptureTexture( _In_ ID3D11DeviceContext* pContext,
 		if ( !(support & D3D11_FORMAT_SUPPORT_MULTISAMPLE_RESOLVE) )
 			return E_FAIL;
 
+		ComPtr<ID3D11Texture2D> pTemp;
+		hr = AcquireCachedTexture( d3dDevice.Get(), desc, pTemp );
+		if ( FAILED(hr) )
+			return hr;
+
+		assert( pTemp );
+
 		for( UINT item = 0; item < desc.ArraySize; ++item )
 		{
 			for( UINT level = 0; level < desc.MipLevels; ++level )
@@ -541,13 +651,17 @@ static HRESULT CaptureTexture( _In_ ID3D11DeviceContext* pContext,
 		desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
 		desc.Usage = D3D11_USAGE_STAGING;
 
-		hr = d3dDevice->CreateTexture2D( &desc, 0, pStaging.GetAddressOf() );
+		hr = AcquireCachedTexture( d3dDevice.Get(), desc, pStaging );
+		if ( SUCCEEDED(hr) )
+		{
+			assert( pStaging );
+			pContext->CopyResource( pStaging.Get(), pTemp.Get() );
+		}
+
+		// The GPU orders the resolve before any later reuse of the temp texture
+		ReleaseCachedTexture( pTemp.Get() );
 		if ( FAILED(hr) )
 			return hr;
-
-		assert( pStaging );
-
-		pContext->CopyResource( pStaging.Get(), pTemp.Get() );
 	}
 	else if ( (desc.Usage == D3D11_USAGE_STAGING) && (desc.CPUAccessFlags & D3D11_CPU_ACCESS_READ) )
 	{
@@ -562,7 +676,7 @@ static HRESULT CaptureTexture( _In_ ID3D11DeviceContext* pContext,
 		desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
 		desc.Usage = D3D11_USAGE_STAGING;
 
-		hr = d3dDevice->CreateTexture2D( &desc, 0, pStaging.GetAddressOf() );
+		hr = AcquireCachedTexture( d3dDevice.Get(), desc, pStaging );
 		if ( FAILED(hr) )
 			return hr;
 
@@ -575,6 +689,68 @@ static HRESULT CaptureTexture( _In_ ID3D11DeviceContext* pContext,
 }
 
 
+//--------------------------------------------------------------------------------------
+// Copies the mapped staging texture into frame's pixels. With D3D11_MAP_FLAG_DO_NOT_WAIT
+// this returns DXGI_ERROR_WAS_STILL_DRAWING instead of stalling while the GPU is busy.
+static HRESULT ReadStagingTexture( _In_ ID3D11DeviceContext* pContext,
+								  _In_ ID3D11Texture2D* pStaging,
+								  _In_ const D3D11_TEXTURE2D_DESC& desc,
+								  _In_ UINT mapFlags,
+								  _Inout_ TextureInfo& frame )
+{
+	size_t rowPitch, slicePitch, rowCount;
+	GetSurfaceInfo( desc.Width, desc.Height, desc.Format, &slicePitch, &rowPitch, &rowCount );
+
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	HRESULT hr = pContext->Map( pStaging, 0, D3D11_MAP_READ, mapFlags, &mapped );
+	if ( FAILED(hr) )
+		return hr;
+
+	auto sptr = reinterpret_cast<const uint8_t*>( mapped.pData );
+	if ( !sptr )
+	{
+		pContext->Unmap( pStaging, 0 );
+		return E_POINTER;
+	}
+
+	// DDS keeps the rows as they are; PNG converts them and wants the bottom row first
+	PixelLayout layout = kPixelRaw;
+	RowConversion conversion = kRowCopy;
+	bool flip = false;
+	if ( frame.output != kOutputDDS )
+	{
+		conversion = GetRowConversion( desc.Format, &layout );
+		flip = true;
+	}
+	size_t dstPitch = GetConvertedRowBytes( conversion, rowPitch );
+
+	frame.pixels = PixelBuffer( dstPitch * rowCount );
+	if ( !frame.pixels.Get() )
+	{
+		pContext->Unmap( pStaging, 0 );
+		return E_OUTOFMEMORY;
+	}
+
+	// Copy, flip and swizzle in one pass over the mapped rows, hashing each row while it's hot
+	size_t msize = std::min<size_t>( rowPitch, mapped.RowPitch );
+	FrameHash hash;
+	ConvertRows( conversion, sptr, mapped.RowPitch, msize, frame.pixels.Get(), dstPitch, rowCount, flip,
+				 frame.hashContent ? &hash : NULL );
+	frame.contentHash = frame.hashContent ? hash.Digest() : 0;
+
+	pContext->Unmap( pStaging, 0 );
+
+	frame.format = desc.Format;
+	frame.layout = layout;
+	frame.rowPitch = dstPitch;
+	frame.width = desc.Width;
+	frame.height = desc.Height;
+
+	return S_OK;
+}
+
+
 //--------------------------------------------------------------------------------------
 TextureInfo GetTextureData( _In_ ID3D11DeviceContext* pContext,
 						   _In_ ID3D11Resource* pSource)
@@ -585,42 +761,224 @@ TextureInfo GetTextureData( _In_ ID3D11DeviceContext* pContext,
 	if ( FAILED(hr) )
 		return TextureInfo();
 
-	size_t rowPitch, slicePitch, rowCount;
-	GetSurfaceInfo( desc.Width, desc.Height, desc.Format, &slicePitch, &rowPitch, &rowCount );
-
-
-	D3D11_MAPPED_SUBRESOURCE mapped;
-	hr = pContext->Map( pStaging.Get(), 0, D3D11_MAP_READ, 0, &mapped );
+	TextureInfo result;
+	hr = ReadStagingTexture( pContext, pStaging.Get(), desc, 0, result );
+	ReleaseCachedTexture( pStaging.Get() );
 	if ( FAILED(hr) )
 		return TextureInfo();
+	return result;
+}
 
-	auto sptr = reinterpret_cast<const uint8_t*>( mapped.pData );
-	if ( !sptr )
+
+//--------------------------------------------------------------------------------------
+// Asynchronous readback: each capture copies into the next slot of a ring of staging
+// textures, and slots are only mapped once the GPU is done with them, so the render thread
+// never waits for the GPU unless every slot is still in flight.
+struct ReadbackSlot
+{
+	ComPtr<ID3D11Texture2D> pStaging;
+	D3D11_TEXTURE2D_DESC desc;
+	TextureInfo frame;
+};
+
+static const UINT kMaxReadbackLatency = 8;
+static ReadbackSlot readbackSlots[kMaxReadbackLatency];
+static UINT readbackLatency = 2;
+static UINT readbackHead = 0;  // oldest pending slot
+static UINT readbackCount = 0; // pending slots
+
+static void ReleaseReadbackSlot( ReadbackSlot& slot )
+{
+	ReleaseCachedTexture( slot.pStaging.Get() );
+	slot.pStaging.Reset();
+	slot.frame = TextureInfo();
+}
+
+void SetTextureReadbackLatency( UINT frames )
+{
+	readbackLatency = std::min<UINT>( frames, kMaxReadbackLatency );
+}
+
+UINT CollectTextureReadbacks( _In_ ID3D11DeviceContext* pContext,
+							 _In_ bool wait,
+							 _In_ ReadbackCallback deliver )
+{
+	UINT delivered = 0;
+	while ( readbackCount > 0 )
 	{
-		pContext->Unmap( pStaging.Get(), 0 );
-		return TextureInfo();
+		ReadbackSlot& slot = readbackSlots[readbackHead];
+		HRESULT hr = ReadStagingTexture( pContext, slot.pStaging.Get(), slot.desc,
+										wait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT, slot.frame );
+
+		// Frames are delivered in capture order, so a busy slot holds back the ones after it
+		if ( hr == DXGI_ERROR_WAS_STILL_DRAWING )
+			break;
+
+		if ( SUCCEEDED(hr) )
+		{
+			deliver( slot.frame );
+			++delivered;
+		}
+		ReleaseReadbackSlot( slot );
+		readbackHead = (readbackHead + 1) % kMaxReadbackLatency;
+		--readbackCount;
 	}
+	return delivered;
+}
 
-	std::unique_ptr<uint8_t[]> * pixels = new std::unique_ptr<uint8_t[]>( new (std::nothrow) uint8_t[ slicePitch ] );
-	if (!pixels)
-		return TextureInfo();
-	uint8_t* dptr = pixels->get() + (rowCount - 1) * rowPitch;
+HRESULT QueueTextureReadback( _In_ ID3D11DeviceContext* pContext,
+							 _In_ ID3D11Resource* pSource,
+							 _Inout_ TextureInfo& frame,
+							 _In_ ReadbackCallback deliver )
+{
+	// With every slot in flight, the oldest has to be waited for
+	while ( readbackCount > 0 && readbackCount >= readbackLatency )
+	{
+		ReadbackSlot& oldest = readbackSlots[readbackHead];
+		HRESULT hr = ReadStagingTexture( pContext, oldest.pStaging.Get(), oldest.desc, 0, oldest.frame );
+		if ( SUCCEEDED(hr) )
+			deliver( oldest.frame );
+		ReleaseReadbackSlot( oldest );
+		readbackHead = (readbackHead + 1) % kMaxReadbackLatency;
+		--readbackCount;
+	}
 
-	size_t msize = std::min<size_t>( rowPitch, mapped.RowPitch );
-	for( size_t h = 0; h < rowCount; ++h )
+	ReadbackSlot& slot = readbackSlots[(readbackHead + readbackCount) % kMaxReadbackLatency];
+	HRESULT hr = CaptureTexture( pContext, pSource, slot.desc, slot.pStaging );
+	if ( FAILED(hr) )
 	{
-		memcpy_s( dptr, rowPitch, sptr, msize );
-		sptr += mapped.RowPitch;
-		dptr -= rowPitch;
+		slot.pStaging.Reset();
+		return hr;
 	}
 
-	pContext->Unmap( pStaging.Get(), 0 );
+	slot.frame = std::move( frame );
+	++readbackCount;
 
-	auto result = TextureInfo();
-	result.width = desc.Width;
-	result.height = desc.Height;
-	result.pixels = pixels;
+	// A source that is itself a staging texture isn't copied, so it must be read right away
+	if ( readbackLatency == 0 || slot.pStaging.Get() == pSource )
+		CollectTextureReadbacks( pContext, true, deliver );
+	return S_OK;
+}
 
-	return result;
+
+//--------------------------------------------------------------------------------------
+void ReleaseCaptureResources()
+{
+	while ( readbackCount > 0 )
+	{
+		ReleaseReadbackSlot( readbackSlots[readbackHead] );
+		readbackHead = (readbackHead + 1) % kMaxReadbackLatency;
+		--readbackCount;
+	}
+	textureCache.clear();
 }
 
+
+//--------------------------------------------------------------------------------------
+HRESULT SaveDDSFrame( _In_ const TextureInfo& frame,
+					 _In_z_ const char* fileName )
+{
+	if ( !fileName || !frame.pixels.Get() || frame.output != kOutputDDS )
+		return E_INVALIDARG;
+
+	size_t rowPitch, slicePitch, rowCount;
+	GetSurfaceInfo( frame.width, frame.height, frame.format, &slicePitch, &rowPitch, &rowCount );
+	if ( slicePitch == 0 || slicePitch > frame.pixels.Size() || slicePitch > UINT32_MAX )
+		return HRESULT_FROM_WIN32( ERROR_NOT_SUPPORTED );
+
+	// Setup header
+	const size_t MAX_HEADER_SIZE = sizeof(uint32_t) + sizeof(DDS_HEADER) + sizeof(DDS_HEADER_DXT10);
+	uint8_t fileHeader[ MAX_HEADER_SIZE ];
+
+	*reinterpret_cast<uint32_t*>(&fileHeader[0]) = DDS_MAGIC;
+
+	auto header = reinterpret_cast<DDS_HEADER*>( &fileHeader[0] + sizeof(uint32_t) );
+	size_t headerSize = sizeof(uint32_t) + sizeof(DDS_HEADER);
+	memset( header, 0, sizeof(DDS_HEADER) );
+	header->size = sizeof( DDS_HEADER );
+	header->flags = DDS_HEADER_FLAGS_TEXTURE | DDS_HEADER_FLAGS_MIPMAP;
+	header->height = frame.height;
+	header->width = frame.width;
+	header->mipMapCount = 1;
+	header->caps = DDS_SURFACE_FLAGS_TEXTURE;
+
+	// Try to use a legacy .DDS pixel format for better tools support, otherwise fallback to 'DX10' header extension
+	DDS_HEADER_DXT10* extHeader = nullptr;
+	switch( frame.format )
+	{
+	case DXGI_FORMAT_R8G8B8A8_UNORM:        memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_A8B8G8R8, sizeof(DDS_PIXELFORMAT) );    break;
+	case DXGI_FORMAT_R16G16_UNORM:          memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_G16R16, sizeof(DDS_PIXELFORMAT) );      break;
+	case DXGI_FORMAT_R8G8_UNORM:            memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_A8L8, sizeof(DDS_PIXELFORMAT) );        break;
+	case DXGI_FORMAT_R16_UNORM:             memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_L16, sizeof(DDS_PIXELFORMAT) );         break;
+	case DXGI_FORMAT_R8_UNORM:              memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_L8, sizeof(DDS_PIXELFORMAT) );          break;
+	case DXGI_FORMAT_A8_UNORM:              memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_A8, sizeof(DDS_PIXELFORMAT) );          break;
+	case DXGI_FORMAT_R8G8_B8G8_UNORM:       memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_R8G8_B8G8, sizeof(DDS_PIXELFORMAT) );   break;
+	case DXGI_FORMAT_G8R8_G8B8_UNORM:       memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_G8R8_G8B8, sizeof(DDS_PIXELFORMAT) );   break;
+	case DXGI_FORMAT_BC1_UNORM:             memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_DXT1, sizeof(DDS_PIXELFORMAT) );        break;
+	case DXGI_FORMAT_BC2_UNORM:             memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_DXT3, sizeof(DDS_PIXELFORMAT) );        break;
+	case DXGI_FORMAT_BC3_UNORM:             memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_DXT5, sizeof(DDS_PIXELFORMAT) );        break;
+	case DXGI_FORMAT_BC4_UNORM:             memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_BC4_UNORM, sizeof(DDS_PIXELFORMAT) );   break;
+	case DXGI_FORMAT_BC4_SNORM:             memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_BC4_SNORM, sizeof(DDS_PIXELFORMAT) );   break;
+	case DXGI_FORMAT_BC5_UNORM:             memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_BC5_UNORM, sizeof(DDS_PIXELFORMAT) );   break;
+	case DXGI_FORMAT_BC5_SNORM:             memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_BC5_SNORM, sizeof(DDS_PIXELFORMAT) );   break;
+	case DXGI_FORMAT_B5G6R5_UNORM:          memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_R5G6B5, sizeof(DDS_PIXELFORMAT) );      break;
+	case DXGI_FORMAT_B5G5R5A1_UNORM:        memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_A1R5G5B5, sizeof(DDS_PIXELFORMAT) );    break;
+	case DXGI_FORMAT_R8G8_SNORM:            memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_V8U8, sizeof(DDS_PIXELFORMAT) );        break;
+	case DXGI_FORMAT_R8G8B8A8_SNORM:        memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_Q8W8V8U8, sizeof(DDS_PIXELFORMAT) );    break;
+	case DXGI_FORMAT_R16G16_SNORM:          memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_V16U16, sizeof(DDS_PIXELFORMAT) );      break;
+	case DXGI_FORMAT_B8G8R8A8_UNORM:        memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_A8R8G8B8, sizeof(DDS_PIXELFORMAT) );    break; // DXGI 1.1
+	case DXGI_FORMAT_B8G8R8X8_UNORM:        memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_X8R8G8B8, sizeof(DDS_PIXELFORMAT) );    break; // DXGI 1.1
+	case DXGI_FORMAT_YUY2:                  memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_YUY2, sizeof(DDS_PIXELFORMAT) );        break; // DXGI 1.2
+	case DXGI_FORMAT_B4G4R4A4_UNORM:        memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_A4R4G4B4, sizeof(DDS_PIXELFORMAT) );    break; // DXGI 1.2
+
+	// Legacy D3DX formats using D3DFMT enum value as FourCC
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:    header->ddspf.size = sizeof(DDS_PIXELFORMAT); header->ddspf.flags = DDS_FOURCC; header->ddspf.fourCC = 116; break; // D3DFMT_A32B32G32R32F
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:    header->ddspf.size = sizeof(DDS_PIXELFORMAT); header->ddspf.flags = DDS_FOURCC; header->ddspf.fourCC = 113; break; // D3DFMT_A16B16G16R16F
+	case DXGI_FORMAT_R16G16B16A16_UNORM:    header->ddspf.size = sizeof(DDS_PIXELFORMAT); header->ddspf.flags = DDS_FOURCC; header->ddspf.fourCC = 36;  break; // D3DFMT_A16B16G16R16
+	case DXGI_FORMAT_R16G16B16A16_SNORM:    header->ddspf.size = sizeof(DDS_PIXELFORMAT); header->ddspf.flags = DDS_FOURCC; header->ddspf.fourCC = 110; break; // D3DFMT_Q16W16V16U16
+	case DXGI_FORMAT_R32G32_FLOAT:          header->ddspf.size = sizeof(DDS_PIXELFORMAT); header->ddspf.flags = DDS_FOURCC; header->ddspf.fourCC = 115; break; // D3DFMT_G32R32F
+	case DXGI_FORMAT_R16G16_FLOAT:          header->ddspf.size = sizeof(DDS_PIXELFORMAT); header->ddspf.flags = DDS_FOURCC; header->ddspf.fourCC = 112; break; // D3DFMT_G16R16F
+	case DXGI_FORMAT_R32_FLOAT:             header->ddspf.size = sizeof(DDS_PIXELFORMAT); header->ddspf.flags = DDS_FOURCC; header->ddspf.fourCC = 114; break; // D3DFMT_R32F
+	case DXGI_FORMAT_R16_FLOAT:             header->ddspf.size = sizeof(DDS_PIXELFORMAT); header->ddspf.flags = DDS_FOURCC; header->ddspf.fourCC = 111; break; // D3DFMT_R16F
+
+	// Everything else, including the palettized video formats (AI44, IA44, P8, A8P8) that have no
+	// legacy equivalent, goes out with the 'DX10' extension; the palette itself isn't captured
+	default:
+		memcpy_s( &header->ddspf, sizeof(header->ddspf), &DDSPF_DX10, sizeof(DDS_PIXELFORMAT) );
+
+		headerSize += sizeof(DDS_HEADER_DXT10);
+		extHeader = reinterpret_cast<DDS_HEADER_DXT10*>( reinterpret_cast<uint8_t*>(&fileHeader[0]) + sizeof(uint32_t) + sizeof(DDS_HEADER) );
+		memset( extHeader, 0, sizeof(DDS_HEADER_DXT10) );
+		extHeader->dxgiFormat = frame.format;
+		extHeader->resourceDimension = D3D11_RESOURCE_DIMENSION_TEXTURE2D;
+		extHeader->arraySize = 1;
+		break;
+	}
+
+	if ( IsCompressed( frame.format ) )
+	{
+		header->flags |= DDS_HEADER_FLAGS_LINEARSIZE;
+		header->pitchOrLinearSize = static_cast<uint32_t>( slicePitch );
+	}
+	else
+	{
+		header->flags |= DDS_HEADER_FLAGS_PITCH;
+		header->pitchOrLinearSize = static_cast<uint32_t>( rowPitch );
+	}
+
+	// The pixels were captured with the same row pitch, so they go out in one write
+	HANDLE hFile = CreateFileA( fileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( hFile == INVALID_HANDLE_VALUE )
+		return HRESULT_FROM_WIN32( GetLastError() );
+
+	HRESULT hr = S_OK;
+	DWORD bytesWritten;
+	if ( !WriteFile( hFile, fileHeader, static_cast<DWORD>( headerSize ), &bytesWritten, NULL )
+		|| !WriteFile( hFile, frame.pixels.Get(), static_cast<DWORD>( slicePitch ), &bytesWritten, NULL ) )
+	{
+		hr = HRESULT_FROM_WIN32( GetLastError() );
+	}
+
+	CloseHandle( hFile );
+	return hr;
+}
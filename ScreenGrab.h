@@ -5,6 +5,7 @@
 #include <d3d11_1.h>
 #include <ocidl.h>
 #include <memory>
+#include <string>
 
 #pragma warning(push)
 #pragma warning(disable : 4005)
@@ -13,21 +14,131 @@
 
 #include <functional>
 
+#include "BufferPool.h"
+#include "PixelConvert.h"
+
+// File format a frame is captured for
+enum CaptureOutput
+{
+	kOutputPNG = 0, // pixels converted to a PNG layout and flipped
+	kOutputDDS,     // pixels exactly as the GPU holds them
+	kOutputQOI,     // converted like PNG, written as QOI where the layout allows
+};
+
+// A captured frame on its way to the encoders. Move-only: the pixels are a pooled buffer and
+// the path is stored inline, so handing a frame between threads never allocates.
 struct TextureInfo
 {
-	std::string * filePath;
-	std::unique_ptr<uint8_t[]> * pixels;
+	PixelBuffer pixels; // rowPitch * height bytes, bottom row first
+	char filePath[MAX_PATH];
+	DXGI_FORMAT format; // format of the source texture
+	PixelLayout layout; // what the pixels were converted to
+	CaptureOutput output;
+	size_t rowPitch;
 	unsigned width;
 	unsigned height;
+	int64_t sequence; // capture order, stamped by OnRenderEvent
+	int64_t timestamp; // QueryPerformanceCounter when the capture was queued
+	const void* texture; // source texture, identifies a sequence of frames
+	char deltaOf[MAX_PATH]; // file name of the frame the pixels are an XOR against; empty if whole
+	bool hashContent; // set before the readback to have contentHash computed
+	uint64_t contentHash; // XXH64 of the converted pixels
+	char duplicateOf[MAX_PATH]; // path of an identical earlier frame; such frames carry no pixels
+	int64_t duplicateOfSequence; // sequence of that frame
 
 	TextureInfo()
 	{
-		pixels = NULL;
+		filePath[0] = 0;
+		deltaOf[0] = 0;
+		duplicateOf[0] = 0;
+		format = DXGI_FORMAT_UNKNOWN;
+		layout = kPixelRaw;
+		output = kOutputPNG;
+		rowPitch = 0;
 		width = 0;
 		height = 0;
-		filePath = NULL;
+		sequence = 0;
+		timestamp = 0;
+		texture = NULL;
+		hashContent = false;
+		contentHash = 0;
+		duplicateOfSequence = 0;
+	}
+
+	TextureInfo(TextureInfo&& other)
+	{
+		*this = std::move(other);
+	}
+
+	TextureInfo& operator=(TextureInfo&& other)
+	{
+		if (this != &other)
+		{
+			pixels = std::move(other.pixels);
+			strcpy_s(filePath, other.filePath);
+			format = other.format;
+			layout = other.layout;
+			output = other.output;
+			rowPitch = other.rowPitch;
+			width = other.width;
+			height = other.height;
+			sequence = other.sequence;
+			timestamp = other.timestamp;
+			texture = other.texture;
+			strcpy_s(deltaOf, other.deltaOf);
+			hashContent = other.hashContent;
+			contentHash = other.contentHash;
+			strcpy_s(duplicateOf, other.duplicateOf);
+			duplicateOfSequence = other.duplicateOfSequence;
+			other.filePath[0] = 0;
+			other.deltaOf[0] = 0;
+			other.duplicateOf[0] = 0;
+		}
+		return *this;
 	}
+
+	// Fails if the path doesn't fit in MAX_PATH
+	bool SetFilePath(const std::string& path)
+	{
+		if (path.size() >= MAX_PATH)
+			return false;
+		memcpy(filePath, path.c_str(), path.size() + 1);
+		return true;
+	}
+
+private:
+	TextureInfo(const TextureInfo&);
+	TextureInfo& operator=(const TextureInfo&);
 };
 
+// Copies the texture to a staging texture and reads it back, waiting for the GPU
 TextureInfo GetTextureData( _In_ ID3D11DeviceContext* pContext,
 						   _In_ ID3D11Resource* pSource);
+
+// Receives frames from the asynchronous readback ring, in capture order, on the render thread.
+// The callee may move the frame out.
+typedef void (*ReadbackCallback)(TextureInfo& frame);
+
+// Starts copying pSource into the next readback slot; frame carries the path and anything
+// else that should travel with the pixels. Only waits for the GPU when all slots are in use.
+HRESULT QueueTextureReadback( _In_ ID3D11DeviceContext* pContext,
+							 _In_ ID3D11Resource* pSource,
+							 _Inout_ TextureInfo& frame,
+							 _In_ ReadbackCallback deliver );
+
+// Delivers the readbacks the GPU has finished, or all of them when wait is true
+UINT CollectTextureReadbacks( _In_ ID3D11DeviceContext* pContext,
+							 _In_ bool wait,
+							 _In_ ReadbackCallback deliver );
+
+// Number of frames a readback trails its capture; 0 reads back synchronously
+void SetTextureReadbackLatency( UINT frames );
+
+// Writes a frame captured for kOutputDDS to a DDS file, with a DX10 header extension for formats
+// the legacy header can't describe
+HRESULT SaveDDSFrame( _In_ const TextureInfo& frame,
+					 _In_z_ const char* fileName );
+
+// Drops pending readbacks and the cached staging and resolve textures; call before the
+// device is reset or destroyed
+void ReleaseCaptureResources();
@@ -0,0 +1,222 @@
+// Encodes a capture spool, recorded by the plugin between StartSpool and StopSpool, into PNG files
+// on all cores.
+//
+//   Spool2Png <basePath> [outputDirectory] [threads] [pngLevel]
+//
+// Frames go to the path they were captured for, or into outputDirectory under the same file
+// name. Frames captured for QOI are written as QOI when their layout allows. Float frames are
+// tone mapped with ACES at the default exposure; frames PNG can't hold (DDS captures,
+// compressed formats) are skipped.
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "SpoolFormat.h"
+#include "ScreenGrab.h"
+#include "PngEncoder.h"
+#include "QoiCodec.h"
+#include "HdrConvert.h"
+#include "lodepng.h"
+
+struct Segment
+{
+	HANDLE file;
+	HANDLE mapping;
+	const uint8_t* view;
+	uint64_t index;
+};
+
+struct Record
+{
+	const SpoolFrameHeader* header;
+	std::string path;
+};
+
+static std::vector<Record> records;
+static std::string outputDirectory;
+static int pngLevel = kPngDefaultLevel;
+static volatile LONG nextRecord = -1;
+static volatile LONG writtenCount = 0;
+static volatile LONG skippedCount = 0;
+static volatile LONG failedCount = 0;
+
+
+//--------------------------------------------------------------------------------------
+static bool OpenSegment(const std::string& path, Segment& segment)
+{
+	segment.mapping = NULL;
+	segment.view = NULL;
+	segment.file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (segment.file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(segment.file, &size) && (uint64_t)size.QuadPart >= sizeof(SpoolSegmentHeader))
+		segment.mapping = CreateFileMappingA(segment.file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (segment.mapping)
+		segment.view = static_cast<const uint8_t*>( MapViewOfFile(segment.mapping, FILE_MAP_READ, 0, 0, 0) );
+
+	const SpoolSegmentHeader* header = reinterpret_cast<const SpoolSegmentHeader*>(segment.view);
+	if (!header || header->magic != kSpoolSegmentMagic || header->version != kSpoolVersion
+		|| header->usedBytes > (uint64_t)size.QuadPart) {
+		fprintf(stderr, "%s: not a spool segment\n", path.c_str());
+		return false;
+	}
+	segment.index = header->segmentIndex;
+	return true;
+}
+
+static void CloseSegment(Segment& segment)
+{
+	if (segment.view)
+		UnmapViewOfFile(segment.view);
+	if (segment.mapping)
+		CloseHandle(segment.mapping);
+	if (segment.file != INVALID_HANDLE_VALUE)
+		CloseHandle(segment.file);
+}
+
+static void CollectRecords(const Segment& segment)
+{
+	const SpoolSegmentHeader* header = reinterpret_cast<const SpoolSegmentHeader*>(segment.view);
+	uint64_t offset = sizeof(SpoolSegmentHeader);
+	while (offset + sizeof(SpoolFrameHeader) <= header->usedBytes) {
+		const SpoolFrameHeader* frame = reinterpret_cast<const SpoolFrameHeader*>(segment.view + offset);
+		if (frame->magic != kSpoolFrameMagic || frame->recordSize == 0
+			|| offset + frame->recordSize > header->usedBytes
+			|| SpoolPixelOffset(frame->pathLength) + frame->dataSize > frame->recordSize)
+			break;
+
+		Record record;
+		record.header = frame;
+		record.path.assign(reinterpret_cast<const char*>(frame + 1), frame->pathLength);
+		records.push_back(record);
+		offset += frame->recordSize;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+static std::string GetOutputPath(const Record& record)
+{
+	if (outputDirectory.empty())
+		return record.path;
+	size_t slash = record.path.find_last_of("/\\");
+	std::string name = slash == std::string::npos ? record.path : record.path.substr(slash + 1);
+	return outputDirectory + "\\" + name;
+}
+
+// Same fallback as the plugin: a frame captured for QOI that QOI can't hold becomes a PNG
+static std::string GetPngFallbackPath(const std::string& path)
+{
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return path + ".png";
+	return path.substr(0, dot) + ".png";
+}
+
+static void WriteRecord(const Record& record)
+{
+	const SpoolFrameHeader* header = record.header;
+	const uint8_t* pixels = reinterpret_cast<const uint8_t*>(header) + SpoolPixelOffset(header->pathLength);
+	PixelLayout layout = (PixelLayout)header->layout;
+	size_t pixelCount = (size_t)header->width * header->height;
+
+	std::vector<uint8_t> toneMapped;
+	if (IsFloatLayout(layout)) {
+		toneMapped.resize(pixelCount * 8);
+		ToneMapPixels(layout, pixels, &toneMapped[0], pixelCount, kToneMapACES, 1.0f);
+		pixels = &toneMapped[0];
+		layout = kPixelRGBA16;
+	}
+	if (!IsPngLayout(layout)) {
+		InterlockedIncrement(&skippedCount);
+		return;
+	}
+
+	std::string path = GetOutputPath(record);
+	bool ok;
+	if (header->output == kOutputQOI && IsQoiLayout(layout)) {
+		std::vector<unsigned char> encoded;
+		ok = EncodeQoi(pixels, header->width, header->height, layout, encoded)
+			&& lodepng::save_file(encoded, path) == 0;
+	} else {
+		if (header->output == kOutputQOI)
+			path = GetPngFallbackPath(path);
+		ok = EncodePngFile(pixels, header->width, header->height, layout, path, pngLevel);
+	}
+	if (ok) {
+		InterlockedIncrement(&writtenCount);
+	} else {
+		fprintf(stderr, "%s: could not write frame %lld\n", path.c_str(), (long long)header->sequence);
+		InterlockedIncrement(&failedCount);
+	}
+}
+
+static DWORD WINAPI EncodeThreadLoop(LPVOID)
+{
+	LONG index;
+	while ((index = InterlockedIncrement(&nextRecord)) < (LONG)records.size())
+		WriteRecord(records[index]);
+	return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: Spool2Png <basePath> [outputDirectory] [threads] [pngLevel]\n");
+		return 2;
+	}
+	std::string basePath = argv[1];
+	if (argc > 2)
+		outputDirectory = argv[2];
+
+	SYSTEM_INFO system;
+	GetSystemInfo(&system);
+	int threadCount = argc > 3 ? atoi(argv[3]) : (int)system.dwNumberOfProcessors;
+	threadCount = std::max<int>(1, std::min<int>(threadCount, MAXIMUM_WAIT_OBJECTS));
+	if (argc > 4)
+		pngLevel = atoi(argv[4]);
+
+	// Segment files are reused round-robin, their headers tell the recording order
+	std::vector<Segment> segments;
+	for (unsigned slot = 0; ; ++slot) {
+		std::string path = SpoolSegmentPath(basePath, slot);
+		if (GetFileAttributesA(path.c_str()) == INVALID_FILE_ATTRIBUTES)
+			break;
+		Segment segment;
+		if (OpenSegment(path, segment))
+			segments.push_back(segment);
+		else
+			CloseSegment(segment);
+	}
+	if (segments.empty()) {
+		fprintf(stderr, "no spool segments at %s\n", basePath.c_str());
+		return 1;
+	}
+	std::sort(segments.begin(), segments.end(), [](const Segment& a, const Segment& b) { return a.index < b.index; });
+	for (size_t i = 0; i < segments.size(); ++i)
+		CollectRecords(segments[i]);
+	std::stable_sort(records.begin(), records.end(), [](const Record& a, const Record& b) {
+		return a.header->sequence < b.header->sequence;
+	});
+
+	std::vector<HANDLE> threads;
+	for (int i = 0; i < threadCount; ++i)
+		threads.push_back(CreateThread(NULL, 0, EncodeThreadLoop, NULL, 0, NULL));
+	WaitForMultipleObjects((DWORD)threads.size(), &threads[0], TRUE, INFINITE);
+	for (size_t i = 0; i < threads.size(); ++i)
+		CloseHandle(threads[i]);
+
+	for (size_t i = 0; i < segments.size(); ++i)
+		CloseSegment(segments[i]);
+
+	printf("%ld written, %ld skipped, %ld failed\n", writtenCount, skippedCount, failedCount);
+	return failedCount > 0 ? 1 : 0;
+}
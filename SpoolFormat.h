@@ -0,0 +1,69 @@
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <stdio.h>
+#include <string>
+
+#pragma warning(push)
+#pragma warning(disable : 4005)
+#include <stdint.h>
+#pragma warning(pop)
+
+// On-disk layout of a capture spool, shared by the plugin's SpoolWriter and Spool2Png.
+//
+// A spool is a ring of preallocated segment files named <base>.000.spool, <base>.001.spool, ...
+// Each segment starts with a SpoolSegmentHeader, followed by frame records up to usedBytes.
+// A record is a SpoolFrameHeader, the frame's file path (not terminated) and the pixels, which
+// start and end on a kSpoolAlignment boundary. Everything is little-endian.
+
+static const uint32_t kSpoolSegmentMagic = 0x47455053; // "SPEG"
+static const uint32_t kSpoolFrameMagic = 0x4D524653;   // "SFRM"
+static const uint32_t kSpoolVersion = 1;
+static const uint64_t kSpoolAlignment = 64;
+
+struct SpoolSegmentHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t segmentIndex;       // counts up for the whole recording; orders the reused files
+	uint64_t usedBytes;          // header plus complete records, updated after every record
+	uint64_t timestampFrequency; // ticks per second of SpoolFrameHeader::timestamp
+	uint8_t reserved[32];
+};
+
+struct SpoolFrameHeader
+{
+	uint32_t magic;
+	uint32_t format;   // DXGI_FORMAT of the captured texture
+	uint32_t layout;   // PixelLayout of the pixels
+	uint32_t output;   // CaptureOutput the frame was captured for
+	uint32_t width;
+	uint32_t height;
+	uint64_t rowPitch;
+	uint64_t dataSize;
+	int64_t sequence;
+	int64_t timestamp; // QueryPerformanceCounter when the capture was queued
+	uint64_t recordSize;
+	uint32_t pathLength;
+	uint32_t reserved;
+};
+
+inline uint64_t SpoolAlign(uint64_t size)
+{
+	return (size + kSpoolAlignment - 1) & ~(kSpoolAlignment - 1);
+}
+
+// Offset of the pixels from the start of a record
+inline uint64_t SpoolPixelOffset(uint32_t pathLength)
+{
+	return SpoolAlign(sizeof(SpoolFrameHeader) + pathLength);
+}
+
+// File name of the segment in ring slot `slot`
+inline std::string SpoolSegmentPath(const std::string& basePath, unsigned slot)
+{
+	char suffix[32];
+	sprintf_s(suffix, ".%03u.spool", slot);
+	return basePath + suffix;
+}
@@ -0,0 +1,148 @@
+#include "SpoolWriter.h"
+
+//--------------------------------------------------------------------------------------
+SpoolWriter::SpoolWriter()
+	: segmentBytes(0), segmentIndex(0), timestampFrequency(0), mapping(NULL), view(NULL)
+{
+	InitializeCriticalSection(&lock);
+}
+
+SpoolWriter::~SpoolWriter()
+{
+	Close();
+	DeleteCriticalSection(&lock);
+}
+
+
+//--------------------------------------------------------------------------------------
+bool SpoolWriter::Open(const std::string& basePath, size_t segmentBytes, unsigned segmentCount)
+{
+	Close();
+	if (segmentCount == 0 || segmentBytes <= sizeof(SpoolSegmentHeader))
+		return false;
+
+	EnterCriticalSection(&lock);
+	bool ok = true;
+	for (unsigned i = 0; i < segmentCount && ok; ++i) {
+		HANDLE file = CreateFileA(SpoolSegmentPath(basePath, i).c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+			NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			ok = false;
+			break;
+		}
+		files.push_back(file);
+
+		// Reserve the whole segment now rather than extending the file while recording
+		LARGE_INTEGER size;
+		size.QuadPart = (LONGLONG)segmentBytes;
+		ok = SetFilePointerEx(file, size, NULL, FILE_BEGIN) && SetEndOfFile(file);
+	}
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	timestampFrequency = (uint64_t)frequency.QuadPart;
+	this->segmentBytes = segmentBytes;
+	segmentIndex = 0;
+	ok = ok && MapSegment(0);
+	LeaveCriticalSection(&lock);
+
+	if (!ok)
+		Close();
+	return ok;
+}
+
+void SpoolWriter::Close()
+{
+	EnterCriticalSection(&lock);
+	UnmapSegment();
+	for (size_t i = 0; i < files.size(); ++i)
+		CloseHandle(files[i]);
+	files.clear();
+	LeaveCriticalSection(&lock);
+}
+
+
+//--------------------------------------------------------------------------------------
+bool SpoolWriter::MapSegment(uint64_t index)
+{
+	HANDLE file = files[(size_t)(index % files.size())];
+	mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, 0, 0, NULL);
+	if (!mapping)
+		return false;
+	view = static_cast<uint8_t*>( MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, segmentBytes) );
+	if (!view) {
+		CloseHandle(mapping);
+		mapping = NULL;
+		return false;
+	}
+
+	SpoolSegmentHeader* header = reinterpret_cast<SpoolSegmentHeader*>(view);
+	memset(header, 0, sizeof(SpoolSegmentHeader));
+	header->magic = kSpoolSegmentMagic;
+	header->version = kSpoolVersion;
+	header->segmentIndex = index;
+	header->usedBytes = sizeof(SpoolSegmentHeader);
+	header->timestampFrequency = timestampFrequency;
+	segmentIndex = index;
+	return true;
+}
+
+void SpoolWriter::UnmapSegment()
+{
+	if (view) {
+		UnmapViewOfFile(view);
+		view = NULL;
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+		mapping = NULL;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+bool SpoolWriter::Append(const TextureInfo& frame)
+{
+	size_t pathLength = strlen(frame.filePath);
+	uint64_t pixelOffset = SpoolPixelOffset((uint32_t)pathLength);
+	uint64_t recordSize = SpoolAlign(pixelOffset + frame.pixels.Size());
+
+	EnterCriticalSection(&lock);
+	if (!view || recordSize > segmentBytes - sizeof(SpoolSegmentHeader)) {
+		LeaveCriticalSection(&lock);
+		return false;
+	}
+
+	SpoolSegmentHeader* segment = reinterpret_cast<SpoolSegmentHeader*>(view);
+	if (segment->usedBytes + recordSize > segmentBytes) {
+		UnmapSegment();
+		if (!MapSegment(segmentIndex + 1)) {
+			LeaveCriticalSection(&lock);
+			return false;
+		}
+		segment = reinterpret_cast<SpoolSegmentHeader*>(view);
+	}
+
+	uint8_t* record = view + segment->usedBytes;
+	SpoolFrameHeader* header = reinterpret_cast<SpoolFrameHeader*>(record);
+	memset(header, 0, sizeof(SpoolFrameHeader));
+	header->magic = kSpoolFrameMagic;
+	header->format = frame.format;
+	header->layout = frame.layout;
+	header->output = frame.output;
+	header->width = frame.width;
+	header->height = frame.height;
+	header->rowPitch = frame.rowPitch;
+	header->dataSize = frame.pixels.Size();
+	header->sequence = frame.sequence;
+	header->timestamp = frame.timestamp;
+	header->recordSize = recordSize;
+	header->pathLength = (uint32_t)pathLength;
+	memcpy(record + sizeof(SpoolFrameHeader), frame.filePath, pathLength);
+	memcpy(record + pixelOffset, frame.pixels.Get(), frame.pixels.Size());
+
+	// Publish the record last, so a crash mid-copy leaves the segment readable up to here
+	segment->usedBytes += recordSize;
+	LeaveCriticalSection(&lock);
+	return true;
+}
@@ -0,0 +1,48 @@
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <windows.h>
+#include <string>
+#include <vector>
+
+#include "ScreenGrab.h"
+#include "SpoolFormat.h"
+
+// Appends captured frames, uncompressed, to a ring of memory-mapped segment files (see
+// SpoolFormat.h), leaving the encoding to Spool2Png after the session. All segment files are
+// created at full size when the spool opens, so recording never grows a file. Once the last
+// segment is full the oldest one is overwritten.
+class SpoolWriter
+{
+public:
+	SpoolWriter();
+	~SpoolWriter();
+
+	// Creates segmentCount files of segmentBytes each, closing any spool already open
+	bool Open(const std::string& basePath, size_t segmentBytes, unsigned segmentCount);
+
+	// Unmaps the current segment and closes every file
+	void Close();
+
+	// Copies the frame into the current segment. Returns false when no spool is open, or the
+	// frame doesn't fit in a segment at all.
+	bool Append(const TextureInfo& frame);
+
+	bool IsOpen() const { return view != NULL; }
+
+private:
+	bool MapSegment(uint64_t index);
+	void UnmapSegment();
+
+	CRITICAL_SECTION lock;
+	std::vector<HANDLE> files;
+	size_t segmentBytes;
+	uint64_t segmentIndex;
+	uint64_t timestampFrequency;
+	HANDLE mapping;
+	uint8_t* view;
+
+	SpoolWriter(const SpoolWriter&);
+	SpoolWriter& operator=(const SpoolWriter&);
+};
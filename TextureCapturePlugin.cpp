@@ -2,6 +2,16 @@
 #include "Unity/IUnityInterface.h"
 #include "Unity/IUnityGraphics.h"
 #include "ScreenGrab.h"
+#include "CaptureQueue.h"
+#include "FrameCommitter.h"
+#include "BufferPool.h"
+#include "DeltaFrame.h"
+#include "HdrConvert.h"
+#include "PngEncoder.h"
+#include "QoiCodec.h"
+#include "SpoolWriter.h"
+#include "CaptureArchive.h"
+#include "CaptureResults.h"
 #include "lodepng.h"
 #include "Unity/IUnityGraphicsD3D11.h"
 
@@ -10,9 +20,10 @@
 #include <stdio.h>
 #include <vector>
 #include <string>
+#include <map>
 #include <d3d11.h>
 #include <time.h>
-#include <queue>
+#include <algorithm>
 
 static FILE * logFile = NULL;
 static void Log(std::string message)
@@ -24,27 +35,594 @@ static void Log(std::string message)
 }
 
 static bool writeThreadEnabled = true;
-static HANDLE writeThreadHandle;
-static std::queue<TextureInfo> writeThreadQueue = std::queue<TextureInfo>();
+static CaptureQueue writeThreadQueue(64);
+static FrameCommitter frameCommitter(64);
+static SpoolWriter frameSpool;
+static CaptureArchive frameArchive;
+static CaptureResults captureResults;
+
+// Where finished frames go. In memory they wait in captureResults for PollCaptureResult, and
+// count against the capture budget until released.
+enum ResultDelivery
+{
+	kDeliverFiles = 0,   // written to their paths
+	kDeliverEncoded,     // the encoded PNG or QOI file contents
+	kDeliverPixels,      // the converted pixels, as PNG would get them; DDS captures unconverted
+};
+static volatile LONG resultDelivery = kDeliverFiles;
+
+// Frames of a texture are XORed against the one before, with a whole frame every
+// deltaKeyframeInterval frames; 0 or 1 turns it off. deltaEncoder is only touched on the
+// render thread.
+static volatile LONG deltaKeyframeInterval = 0;
+static DeltaEncoder deltaEncoder;
+
+// What happens to a frame whose pixels repeat the last frame written from the same texture.
+// Any policy but kDuplicatesWrite hashes every frame while it is converted.
+enum DuplicatePolicy
+{
+	kDuplicatesWrite = 0,   // encoded like any other frame
+	kDuplicatesSkip,        // nothing is written
+	kDuplicatesHardLink,    // its path becomes a hard link to the earlier file
+	kDuplicatesManifest,    // listed in a duplicates.txt next to it
+};
+static volatile LONG duplicatePolicy = kDuplicatesWrite;
+static volatile LONG64 duplicateFrames = 0;
+static volatile LONG64 lastFrameHash = 0;
+
+// The last frame queued for writing from each texture; render thread only
+struct WrittenFrame
+{
+	uint64_t hash;
+	unsigned width;
+	unsigned height;
+	PixelLayout layout;
+	CaptureOutput output;
+	std::string path;
+	int64_t sequence;
+};
+static std::map<const void*, WrittenFrame> writtenFrames;
+
+// Backpressure: once the queued frames hold more than captureBudget bytes, the policy decides
+// what gives way. A budget of 0 means unlimited; the ring itself still caps the frame count.
+enum BackpressurePolicy
+{
+	kBackpressureBlock = 0,     // the render thread waits for the encoders
+	kBackpressureDropNewest,    // the frame being captured is discarded
+	kBackpressureDropOldest,    // the oldest queued frames are discarded
+	kBackpressureCoalesce,      // queued frames for the same file are replaced by the new one
+};
+static volatile LONG64 captureBudget = 0;
+static volatile LONG backpressurePolicy = kBackpressureDropNewest;
+static volatile LONG64 bytesInFlight = 0;
+static volatile LONG64 droppedFrames = 0;
+static volatile LONG64 failedFrames = 0;
+static HANDLE frameReleasedEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+static bool OverBudget(size_t size)
+{
+	LONG64 budget = captureBudget;
+	LONG64 inFlight = bytesInFlight;
+	// A single frame larger than the budget is still let through when nothing else is queued
+	return budget > 0 && inFlight > 0 && inFlight + (LONG64)size > budget;
+}
+
+// Frees a frame that was admitted to the queue and returns its bytes to the budget
+static void ReleaseFrame(TextureInfo& frame)
+{
+	InterlockedExchangeAdd64(&bytesInFlight, -(LONG64)frame.pixels.Size());
+	frame = TextureInfo();
+	SetEvent(frameReleasedEvent);
+}
+
+// Render thread only
+static void DropFrame(TextureInfo& frame)
+{
+	// A queued delta frame may be the reference of the ones behind it; start over with keyframes
+	deltaEncoder.Reset();
+	// Same for duplicates, whose original may be the frame going away
+	writtenFrames.clear();
+	InterlockedIncrement64(&droppedFrames);
+	frameCommitter.Skip(frame.sequence);
+	ReleaseFrame(frame);
+}
+
+// Frames in kPixelRaw come from formats PNG can't hold
+static bool CanEncodeFrame(const TextureInfo& frame)
+{
+	return frame.pixels.Get() != NULL && IsPngLayout(frame.layout);
+}
+
+static volatile LONG pngCompressionLevel = kPngDefaultLevel;
+static volatile LONG pngDeflateThreads = 1;
+
+static bool EncodeFrame(const TextureInfo& frame, const std::string& path)
+{
+	return EncodePngFile(frame.pixels.Get(), frame.width, frame.height, frame.layout, path, pngCompressionLevel,
+		frame.deltaOf, pngDeflateThreads);
+}
+
+// Encodes a frame into memory, for the archive and for results delivered in memory
+typedef bool (*FrameEncoder)(const TextureInfo& frame, EncodedFrame& encoded);
+
+// Keeps the buffer lodepng encoded into
+static bool EncodePngBytes(const TextureInfo& frame, EncodedFrame& png)
+{
+	return EncodePng(frame.pixels.Get(), frame.width, frame.height, frame.layout, png.png, png.size,
+		pngCompressionLevel, frame.deltaOf, pngDeflateThreads);
+}
+
+// Writes into a pooled buffer with room for the worst case, so a steady capture neither allocates
+// nor clears five bytes per pixel for every frame
+static bool EncodeQoiBytes(const TextureInfo& frame, EncodedFrame& qoi)
+{
+	size_t maxSize = MaxQoiSize(frame.width, frame.height);
+	if (maxSize == 0)
+		return false;
+	qoi.pooled = PixelBuffer(maxSize);
+	if (qoi.pooled.Get() == NULL)
+		return false;
+	qoi.size = EncodeQoi(frame.pixels.Get(), frame.width, frame.height, frame.layout, qoi.pooled.Get());
+	return qoi.size > 0;
+}
+
+static bool WriteEncodedFile(const EncodedFrame& encoded, const std::string& path)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	bool ok = encoded.size == 0 || fwrite(encoded.Data(), 1, encoded.size, file) == encoded.size;
+	return fclose(file) == 0 && ok;
+}
+
+static bool EncodeQoiFrame(const TextureInfo& frame, const std::string& path)
+{
+	EncodedFrame qoi;
+	return EncodeQoiBytes(frame, qoi) && WriteEncodedFile(qoi, path);
+}
+
+// Float captures are either tone mapped into a 16-bit PNG or written out as a PFM file next to
+// where the PNG would have gone
+enum HdrOutput
+{
+	kHdrOutputToneMapped = 0,
+	kHdrOutputFloat,
+};
+static volatile LONG hdrOutput = kHdrOutputToneMapped;
+static volatile LONG hdrToneMap = kToneMapACES;
+static volatile float hdrExposure = 1.0f;
+
+static void ToneMapFrame(TextureInfo& frame)
+{
+	ToneMapPixels(frame.layout, frame.pixels.Get(), frame.pixels.Get(), (size_t)frame.width * frame.height,
+		(ToneMapOperator)hdrToneMap, hdrExposure);
+	frame.layout = kPixelRGBA16;
+	frame.rowPitch = (size_t)frame.width * 8;
+}
+
+static std::string ReplaceExtension(const std::string& path, const char* extension)
+{
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return path + extension;
+	return path.substr(0, dot) + extension;
+}
+
+// Portable float map: RGB floats, little-endian, bottom row first
+static bool WriteFloatFile(const TextureInfo& frame, const std::string& path)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	bool ok = fprintf(file, "PF\n%u %u\n-1.0\n", frame.width, frame.height) > 0;
+	std::vector<float> row((size_t)frame.width * 3);
+	for (unsigned y = frame.height; ok && y-- > 0; ) {
+		ExtractFloatRGB(frame.layout, frame.pixels.Get() + y * frame.rowPitch, &row[0], frame.width);
+		ok = fwrite(&row[0], sizeof(float), row.size(), file) == row.size();
+	}
+	return fclose(file) == 0 && ok;
+}
+
+static bool WriteDDSFile(const TextureInfo& frame, const std::string& path)
+{
+	return SUCCEEDED(SaveDDSFrame(frame, path.c_str()));
+}
+
+// Writes a frame to its file; the committer renames it into place afterwards
+typedef bool (*FrameWriter)(const TextureInfo& frame, const std::string& path);
+
+// Where a frame requested at path ends up, which depends on its layout and output format
+static std::string GetFinalPath(const TextureInfo& frame, const std::string& path)
+{
+	if (frame.output == kOutputDDS)
+		return path;
+	if (IsFloatLayout(frame.layout)) {
+		if (hdrOutput == kHdrOutputFloat)
+			return ReplaceExtension(path, ".pfm");
+		// Tone mapped frames don't fit in QOI
+		return frame.output == kOutputQOI ? ReplaceExtension(path, ".png") : path;
+	}
+	// Neither do 16-bit ones, they still get a PNG
+	if (frame.output == kOutputQOI && !IsQoiLayout(frame.layout))
+		return ReplaceExtension(path, ".png");
+	return path;
+}
+
+// Gets the frame ready for its output format and picks the writer, or NULL when the frame can't
+// be written. finalPath starts as the requested path and may get a different extension.
+static FrameWriter PrepareFrame(TextureInfo& frame, std::string& finalPath)
+{
+	if (frame.pixels.Get() == NULL)
+		return NULL;
+	finalPath = GetFinalPath(frame, finalPath);
+	if (frame.output == kOutputDDS)
+		return WriteDDSFile;
+	if (IsFloatLayout(frame.layout)) {
+		if (hdrOutput == kHdrOutputFloat)
+			return WriteFloatFile;
+		ToneMapFrame(frame);
+	}
+	if (frame.output == kOutputQOI && IsQoiLayout(frame.layout))
+		return EncodeQoiFrame;
+	return CanEncodeFrame(frame) ? EncodeFrame : NULL;
+}
+
+// A write can fail for a moment, say while a viewer holds the file; a frame the writer rejects
+// or a missing directory fails every time, so after a few attempts the frame is given up on
+static const int kWriteAttempts = 3;
+static const DWORD kWriteRetryMilliseconds = 20;
+
+static bool WriteWithRetries(FrameWriter writer, const TextureInfo& frame, const std::string& path)
+{
+	for (int attempt = 1; ; ++attempt) {
+		if (writer(frame, path))
+			return true;
+		if (attempt == kWriteAttempts || !writeThreadEnabled)
+			return false;
+		Sleep(kWriteRetryMilliseconds);
+	}
+}
+
+// The in-memory counterpart of a writer, NULL for the ones that only write files
+static FrameEncoder GetFrameEncoder(FrameWriter writer)
+{
+	if (writer == EncodeFrame)
+		return EncodePngBytes;
+	if (writer == EncodeQoiFrame)
+		return EncodeQoiBytes;
+	return NULL;
+}
+
+// Encoder workers all drain writeThreadQueue; worker i keeps running while i < encoderThreadCount.
+// A worker decides to retire under encoderThreadLock, the same lock StartEncoderThreads checks
+// encoderThreadRunning under, so raising the count again either keeps the worker or restarts
+// its slot, never neither.
+static const int kMaxEncoderThreads = 32;
+static HANDLE encoderThreadHandles[kMaxEncoderThreads];
+static bool encoderThreadRunning[kMaxEncoderThreads];
+static volatile LONG encoderThreadCount = 1;
+static bool encoderThreadsStarted = false;
+static CRITICAL_SECTION encoderThreadLock;
+
+static bool InitializeEncoderThreadLock()
+{
+	InitializeCriticalSection(&encoderThreadLock);
+	return true;
+}
+static bool encoderThreadLockInitialized = InitializeEncoderThreadLock();
+
+// False once worker `index` is above the count; it then counts as retired
+static bool KeepEncoding(LONG index)
+{
+	EnterCriticalSection(&encoderThreadLock);
+	bool keep = index < encoderThreadCount;
+	if (!keep)
+		encoderThreadRunning[index] = false;
+	LeaveCriticalSection(&encoderThreadLock);
+	return keep;
+}
+
 static DWORD WINAPI WriteThreadLoop(LPVOID lpParameter)
 {
-	while (writeThreadEnabled) {
-		while (!writeThreadQueue.empty()) {
-			auto current = writeThreadQueue.front();
-			writeThreadQueue.pop();
-			try {
-				if (current.pixels != NULL) {
-					while (writeThreadEnabled && lodepng::encode(*current.filePath, current.pixels->get(), current.width, current.height, LCT_RGBA) != 0);
+	LONG index = (LONG)(INT_PTR)lpParameter;
+	TextureInfo current;
+	while (KeepEncoding(index) && writeThreadQueue.Pop(current)) {
+		bool written = false;
+		bool failed = false;
+		try {
+			if (current.duplicateOf[0]) {
+				// Nothing to encode; in memory the result only names the original. Otherwise the
+				// committer links or lists the frame in its turn, after the original, which another
+				// worker may still be encoding. While an archive is open the original most likely goes
+				// there, so the committer tries a link record first.
+				std::string originalPath = GetFinalPath(current, current.duplicateOf);
+				std::string finalPath = GetFinalPath(current, current.filePath);
+				bool listOnly = duplicatePolicy == kDuplicatesManifest;
+				if (resultDelivery == kDeliverFiles) {
+					if (frameArchive.IsOpen())
+						frameCommitter.CommitArchiveLink(current.sequence, &frameArchive, current.duplicateOfSequence,
+							current.timestamp, originalPath, finalPath, listOnly);
+					else
+						frameCommitter.CommitDuplicate(current.sequence, originalPath, finalPath, listOnly);
+					written = true;
+				} else {
+					captureResults.AddDuplicate(current);
+				}
+			} else {
+				// While a spool is open frames only get copied into it; Spool2Png writes the files
+				// later, so there is nothing for the committer. The same goes for frames delivered
+				// in memory or appended to an archive.
+				std::string finalPath = current.filePath;
+				FrameWriter writer = frameSpool.Append(current) ? NULL : PrepareFrame(current, finalPath);
+				LONG delivery = resultDelivery;
+				FrameEncoder encoder = GetFrameEncoder(writer);
+				if (writer != NULL && delivery == kDeliverPixels) {
+					// Moving the pixels out leaves them in the budget until the application releases
+					// them; ReleaseFrame only returns what the frame still holds
+					captureResults.AddPixels(current);
+				} else if (encoder != NULL && delivery == kDeliverEncoded) {
+					EncodedFrame encoded;
+					failed = !encoder(current, encoded);
+					if (!failed) {
+						InterlockedExchangeAdd64(&bytesInFlight, (LONG64)encoded.size);
+						captureResults.AddEncoded(current, encoded);
+					}
+				} else if (encoder != NULL && frameArchive.IsOpen()) {
+					// StopArchive may have closed the archive since the check, or the disk is full;
+					// then the frame is written to its file as it would be without an archive
+					EncodedFrame encoded;
+					failed = !encoder(current, encoded);
+					if (!failed && !frameArchive.Append(finalPath, encoded.Data(), encoded.size, current.sequence,
+						current.timestamp)) {
+						std::string tempPath = FrameCommitter::TempPath(finalPath, current.sequence);
+						written = WriteEncodedFile(encoded, tempPath);
+						failed = !written;
+						if (written)
+							frameCommitter.Commit(current.sequence, tempPath, finalPath);
+						else
+							DeleteFileA(tempPath.c_str());
+					}
+				} else if (writer != NULL) {
+					std::string tempPath = FrameCommitter::TempPath(finalPath, current.sequence);
+					written = WriteWithRetries(writer, current, tempPath);
+					failed = !written;
+					if (written)
+						frameCommitter.Commit(current.sequence, tempPath, finalPath);
+					else
+						DeleteFileA(tempPath.c_str());
 				}
-				delete current.pixels;
-			} catch (...) { }
+			}
+		} catch (...) {
+			failed = !written;
 		}
-		Sleep(50);
+		if (failed)
+			InterlockedIncrement64(&failedFrames);
+		if (!written)
+			frameCommitter.Skip(current.sequence);
+		ReleaseFrame(current);
 	}
-	CloseHandle(writeThreadHandle);
 	return 0;
 }
 
+static void StartEncoderThreads()
+{
+	EnterCriticalSection(&encoderThreadLock);
+	for (LONG i = 0; i < encoderThreadCount; ++i) {
+		// A worker above a previous, smaller count that hasn't retired yet sees the new count
+		// before its next frame and stays
+		if (encoderThreadRunning[i])
+			continue;
+		HANDLE& handle = encoderThreadHandles[i];
+		if (handle != NULL) {
+			// Retired, all it has left is to return
+			WaitForSingleObject(handle, INFINITE);
+			CloseHandle(handle);
+		}
+		DWORD threadID;
+		handle = CreateThread(0, 0, WriteThreadLoop, (LPVOID)(INT_PTR)i, 0, &threadID);
+		encoderThreadRunning[i] = handle != NULL;
+	}
+	encoderThreadsStarted = true;
+	LeaveCriticalSection(&encoderThreadLock);
+}
+
+static void StopEncoderThreads()
+{
+	writeThreadEnabled = false;
+	writeThreadQueue.Close();
+	for (int i = 0; i < kMaxEncoderThreads; ++i) {
+		if (encoderThreadHandles[i] != NULL) {
+			WaitForSingleObject(encoderThreadHandles[i], INFINITE);
+			CloseHandle(encoderThreadHandles[i]);
+			encoderThreadHandles[i] = NULL;
+		}
+		encoderThreadRunning[i] = false;
+	}
+	encoderThreadsStarted = false;
+	frameCommitter.Flush();
+}
+
+// Number of threads encoding captured frames in parallel. Lowering it lets surplus workers
+// finish the frame they hold and exit.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetEncoderThreadCount(int count)
+{
+	count = std::max<int>(1, std::min<int>(count, kMaxEncoderThreads));
+	InterlockedExchange(&encoderThreadCount, count);
+	if (encoderThreadsStarted)
+		StartEncoderThreads();
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetCaptureMemoryBudget(int megabytes)
+{
+	InterlockedExchange64(&captureBudget, (LONG64)std::max<int>(0, megabytes) << 20);
+	SetEvent(frameReleasedEvent);
+}
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetBackpressurePolicy(int policy)
+{
+	if (policy >= kBackpressureBlock && policy <= kBackpressureCoalesce)
+		InterlockedExchange(&backpressurePolicy, policy);
+	SetEvent(frameReleasedEvent);
+}
+extern "C" long long UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetDroppedFrameCount()
+{
+	return droppedFrames;
+}
+// Frames that were captured but never made it out: encoding failed, the file or archive record
+// couldn't be written, or a duplicate's original never appeared to link to
+extern "C" long long UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetFailedFrameCount()
+{
+	return failedFrames + frameCommitter.FailedCount();
+}
+extern "C" long long UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetBytesInFlight()
+{
+	return bytesInFlight;
+}
+extern "C" long long UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetBufferPoolHits()
+{
+	return GetPixelBufferPoolHits();
+}
+extern "C" long long UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetBufferPoolMisses()
+{
+	return GetPixelBufferPoolMisses();
+}
+
+// How float render targets are written; see HdrOutput and ToneMapOperator. Exposure is in
+// stops and only applies to tone mapping.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetHdrOutput(int output)
+{
+	if (output >= kHdrOutputToneMapped && output <= kHdrOutputFloat)
+		InterlockedExchange(&hdrOutput, output);
+}
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetHdrToneMap(int op, float exposure)
+{
+	if (op >= kToneMapClamp && op <= kToneMapACES)
+		InterlockedExchange(&hdrToneMap, op);
+	hdrExposure = powf(2.0f, exposure);
+}
+
+// Format captures are written in when the file path doesn't end in .png, .dds or .qoi; see
+// CaptureOutput. DDS skips all conversion and is much cheaper to write; QOI encodes several
+// times faster than PNG.
+static volatile LONG outputFormat = kOutputPNG;
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetOutputFormat(int format)
+{
+	if (format >= kOutputPNG && format <= kOutputQOI)
+		InterlockedExchange(&outputFormat, format);
+}
+
+static CaptureOutput GetOutputForPath(const std::string& path)
+{
+	size_t dot = path.find_last_of('.');
+	if (dot != std::string::npos) {
+		if (_stricmp(path.c_str() + dot, ".dds") == 0)
+			return kOutputDDS;
+		if (_stricmp(path.c_str() + dot, ".png") == 0)
+			return kOutputPNG;
+		if (_stricmp(path.c_str() + dot, ".qoi") == 0)
+			return kOutputQOI;
+	}
+	return (CaptureOutput)outputFormat;
+}
+
+// PNG compression level, 0 (stored) to 9 (smallest); see PngEncoder.h. Applies to frames
+// encoded from now on.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetPngCompressionLevel(int level)
+{
+	InterlockedExchange(&pngCompressionLevel, std::max<int>(kPngMinLevel, std::min<int>(level, kPngMaxLevel)));
+}
+
+// Threads compressing the image data of each PNG, for lower latency on single large frames;
+// 1 compresses it on the encoder thread alone. Frames take a few hundred bytes more per thread.
+// Frames of kPngStreamingBytes (64 MB) of pixels or more are streamed to their files on the
+// encoder thread alone, whatever the setting; in memory and in an archive they still use it.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetPngDeflateThreads(int threads)
+{
+	InterlockedExchange(&pngDeflateThreads, std::max<int>(1, std::min<int>(threads, kPngMaxDeflateThreads)));
+}
+
+// Stores PNG frames of the same texture as XOR differences against the frame before, keeping
+// every `frames`-th frame whole; 0 or 1 stores every frame whole. Delta2Png rebuilds the full
+// frames. Use it with the Block backpressure policy: a dropped or unwritten frame leaves the
+// deltas after it undecodable up to the next keyframe. Not applied while a spool is open.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetDeltaKeyframeInterval(int frames)
+{
+	InterlockedExchange(&deltaKeyframeInterval, std::max<int>(0, frames));
+}
+
+// Frames that repeat the previous frame of their texture byte for byte are skipped, hard linked
+// to the earlier file or listed in a duplicates.txt; see DuplicatePolicy. Not applied while a
+// spool is open.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetDuplicateFramePolicy(int policy)
+{
+	if (policy >= kDuplicatesWrite && policy <= kDuplicatesManifest)
+		InterlockedExchange(&duplicatePolicy, policy);
+}
+extern "C" long long UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetDuplicateFrameCount()
+{
+	return duplicateFrames;
+}
+// 64-bit xxHash of the converted pixels of the last frame delivered, 0 until a duplicate policy
+// is set
+extern "C" unsigned long long UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetLastFrameHash()
+{
+	return (unsigned long long)lastFrameHash;
+}
+
+// Records raw frames into segmentCount memory-mapped files of segmentMegabytes each, named
+// basePath.000.spool and up, for Spool2Png to encode later. Returns 0 if the files can't be created.
+extern "C" int UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API StartSpool(const char* basePath, int segmentMegabytes, int segmentCount)
+{
+	if (!basePath || segmentMegabytes <= 0 || segmentCount <= 0)
+		return 0;
+	return frameSpool.Open(basePath, (size_t)segmentMegabytes << 20, (unsigned)segmentCount) ? 1 : 0;
+}
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API StopSpool()
+{
+	frameSpool.Close();
+}
+
+// Appends PNG and QOI frames to the single archive file at path instead of writing a file each,
+// until StopArchive writes its index. Archive2Png extracts them. Frames in other formats are
+// still written as files, as is a frame the archive can't take; duplicates of archived frames
+// become link records whatever the duplicate policy. Returns 0 if the file can't be created.
+extern "C" int UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API StartArchive(const char* path)
+{
+	if (!path)
+		return 0;
+	return frameArchive.Open(path) ? 1 : 0;
+}
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API StopArchive()
+{
+	frameArchive.Close();
+}
+
+// Delivers finished frames in memory instead of writing files; see ResultDelivery. Frames in
+// memory are not delta encoded. Duplicates, under any policy but kDuplicatesWrite, carry no
+// pixels and produce an empty result whose duplicateOf names the frame they repeat. Frames the
+// chosen form doesn't cover (DDS and float files when encoded) are still written to files.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetResultDelivery(int delivery)
+{
+	if (delivery >= kDeliverFiles && delivery <= kDeliverPixels)
+		InterlockedExchange(&resultDelivery, delivery);
+}
+// Takes the oldest finished frame. Returns 0 when there is none. The buffer in info stays valid
+// until it is passed to ReleaseCaptureResult.
+extern "C" int UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API PollCaptureResult(CaptureResultInfo* info)
+{
+	return info && captureResults.Poll(*info) ? 1 : 0;
+}
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API ReleaseCaptureResult(const void* data)
+{
+	size_t size = captureResults.Release(data);
+	if (size > 0) {
+		InterlockedExchangeAdd64(&bytesInFlight, -(LONG64)size);
+		SetEvent(frameReleasedEvent);
+	}
+}
+
 static void* g_TexturePointer = NULL;
 extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetTexture(void* texturePtr)
 {
@@ -55,12 +633,148 @@ extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetFilePath(const cha
 {
 	filePath = path;
 }
+// Frames between a capture and its readback; 0 stalls the render thread until the GPU catches up
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetReadbackLatency(int frames)
+{
+	SetTextureReadbackLatency((UINT)std::max<int>(0, frames));
+}
+
+static ID3D11Device* g_D3D11Device = NULL;
+
+// Pulls queued frames for the same file as `frame` out of the ring until it fits the budget.
+// Frames for other files go back in behind it; the committer restores their order on disk.
+static void CoalesceQueued(const TextureInfo& frame)
+{
+	std::vector<TextureInfo> others;
+	TextureInfo queued;
+	while (OverBudget(frame.pixels.Size()) && writeThreadQueue.Steal(queued)) {
+		if (strcmp(queued.filePath, frame.filePath) == 0)
+			DropFrame(queued);
+		else
+			others.push_back(std::move(queued));
+	}
+	for (size_t i = 0; i < others.size(); ++i) {
+		if (!writeThreadQueue.Push(others[i]))
+			DropFrame(others[i]);
+	}
+}
+
+// Applies the backpressure policy and queues the frame. Returns false, having freed the frame,
+// if it was discarded instead.
+static bool EnqueueFrame(TextureInfo& frame)
+{
+	TextureInfo oldest;
+	switch (backpressurePolicy) {
+	case kBackpressureBlock:
+		while (OverBudget(frame.pixels.Size()) && writeThreadEnabled)
+			WaitForSingleObject(frameReleasedEvent, 100);
+		break;
+	case kBackpressureDropOldest:
+		while (OverBudget(frame.pixels.Size()) && writeThreadQueue.Steal(oldest))
+			DropFrame(oldest);
+		break;
+	case kBackpressureCoalesce:
+		CoalesceQueued(frame);
+		break;
+	}
+
+	if (!OverBudget(frame.pixels.Size())) {
+		InterlockedExchangeAdd64(&bytesInFlight, (LONG64)frame.pixels.Size());
+		bool queued;
+		for (;;) {
+			queued = writeThreadQueue.Push(frame);
+			if (queued)
+				break;
+			// The ring is full even though the budget is not
+			if (backpressurePolicy == kBackpressureBlock && writeThreadEnabled)
+				WaitForSingleObject(frameReleasedEvent, 100);
+			else if (backpressurePolicy == kBackpressureDropOldest && writeThreadQueue.Steal(oldest))
+				DropFrame(oldest);
+			else
+				break;
+		}
+		if (queued)
+			return true;
+		InterlockedExchangeAdd64(&bytesInFlight, -(LONG64)frame.pixels.Size());
+	}
+
+	InterlockedIncrement64(&droppedFrames);
+	frame = TextureInfo();
+	return false;
+}
+
+// Only touched on the render thread. A discarded frame doesn't consume a number, so the
+// committer never waits on it.
+static int64_t nextSequence = 0;
+
+// True when the frame repeats the last one queued from its texture; otherwise it becomes the
+// one later frames are compared with
+static bool IsDuplicateFrame(const TextureInfo& frame)
+{
+	WrittenFrame& last = writtenFrames[frame.texture];
+	if (!last.path.empty() && last.hash == frame.contentHash && last.width == frame.width
+		&& last.height == frame.height && last.layout == frame.layout && last.output == frame.output)
+		return true;
+	last.hash = frame.contentHash;
+	last.width = frame.width;
+	last.height = frame.height;
+	last.layout = frame.layout;
+	last.output = frame.output;
+	last.path = frame.filePath;
+	last.sequence = frame.sequence;
+	return false;
+}
+
+static void DeliverFrame(TextureInfo& frame)
+{
+	frame.sequence = nextSequence;
+	if (frame.hashContent)
+		lastFrameHash = (LONG64)frame.contentHash;
+
+	// A spool keeps every frame; Spool2Png writes them all
+	LONG policy = duplicatePolicy;
+	if (policy != kDuplicatesWrite && frame.hashContent && frame.pixels.Get() != NULL && !frameSpool.IsOpen()
+		&& IsDuplicateFrame(frame)) {
+		InterlockedIncrement64(&duplicateFrames);
+		// In memory the caller may be waiting on this very capture, so it always gets a result
+		if (policy == kDuplicatesSkip && resultDelivery == kDeliverFiles) {
+			frame = TextureInfo();
+			return;
+		}
+		// Only the original's path and sequence travel on; the pixels go back to the pool right away
+		strcpy_s(frame.duplicateOf, writtenFrames[frame.texture].path.c_str());
+		frame.duplicateOfSequence = writtenFrames[frame.texture].sequence;
+		frame.pixels = PixelBuffer();
+	} else {
+		LONG keyframeInterval = deltaKeyframeInterval;
+		if (keyframeInterval > 1 && !frameSpool.IsOpen() && resultDelivery == kDeliverFiles)
+			deltaEncoder.Apply(frame, keyframeInterval);
+		else
+			deltaEncoder.Reset();
+	}
+	if (EnqueueFrame(frame)) {
+		++nextSequence;
+	} else {
+		deltaEncoder.Reset();
+		writtenFrames.clear();
+	}
+}
+
+// Waits for every readback still in flight and queues the frames
+static void FlushReadbacks()
+{
+	if (g_D3D11Device == NULL)
+		return;
+	ID3D11DeviceContext* ctx = NULL;
+	g_D3D11Device->GetImmediateContext(&ctx);
+	CollectTextureReadbacks(ctx, true, DeliverFrame);
+	ctx->Release();
+}
 
 // UnitySetInterfaces
 static IUnityInterfaces* s_UnityInterfaces = NULL;
 static IUnityGraphics* s_Graphics = NULL;
 static UnityGfxRenderer s_DeviceType = kUnityGfxRendererNull;
-static ID3D11Device* g_D3D11Device = NULL;
 static void UNITY_INTERFACE_API OnGraphicsDeviceEvent(UnityGfxDeviceEventType eventType)
 {
 	UnityGfxRenderer currentDeviceType = s_DeviceType;
@@ -76,13 +790,18 @@ static void UNITY_INTERFACE_API OnGraphicsDeviceEvent(UnityGfxDeviceEventType ev
 
 	case kUnityGfxDeviceEventShutdown:
 		{
+			FlushReadbacks();
+			ReleaseCaptureResources();
 			s_DeviceType = kUnityGfxRendererNull;
 			g_TexturePointer = NULL;
+			g_D3D11Device = NULL;
 			break;
 		}
 
 	case kUnityGfxDeviceEventBeforeReset:
 		{
+			FlushReadbacks();
+			ReleaseCaptureResources();
 			break;
 		}
 
@@ -99,8 +818,7 @@ static void UNITY_INTERFACE_API OnGraphicsDeviceEvent(UnityGfxDeviceEventType ev
 }
 extern "C" void	UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API UnityPluginLoad(IUnityInterfaces* unityInterfaces)
 {
-	DWORD myThreadID;
-	writeThreadHandle = CreateThread(0, 0, WriteThreadLoop, NULL, 0, &myThreadID);
+	StartEncoderThreads();
 
 	s_UnityInterfaces = unityInterfaces;
 	s_Graphics = s_UnityInterfaces->Get<IUnityGraphics>();
@@ -114,7 +832,12 @@ extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API UnityPluginUnload()
 	if (logFile != NULL) {
 		fclose(logFile);
 	}
-	writeThreadEnabled = false;
+	StopEncoderThreads();
+	StopPngDeflateThreads();
+	frameSpool.Close();
+	frameArchive.Close();
+	InterlockedExchangeAdd64(&bytesInFlight, -(LONG64)captureResults.Clear());
+	TrimPixelBufferPool();
 
 	s_Graphics->UnregisterDeviceEventCallback(OnGraphicsDeviceEvent);
 }
@@ -124,18 +847,24 @@ static void UNITY_INTERFACE_API OnRenderEvent(int eventID)
 	if (s_DeviceType != kUnityGfxRendererD3D11)
 		return;
 
+	ID3D11DeviceContext* ctx = NULL;
+	g_D3D11Device->GetImmediateContext(&ctx);
+
+	// Hand over whatever earlier captures the GPU has finished, then start this one
+	CollectTextureReadbacks(ctx, false, DeliverFrame);
 	if (g_TexturePointer && !filePath.empty()) {
 		ID3D11Texture2D* d3dtex = (ID3D11Texture2D*)g_TexturePointer;
-		ID3D11DeviceContext* ctx = NULL;
-		g_D3D11Device->GetImmediateContext (&ctx);
-		auto result = GetTextureData(ctx, d3dtex);
-		ctx->Release();
-
-		if (result.pixels != NULL) {
-			result.filePath = new std::string(filePath);
-			writeThreadQueue.push(result);
-		}
+		TextureInfo frame;
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		frame.output = GetOutputForPath(filePath);
+		frame.timestamp = now.QuadPart;
+		frame.texture = g_TexturePointer;
+		frame.hashContent = duplicatePolicy != kDuplicatesWrite;
+		if (frame.SetFilePath(filePath))
+			QueueTextureReadback(ctx, d3dtex, frame, DeliverFrame);
 	}
+	ctx->Release();
 }
 extern "C" UnityRenderingEvent UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetRenderEventFunc()
 {
@@ -425,10 +425,73 @@ static void addBitsToStream(size_t* bitpointer, ucvector* bitstream, unsigned va
 	for(i = 0; i != nbits; ++i) addBitToStream(bitpointer, bitstream, (unsigned char)((value >> i) & 1));
 }
 
-static void addBitsToStreamReversed(size_t* bitpointer, ucvector* bitstream, unsigned value, size_t nbits)
+/*
+Word at a time bit writer for the deflate blocks. Bits collect in a 64-bit accumulator, the first
+one lowest, and go to the output 32 at a time instead of a push_back per byte. It carries on the
+stream of an (out, bitpointer) pair like addBitToStream uses: a partly written last byte of out
+is taken back into the accumulator, and written again with zero padding when finishing.
+*/
+typedef struct BitWriter
 {
-	size_t i;
-	for(i = 0; i != nbits; ++i) addBitToStream(bitpointer, bitstream, (unsigned char)((value >> (nbits - 1 - i)) & 1));
+	ucvector* out;
+	unsigned long long bits; /*bits not in out yet, the first one lowest*/
+	unsigned count; /*the number of those, below 32 between puts*/
+	size_t startsize; /*out->size and count when starting, to advance the bit pointer by*/
+	unsigned startcount;
+	unsigned error;
+} BitWriter;
+
+static void bitwriter_init(BitWriter* writer, ucvector* out, size_t bitpointer)
+{
+	writer->out = out;
+	writer->bits = 0;
+	writer->count = (unsigned)(bitpointer & 7);
+	writer->error = 0;
+	if(writer->count) writer->bits = out->data[--out->size];
+	writer->startsize = out->size;
+	writer->startcount = writer->count;
+}
+
+/*reserves room for size more bytes, so that puts of that many never reallocate*/
+static void bitwriter_reserve(BitWriter* writer, size_t size)
+{
+	if(!ucvector_reserve(writer->out, writer->out->size + size + 4)) writer->error = 83; /*alloc fail*/
+}
+
+static void bitwriter_flush32(BitWriter* writer)
+{
+	ucvector* out = writer->out;
+	if(out->size + 4 <= out->allocsize || ucvector_reserve(out, out->size + 4))
+	{
+		out->data[out->size + 0] = (unsigned char)(writer->bits);
+		out->data[out->size + 1] = (unsigned char)(writer->bits >> 8);
+		out->data[out->size + 2] = (unsigned char)(writer->bits >> 16);
+		out->data[out->size + 3] = (unsigned char)(writer->bits >> 24);
+		out->size += 4;
+	}
+	else writer->error = 83; /*alloc fail*/
+	writer->bits >>= 32;
+	writer->count -= 32;
+}
+
+/*appends the nbits (at most 32) lowest bits of value, which must have no bits above those*/
+static void bitwriter_put(BitWriter* writer, unsigned value, unsigned nbits)
+{
+	writer->bits |= (unsigned long long)value << writer->count;
+	writer->count += nbits;
+	if(writer->count >= 32) bitwriter_flush32(writer);
+}
+
+/*writes out the remaining bits and advances the bit pointer past everything put*/
+static unsigned bitwriter_finish(BitWriter* writer, size_t* bitpointer)
+{
+	*bitpointer += (writer->out->size - writer->startsize) * 8 + writer->count - writer->startcount;
+	for(; writer->count > 0; writer->bits >>= 8)
+	{
+		if(!ucvector_push_back(writer->out, (unsigned char)writer->bits)) writer->error = 83; /*alloc fail*/
+		writer->count = writer->count > 8 ? writer->count - 8 : 0;
+	}
+	return writer->error;
 }
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
@@ -1292,10 +1355,19 @@ static unsigned inflate(unsigned char** out, size_t* outsize,
 
 static const size_t MAX_SUPPORTED_DEFLATE_LENGTH = 258;
 
-/*bitlen is the size in bits of the code*/
-static void addHuffmanSymbol(size_t* bp, ucvector* compressed, unsigned code, unsigned bitlen)
+/*
+The codes of tree with their bits in stream order, the first bit lowest, so that a symbol goes
+out with a single bitwriter_put of (codes[symbol], tree->lengths[symbol])
+*/
+static void getStreamCodes(unsigned* codes, const HuffmanTree* tree)
 {
-	addBitsToStreamReversed(bp, compressed, code, bitlen);
+	unsigned i, j;
+	for(i = 0; i != tree->numcodes; ++i)
+	{
+		unsigned code = HuffmanTree_getCode(tree, i), length = HuffmanTree_getLength(tree, i), reversed = 0;
+		for(j = 0; j != length; ++j) reversed |= ((code >> j) & 1) << (length - 1 - j);
+		codes[i] = reversed;
+	}
 }
 
 /*search the index in the array, that has the largest value smaller than or equal to the given value,
@@ -1338,48 +1410,54 @@ static void addLengthDistance(uivector* values, size_t length, size_t distance)
 	uivector_push_back(values, extra_distance);
 }
 
-/*3 bytes of data get encoded into two bytes. The hash cannot use more than 3
-bytes as input because 3 is the minimum match length for deflate*/
+/*the first 4 bytes at a position are hashed to 16 bits*/
 static const unsigned HASH_NUM_VALUES = 65536;
 static const unsigned HASH_BIT_MASK = 65535; /*HASH_NUM_VALUES - 1, but C90 does not like that as initializer*/
 
+/*
+What the hash chains keep per circular position (pos & (windowsize - 1)). The fields are together
+so that a step along a chain touches one cache line, rather than one in each of four arrays.
+*/
+typedef struct HashEntry
+{
+	unsigned short chain; /*previous circular pos with the same hash value, itself if none*/
+	unsigned short chainz; /*previous circular pos with the same length of zeros streak, itself if none*/
+	unsigned short zeros; /*length of zeros streak, used as a second hash chain*/
+	unsigned short val; /*hash value of the pos; a chain that gets here with another one is outdated*/
+} HashEntry;
+
 typedef struct Hash
 {
 	int* head; /*hash value to head circular pos - can be outdated if went around window*/
-	/*circular pos to prev circular pos*/
-	unsigned short* chain;
-	int* val; /*circular pos to hash value*/
-
-	/*TODO: do this not only for zeros but for any repeated byte. However for PNG
+	/*similar to head, but for chainz. Allocated together with head.
+	TODO: do this not only for zeros but for any repeated byte. However for PNG
 	it's always going to be the zeros that dominate, so not important for PNG*/
-	int* headz; /*similar to head, but for chainz*/
-	unsigned short* chainz; /*those with same amount of zeros*/
-	unsigned short* zeros; /*length of zeros streak, used as a second hash chain*/
+	int* headz;
+	HashEntry* entries; /*circular pos to its chains*/
 } Hash;
 
 static unsigned hash_init(Hash* hash, unsigned windowsize)
 {
 	unsigned i;
-	hash->head = (int*)lodepng_malloc(sizeof(int) * HASH_NUM_VALUES);
-	hash->val = (int*)lodepng_malloc(sizeof(int) * windowsize);
-	hash->chain = (unsigned short*)lodepng_malloc(sizeof(unsigned short) * windowsize);
+	hash->head = (int*)lodepng_malloc(sizeof(int) * (HASH_NUM_VALUES + MAX_SUPPORTED_DEFLATE_LENGTH + 1));
+	hash->headz = hash->head ? hash->head + HASH_NUM_VALUES : 0;
+	hash->entries = (HashEntry*)lodepng_malloc(sizeof(HashEntry) * windowsize);
 
-	hash->zeros = (unsigned short*)lodepng_malloc(sizeof(unsigned short) * windowsize);
-	hash->headz = (int*)lodepng_malloc(sizeof(int) * (MAX_SUPPORTED_DEFLATE_LENGTH + 1));
-	hash->chainz = (unsigned short*)lodepng_malloc(sizeof(unsigned short) * windowsize);
-
-	if(!hash->head || !hash->chain || !hash->val  || !hash->headz|| !hash->chainz || !hash->zeros)
+	if(!hash->head || !hash->entries)
 	{
 		return 83; /*alloc fail*/
 	}
 
 	/*initialize hash table*/
 	for(i = 0; i != HASH_NUM_VALUES; ++i) hash->head[i] = -1;
-	for(i = 0; i != windowsize; ++i) hash->val[i] = -1;
-	for(i = 0; i != windowsize; ++i) hash->chain[i] = i; /*same value as index indicates uninitialized*/
-
 	for(i = 0; i <= MAX_SUPPORTED_DEFLATE_LENGTH; ++i) hash->headz[i] = -1;
-	for(i = 0; i != windowsize; ++i) hash->chainz[i] = i; /*same value as index indicates uninitialized*/
+	for(i = 0; i != windowsize; ++i)
+	{
+		/*same value as index indicates uninitialized*/
+		hash->entries[i].chain = hash->entries[i].chainz = (unsigned short)i;
+		hash->entries[i].zeros = 0;
+		hash->entries[i].val = 0;
+	}
 
 	return 0;
 }
@@ -1387,35 +1465,32 @@ static unsigned hash_init(Hash* hash, unsigned windowsize)
 static void hash_cleanup(Hash* hash)
 {
 	lodepng_free(hash->head);
-	lodepng_free(hash->val);
-	lodepng_free(hash->chain);
-
-	lodepng_free(hash->zeros);
-	lodepng_free(hash->headz);
-	lodepng_free(hash->chainz);
+	lodepng_free(hash->entries);
 }
 
 
 
+/*
+Multiplicative hash of the 4 bytes at pos: the top 16 bits of the product with 2654435761 (2^32
+divided by the golden ratio) depend on every byte, for about the cost of the old shift and xor
+of 3 bytes. With 4 bytes a chain holds few positions that differ in the fourth, so a search
+compares fewer strings; only matches of exactly 3 bytes, which are worth little, go unfound.
+*/
 static unsigned getHash(const unsigned char* data, size_t size, size_t pos)
 {
-	unsigned result = 0;
-	if(pos + 2 < size)
+	unsigned word = 0;
+	if(pos + 3 < size)
 	{
-		/*A simple shift and xor hash is used. Since the data of PNGs is dominated
-		by zeroes due to the filters, a better hash does not have a significant
-		effect on speed in traversing the chain, and causes more time spend on
-		calculating the hash.*/
-		result ^= (unsigned)(data[pos + 0] << 0u);
-		result ^= (unsigned)(data[pos + 1] << 4u);
-		result ^= (unsigned)(data[pos + 2] << 8u);
-	} else {
-		size_t amount, i;
-		if(pos >= size) return 0;
-		amount = size - pos;
-		for(i = 0; i != amount; ++i) result ^= (unsigned)(data[pos + i] << (i * 8u));
+		word = (unsigned)data[pos + 0] | ((unsigned)data[pos + 1] << 8u)
+			| ((unsigned)data[pos + 2] << 16u) | ((unsigned)data[pos + 3] << 24u);
 	}
-	return result & HASH_BIT_MASK;
+	else
+	{
+		/*the last 3 positions hash what is left*/
+		size_t i;
+		for(i = 0; pos + i < size; ++i) word |= (unsigned)data[pos + i] << (i * 8u);
+	}
+	return ((word * 2654435761u) >> 16) & HASH_BIT_MASK;
 }
 
 static unsigned countZeros(const unsigned char* data, size_t size, size_t pos)
@@ -1429,16 +1504,107 @@ static unsigned countZeros(const unsigned char* data, size_t size, size_t pos)
 	return (unsigned)(data - start);
 }
 
+/*the length of the zeros streak at pos given the one at pos - 1; streaks start at 3 zeros*/
+static unsigned nextZeros(const unsigned char* data, size_t size, size_t pos, unsigned numzeros)
+{
+	/*inside a streak the first numzeros - 1 bytes are known zeros, only the byte after them is new*/
+	if(numzeros > 3) return (pos + numzeros > size || data[pos + numzeros - 1] != 0) ? numzeros - 1 : numzeros;
+	if(pos + 2 >= size || data[pos] != 0 || data[pos + 1] != 0 || data[pos + 2] != 0) return 0;
+	if(numzeros == 0) return countZeros(data, size, pos);
+	if(pos + numzeros > size || data[pos + numzeros - 1] != 0) return numzeros - 1;
+	return numzeros;
+}
+
+/*getHash of pos, where a streak of 4 or more zeros makes the word and so the hash 0*/
+static unsigned getHashZeros(const unsigned char* data, size_t size, size_t pos, unsigned numzeros)
+{
+	return numzeros >= 4 ? 0 : getHash(data, size, pos);
+}
+
 /*wpos = pos & (windowsize - 1)*/
 static void updateHashChain(Hash* hash, size_t wpos, unsigned hashval, unsigned short numzeros)
 {
-	hash->val[wpos] = (int)hashval;
-	if(hash->head[hashval] != -1) hash->chain[wpos] = hash->head[hashval];
-	hash->head[hashval] = wpos;
+	HashEntry* entry = &hash->entries[wpos];
+	entry->val = (unsigned short)hashval;
+	if(hash->head[hashval] != -1) entry->chain = (unsigned short)hash->head[hashval];
+	hash->head[hashval] = (int)wpos;
 
-	hash->zeros[wpos] = numzeros;
-	if(hash->headz[numzeros] != -1) hash->chainz[wpos] = hash->headz[numzeros];
-	hash->headz[numzeros] = wpos;
+	entry->zeros = numzeros;
+	if(hash->headz[numzeros] != -1) entry->chainz = (unsigned short)hash->headz[numzeros];
+	hash->headz[numzeros] = (int)wpos;
+}
+
+/*puts the positions in[pos..end) in the hash chains without encoding them, as if they had been encoded*/
+static void hash_prime(Hash* hash, const unsigned char* in, size_t pos, size_t end, size_t insize, unsigned windowsize)
+{
+	unsigned numzeros = 0;
+	for(; pos < end; ++pos)
+	{
+		numzeros = nextZeros(in, insize, pos, numzeros);
+		updateHashChain(hash, pos & (windowsize - 1), getHashZeros(in, insize, pos, numzeros), numzeros);
+	}
+}
+
+/*length of the match of in[pos..] at offset, at most up to lastptr*/
+static unsigned matchLength(const unsigned char* in, size_t pos, unsigned offset, const unsigned char* lastptr)
+{
+	const unsigned char* foreptr = &in[pos];
+	const unsigned char* backptr = &in[pos - offset];
+	while(foreptr != lastptr && *backptr == *foreptr)
+	{
+		++backptr;
+		++foreptr;
+	}
+	return (unsigned)(foreptr - &in[pos]);
+}
+
+/*
+LZ77 for the fastest levels: greedy, with a single probe per position at the latest earlier
+position with the same hash, so only hash->head is kept up to date and the chains are left alone.
+Positions inside a match are hashed too, which costs little and finds the next match sooner.
+*/
+static unsigned encodeLZ77SingleProbe(uivector* out, Hash* hash,
+									  const unsigned char* in, size_t inpos, size_t insize, unsigned windowsize,
+									  unsigned minmatch)
+{
+	size_t pos;
+	unsigned i;
+	for(pos = inpos; pos < insize; ++pos)
+	{
+		size_t wpos = pos & (windowsize - 1);
+		unsigned hashval = getHash(in, insize, pos);
+		int hashpos = hash->head[hashval];
+		unsigned length = 0, offset = 0;
+		hash->head[hashval] = (int)wpos;
+
+		if(hashpos != -1)
+		{
+			/*a head from before the last window comes out as some other offset in it, which is still
+			a valid place to compare against*/
+			offset = (unsigned)((wpos - (size_t)hashpos) & (windowsize - 1));
+			if(offset != 0 && offset <= pos)
+			{
+				const unsigned char* lastptr = &in[insize < pos + MAX_SUPPORTED_DEFLATE_LENGTH
+					? insize : pos + MAX_SUPPORTED_DEFLATE_LENGTH];
+				length = matchLength(in, pos, offset, lastptr);
+			}
+		}
+
+		if(length < 3 || length < minmatch || (length == 3 && offset > 4096))
+		{
+			if(!uivector_push_back(out, in[pos])) return 83; /*alloc fail*/
+		}
+		else
+		{
+			addLengthDistance(out, length, offset);
+			for(i = 1; i < length; ++i)
+			{
+				++pos;
+				hash->head[getHash(in, insize, pos)] = (int)(pos & (windowsize - 1));
+			}
+		}
+	}
+	return 0;
 }
 
 /*
@@ -1449,15 +1615,19 @@ It uses a hash table technique to let it encode faster. When doing LZ77 encoding
 sliding window (of windowsize) is used, and all past bytes in that window can be used as
 the "dictionary". A brute force search through all possible distances would be slow, and
 this hash technique is one out of several ways to speed this up.
+chainlimit caps the positions tried per search, goodmatch cuts what is left of the chain to a
+quarter once a match that long is found, and singleprobe tries only one position, see
+encodeLZ77SingleProbe.
 */
 static unsigned encodeLZ77(uivector* out, Hash* hash,
 						   const unsigned char* in, size_t inpos, size_t insize, unsigned windowsize,
-						   unsigned minmatch, unsigned nicematch, unsigned lazymatching)
+						   unsigned minmatch, unsigned nicematch, unsigned lazymatching, unsigned chainlimit,
+						   unsigned goodmatch, unsigned singleprobe)
 {
 	size_t pos;
 	unsigned i, error = 0;
 	/*for large window lengths, assume the user wants no compression loss. Otherwise, max hash chain length speedup.*/
-	unsigned maxchainlength = windowsize >= 8192 ? windowsize : windowsize / 8;
+	unsigned maxchainlength = chainlimit ? chainlimit : windowsize >= 8192 ? windowsize : windowsize / 8;
 	unsigned maxlazymatch = windowsize >= 8192 ? MAX_SUPPORTED_DEFLATE_LENGTH : 64;
 
 	unsigned usezeros = 1; /*not sure if setting it to false for windowsize < 8192 is better or worse*/
@@ -1470,30 +1640,24 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
 	unsigned hashval;
 	unsigned current_offset, current_length;
 	unsigned prev_offset;
-	const unsigned char *lastptr, *foreptr, *backptr;
+	const unsigned char *lastptr;
 	unsigned hashpos;
 
 	if(windowsize == 0 || windowsize > 32768) return 60; /*error: windowsize smaller/larger than allowed*/
 	if((windowsize & (windowsize - 1)) != 0) return 90; /*error: must be power of two*/
 
+	if(singleprobe) return encodeLZ77SingleProbe(out, hash, in, inpos, insize, windowsize, minmatch);
+
 	if(nicematch > MAX_SUPPORTED_DEFLATE_LENGTH) nicematch = MAX_SUPPORTED_DEFLATE_LENGTH;
 
 	for(pos = inpos; pos < insize; ++pos)
 	{
 		size_t wpos = pos & (windowsize - 1); /*position for in 'circular' hash buffers*/
 		unsigned chainlength = 0;
+		unsigned chainend = maxchainlength;
 
-		hashval = getHash(in, insize, pos);
-
-		if(usezeros && hashval == 0)
-		{
-			if(numzeros == 0) numzeros = countZeros(in, insize, pos);
-			else if(pos + numzeros > insize || in[pos + numzeros - 1] != 0) --numzeros;
-		}
-		else
-		{
-			numzeros = 0;
-		}
+		numzeros = usezeros ? nextZeros(in, insize, pos, numzeros) : 0;
+		hashval = getHashZeros(in, insize, pos, numzeros);
 
 		updateHashChain(hash, wpos, hashval, numzeros);
 
@@ -1501,7 +1665,7 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
 		length = 0;
 		offset = 0;
 
-		hashpos = hash->chain[wpos];
+		hashpos = hash->entries[wpos].chain;
 
 		lastptr = &in[insize < pos + MAX_SUPPORTED_DEFLATE_LENGTH ? insize : pos + MAX_SUPPORTED_DEFLATE_LENGTH];
 
@@ -1509,32 +1673,22 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
 		prev_offset = 0;
 		for(;;)
 		{
-			if(chainlength++ >= maxchainlength) break;
+			const HashEntry* entry = &hash->entries[hashpos];
+			if(chainlength++ >= chainend) break;
 			current_offset = hashpos <= wpos ? wpos - hashpos : wpos - hashpos + windowsize;
 
 			if(current_offset < prev_offset) break; /*stop when went completely around the circular buffer*/
 			prev_offset = current_offset;
 			if(current_offset > 0)
 			{
-				/*test the next characters*/
-				foreptr = &in[pos];
-				backptr = &in[pos - current_offset];
-
 				/*common case in PNGs is lots of zeros. Quickly skip over them as a speedup*/
+				unsigned skip = 0;
 				if(numzeros >= 3)
 				{
-					unsigned skip = hash->zeros[hashpos];
+					skip = entry->zeros;
 					if(skip > numzeros) skip = numzeros;
-					backptr += skip;
-					foreptr += skip;
 				}
-
-				while(foreptr != lastptr && *backptr == *foreptr) /*maximum supported length by deflate is max length*/
-				{
-					++backptr;
-					++foreptr;
-				}
-				current_length = (unsigned)(foreptr - &in[pos]);
+				current_length = skip + matchLength(in, pos + skip, current_offset, lastptr);
 
 				if(current_length > length)
 				{
@@ -1543,21 +1697,26 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
 					/*jump out once a length of max length is found (speed gain). This also jumps
 					out if length is MAX_SUPPORTED_DEFLATE_LENGTH*/
 					if(current_length >= nicematch) break;
+					/*good enough to search only a quarter of the rest of the chain*/
+					if(goodmatch && current_length >= goodmatch && chainend == maxchainlength)
+					{
+						chainend = chainlength + (maxchainlength - chainlength) / 4;
+					}
 				}
 			}
 
-			if(hashpos == hash->chain[hashpos]) break;
+			if(hashpos == entry->chain) break;
 
 			if(numzeros >= 3 && length > numzeros)
 			{
-				hashpos = hash->chainz[hashpos];
-				if(hash->zeros[hashpos] != numzeros) break;
+				hashpos = entry->chainz;
+				if(hash->entries[hashpos].zeros != numzeros) break;
 			}
 			else
 			{
-				hashpos = hash->chain[hashpos];
+				hashpos = entry->chain;
 				/*outdated hash value, happens if particular value was not encountered in whole last window*/
-				if(hash->val[hashpos] != (int)hashval) break;
+				if(hash->entries[hashpos].val != hashval) break;
 			}
 		}
 
@@ -1609,16 +1768,8 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
 			{
 				++pos;
 				wpos = pos & (windowsize - 1);
-				hashval = getHash(in, insize, pos);
-				if(usezeros && hashval == 0)
-				{
-					if(numzeros == 0) numzeros = countZeros(in, insize, pos);
-					else if(pos + numzeros > insize || in[pos + numzeros - 1] != 0) --numzeros;
-				}
-				else
-				{
-					numzeros = 0;
-				}
+				numzeros = usezeros ? nextZeros(in, insize, pos, numzeros) : 0;
+				hashval = getHashZeros(in, insize, pos, numzeros);
 				updateHashChain(hash, wpos, hashval, numzeros);
 			}
 		}
@@ -1629,7 +1780,7 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
 
 /* /////////////////////////////////////////////////////////////////////////// */
 
-static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize)
+static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize, unsigned final)
 {
 	/*non compressed deflate block data: 1 bit BFINAL,2 bits BTYPE,(5 bits): it jumps to start of next byte,
 	2 bytes LEN, 2 bytes NLEN, LEN bytes literal DATA*/
@@ -1641,7 +1792,7 @@ static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, s
 		unsigned BFINAL, BTYPE, LEN, NLEN;
 		unsigned char firstbyte;
 
-		BFINAL = (i == numdeflateblocks - 1);
+		BFINAL = final && (i == numdeflateblocks - 1);
 		BTYPE = 0;
 
 		firstbyte = (unsigned char)(BFINAL + ((BTYPE & 1) << 1) + ((BTYPE & 2) << 1));
@@ -1668,34 +1819,35 @@ static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, s
 
 /*
 write the lz77-encoded data, which has lit, len and dist codes, to compressed stream using huffman trees.
-tree_ll: the tree for lit and len codes.
-tree_d: the tree for distance codes.
+codes_ll, lengths_ll: the stream codes (see getStreamCodes) and lengths of the lit and len codes.
+codes_d, lengths_d: the same for the distance codes.
 */
-static void writeLZ77data(size_t* bp, ucvector* out, const uivector* lz77_encoded,
-						  const HuffmanTree* tree_ll, const HuffmanTree* tree_d)
+static void writeLZ77data(BitWriter* writer, const uivector* lz77_encoded,
+						  const unsigned* codes_ll, const unsigned* lengths_ll,
+						  const unsigned* codes_d, const unsigned* lengths_d)
 {
 	size_t i = 0;
+	/*a literal is at most 15 bits, a length/distance pair of 4 values at most 48*/
+	bitwriter_reserve(writer, lz77_encoded->size * 2);
 	for(i = 0; i != lz77_encoded->size; ++i)
 	{
 		unsigned val = lz77_encoded->data[i];
-		addHuffmanSymbol(bp, out, HuffmanTree_getCode(tree_ll, val), HuffmanTree_getLength(tree_ll, val));
 		if(val > 256) /*for a length code, 3 more things have to be added*/
 		{
-			unsigned length_index = val - FIRST_LENGTH_CODE_INDEX;
-			unsigned n_length_extra_bits = LENGTHEXTRA[length_index];
-			unsigned length_extra_bits = lz77_encoded->data[++i];
-
-			unsigned distance_code = lz77_encoded->data[++i];
+			unsigned n_length_extra_bits = LENGTHEXTRA[val - FIRST_LENGTH_CODE_INDEX];
+			unsigned length_extra_bits = lz77_encoded->data[i + 1];
+			unsigned distance_code = lz77_encoded->data[i + 2];
+			unsigned n_distance_extra_bits = DISTANCEEXTRA[distance_code];
+			unsigned distance_extra_bits = lz77_encoded->data[i + 3];
+			i += 3;
 
-			unsigned distance_index = distance_code;
-			unsigned n_distance_extra_bits = DISTANCEEXTRA[distance_index];
-			unsigned distance_extra_bits = lz77_encoded->data[++i];
-
-			addBitsToStream(bp, out, length_extra_bits, n_length_extra_bits);
-			addHuffmanSymbol(bp, out, HuffmanTree_getCode(tree_d, distance_code),
-				HuffmanTree_getLength(tree_d, distance_code));
-			addBitsToStream(bp, out, distance_extra_bits, n_distance_extra_bits);
+			/*the length code with its extra bits (at most 20 bits), then the same for the distance (28)*/
+			bitwriter_put(writer, codes_ll[val] | (length_extra_bits << lengths_ll[val]),
+				lengths_ll[val] + n_length_extra_bits);
+			bitwriter_put(writer, codes_d[distance_code] | (distance_extra_bits << lengths_d[distance_code]),
+				lengths_d[distance_code] + n_distance_extra_bits);
 		}
+		else bitwriter_put(writer, codes_ll[val], lengths_ll[val]);
 	}
 }
 
@@ -1705,6 +1857,8 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
 							   const LodePNGCompressSettings* settings, unsigned final)
 {
 	unsigned error = 0;
+	BitWriter writer;
+	unsigned codes_ll[288], codes_d[32], codes_cl[NUM_CODE_LENGTH_CODES]; /*stream codes of the trees*/
 
 	/*
 	A block is compressed as follows: The PNG data is lz77 encoded, resulting in
@@ -1762,7 +1916,8 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
 		if(settings->use_lz77)
 		{
 			error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-				settings->minmatch, settings->nicematch, settings->lazymatching);
+				settings->minmatch, settings->nicematch, settings->lazymatching, settings->maxchainlength,
+				settings->goodmatch, settings->singleprobe);
 			if(error) break;
 		}
 		else
@@ -1890,10 +2045,14 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
 		- 256 (end code)
 		*/
 
+		getStreamCodes(codes_ll, &tree_ll);
+		getStreamCodes(codes_d, &tree_d);
+		getStreamCodes(codes_cl, &tree_cl);
+		bitwriter_init(&writer, out, *bp);
+
 		/*Write block type*/
-		addBitToStream(bp, out, BFINAL);
-		addBitToStream(bp, out, 0); /*first bit of BTYPE "dynamic"*/
-		addBitToStream(bp, out, 1); /*second bit of BTYPE "dynamic"*/
+		bitwriter_put(&writer, BFINAL, 1);
+		bitwriter_put(&writer, 2, 2); /*BTYPE "dynamic", the first bit 0 and the second 1*/
 
 		/*write the HLIT, HDIST and HCLEN values*/
 		HLIT = (unsigned)(numcodes_ll - 257);
@@ -1901,31 +2060,36 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
 		HCLEN = (unsigned)bitlen_cl.size - 4;
 		/*trim zeroes for HCLEN. HLIT and HDIST were already trimmed at tree creation*/
 		while(!bitlen_cl.data[HCLEN + 4 - 1] && HCLEN > 0) --HCLEN;
-		addBitsToStream(bp, out, HLIT, 5);
-		addBitsToStream(bp, out, HDIST, 5);
-		addBitsToStream(bp, out, HCLEN, 4);
+		bitwriter_put(&writer, HLIT, 5);
+		bitwriter_put(&writer, HDIST, 5);
+		bitwriter_put(&writer, HCLEN, 4);
 
 		/*write the code lenghts of the code length alphabet*/
-		for(i = 0; i != HCLEN + 4; ++i) addBitsToStream(bp, out, bitlen_cl.data[i], 3);
+		for(i = 0; i != HCLEN + 4; ++i) bitwriter_put(&writer, bitlen_cl.data[i], 3);
 
 		/*write the lenghts of the lit/len AND the dist alphabet*/
 		for(i = 0; i != bitlen_lld_e.size; ++i)
 		{
-			addHuffmanSymbol(bp, out, HuffmanTree_getCode(&tree_cl, bitlen_lld_e.data[i]),
-				HuffmanTree_getLength(&tree_cl, bitlen_lld_e.data[i]));
+			unsigned symbol = bitlen_lld_e.data[i];
+			bitwriter_put(&writer, codes_cl[symbol], tree_cl.lengths[symbol]);
 			/*extra bits of repeat codes*/
-			if(bitlen_lld_e.data[i] == 16) addBitsToStream(bp, out, bitlen_lld_e.data[++i], 2);
-			else if(bitlen_lld_e.data[i] == 17) addBitsToStream(bp, out, bitlen_lld_e.data[++i], 3);
-			else if(bitlen_lld_e.data[i] == 18) addBitsToStream(bp, out, bitlen_lld_e.data[++i], 7);
+			if(symbol == 16) bitwriter_put(&writer, bitlen_lld_e.data[++i], 2);
+			else if(symbol == 17) bitwriter_put(&writer, bitlen_lld_e.data[++i], 3);
+			else if(symbol == 18) bitwriter_put(&writer, bitlen_lld_e.data[++i], 7);
 		}
 
 		/*write the compressed data symbols*/
-		writeLZ77data(bp, out, &lz77_encoded, &tree_ll, &tree_d);
+		writeLZ77data(&writer, &lz77_encoded, codes_ll, tree_ll.lengths, codes_d, tree_d.lengths);
 		/*error: the length of the end code 256 must be larger than 0*/
-		if(HuffmanTree_getLength(&tree_ll, 256) == 0) ERROR_BREAK(64);
+		if(HuffmanTree_getLength(&tree_ll, 256) == 0)
+		{
+			bitwriter_finish(&writer, bp);
+			ERROR_BREAK(64);
+		}
 
 		/*write the end code*/
-		addHuffmanSymbol(bp, out, HuffmanTree_getCode(&tree_ll, 256), HuffmanTree_getLength(&tree_ll, 256));
+		bitwriter_put(&writer, codes_ll[256], tree_ll.lengths[256]);
+		error = bitwriter_finish(&writer, bp);
 
 		break; /*end of error-while*/
 	}
@@ -1952,9 +2116,11 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
 {
 	HuffmanTree tree_ll; /*tree for literal values and length codes*/
 	HuffmanTree tree_d; /*tree for distance codes*/
+	unsigned codes_ll[288], codes_d[32]; /*stream codes of the trees*/
+	BitWriter writer;
 
 	unsigned BFINAL = final;
-	unsigned error = 0;
+	unsigned error = 0, writeerror;
 	size_t i;
 
 	HuffmanTree_init(&tree_ll);
@@ -1962,29 +2128,32 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
 
 	generateFixedLitLenTree(&tree_ll);
 	generateFixedDistanceTree(&tree_d);
+	getStreamCodes(codes_ll, &tree_ll);
+	getStreamCodes(codes_d, &tree_d);
 
-	addBitToStream(bp, out, BFINAL);
-	addBitToStream(bp, out, 1); /*first bit of BTYPE*/
-	addBitToStream(bp, out, 0); /*second bit of BTYPE*/
+	bitwriter_init(&writer, out, *bp);
+	bitwriter_put(&writer, BFINAL, 1);
+	bitwriter_put(&writer, 1, 2); /*BTYPE "fixed", the first bit 1 and the second 0*/
 
 	if(settings->use_lz77) /*LZ77 encoded*/
 	{
 		uivector lz77_encoded;
 		uivector_init(&lz77_encoded);
 		error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-			settings->minmatch, settings->nicematch, settings->lazymatching);
-		if(!error) writeLZ77data(bp, out, &lz77_encoded, &tree_ll, &tree_d);
+			settings->minmatch, settings->nicematch, settings->lazymatching, settings->maxchainlength,
+			settings->goodmatch, settings->singleprobe);
+		if(!error) writeLZ77data(&writer, &lz77_encoded, codes_ll, tree_ll.lengths, codes_d, tree_d.lengths);
 		uivector_cleanup(&lz77_encoded);
 	}
 	else /*no LZ77, but still will be Huffman compressed*/
 	{
-		for(i = datapos; i < dataend; ++i)
-		{
-			addHuffmanSymbol(bp, out, HuffmanTree_getCode(&tree_ll, data[i]), HuffmanTree_getLength(&tree_ll, data[i]));
-		}
+		bitwriter_reserve(&writer, (dataend - datapos) * 9 / 8);
+		for(i = datapos; i < dataend; ++i) bitwriter_put(&writer, codes_ll[data[i]], tree_ll.lengths[data[i]]);
 	}
 	/*add END code*/
-	if(!error) addHuffmanSymbol(bp, out, HuffmanTree_getCode(&tree_ll, 256), HuffmanTree_getLength(&tree_ll, 256));
+	if(!error) bitwriter_put(&writer, codes_ll[256], tree_ll.lengths[256]);
+	writeerror = bitwriter_finish(&writer, bp);
+	if(!error) error = writeerror;
 
 	/*cleanup*/
 	HuffmanTree_cleanup(&tree_ll);
@@ -2002,7 +2171,7 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
 	Hash hash;
 
 	if(settings->btype > 2) return 61;
-	else if(settings->btype == 0) return deflateNoCompression(out, in, insize);
+	else if(settings->btype == 0) return deflateNoCompression(out, in, insize, 1);
 	else if(settings->btype == 1) blocksize = insize;
 	else /*if(settings->btype == 2)*/
 	{
@@ -2047,6 +2216,76 @@ unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
 	return error;
 }
 
+unsigned lodepng_deflate_segment(unsigned char** out, size_t* outsize,
+								 const unsigned char* in, size_t start, size_t end, unsigned final,
+								 const LodePNGCompressSettings* settings)
+{
+	unsigned error = 0;
+	size_t i, blocksize, numdeflateblocks;
+	size_t bp = 0; /*the bit pointer*/
+	size_t insize = end - start;
+	Hash hash;
+	ucvector v;
+
+	if(settings->btype > 2) return 61;
+	if(start > end) return 95; /*error: segment ends before it starts*/
+	ucvector_init_buffer(&v, *out, *outsize);
+
+	if(settings->btype == 0)
+	{
+		/*stored blocks end on a byte boundary by themselves*/
+		error = deflateNoCompression(&v, &in[start], insize, final);
+		*out = v.data;
+		*outsize = v.size;
+		return error;
+	}
+
+	/*the same blocks as lodepng_deflatev would make of the segment on its own*/
+	if(settings->btype == 1) blocksize = insize;
+	else
+	{
+		blocksize = insize / 8 + 8;
+		if(blocksize < 65536) blocksize = 65536;
+		if(blocksize > 262144) blocksize = 262144;
+	}
+	numdeflateblocks = (insize + blocksize - 1) / blocksize;
+	if(numdeflateblocks == 0) numdeflateblocks = 1;
+
+	error = hash_init(&hash, settings->windowsize);
+	if(!error)
+	{
+		/*the window before the segment is the dictionary*/
+		size_t dictstart = start > settings->windowsize ? start - settings->windowsize : 0;
+		hash_prime(&hash, in, dictstart, start, end, settings->windowsize);
+	}
+
+	for(i = 0; i != numdeflateblocks && !error; ++i)
+	{
+		unsigned blockfinal = final && (i == numdeflateblocks - 1);
+		size_t blockstart = start + i * blocksize;
+		size_t blockend = blockstart + blocksize;
+		if(blockend > end) blockend = end;
+
+		if(settings->btype == 1) error = deflateFixed(&v, &bp, &hash, in, blockstart, blockend, settings, blockfinal);
+		else error = deflateDynamic(&v, &bp, &hash, in, blockstart, blockend, settings, blockfinal);
+	}
+
+	if(!error && !final)
+	{
+		/*sync flush: an empty stored block brings the stream to a byte boundary*/
+		addBitsToStream(&bp, &v, 0, 3);
+		ucvector_push_back(&v, 0);
+		ucvector_push_back(&v, 0);
+		ucvector_push_back(&v, 255);
+		ucvector_push_back(&v, 255);
+	}
+
+	hash_cleanup(&hash);
+	*out = v.data;
+	*outsize = v.size;
+	return error;
+}
+
 static unsigned deflate(unsigned char** out, size_t* outsize,
 						const unsigned char* in, size_t insize,
 						const LodePNGCompressSettings* settings)
@@ -2096,6 +2335,32 @@ static unsigned adler32(const unsigned char* data, unsigned len)
 	return update_adler32(1L, data, len);
 }
 
+#ifdef LODEPNG_COMPILE_ENCODER
+unsigned lodepng_adler32(const unsigned char* data, size_t len)
+{
+	unsigned adler = 1;
+	/*update_adler32 takes at most 4 GB at a time*/
+	while(len > 0)
+	{
+		unsigned amount = len > 0x40000000 ? 0x40000000 : (unsigned)len;
+		adler = update_adler32(adler, data, amount);
+		data += amount;
+		len -= amount;
+	}
+	return adler;
+}
+
+unsigned lodepng_adler32_combine(unsigned adler1, unsigned adler2, size_t len2)
+{
+	/*the first sum just adds up; every byte of the second part also counted s1 of the first once more*/
+	unsigned rem = (unsigned)(len2 % 65521);
+	unsigned s1 = ((adler1 & 0xffff) + (adler2 & 0xffff) + 65521 - 1) % 65521;
+	unsigned s2 = (unsigned)(((unsigned long long)rem * (adler1 & 0xffff) + ((adler1 >> 16) & 0xffff)
+		+ ((adler2 >> 16) & 0xffff) + 65521 - rem) % 65521);
+	return (s2 << 16) | s1;
+}
+#endif /*LODEPNG_COMPILE_ENCODER*/
+
 /* ////////////////////////////////////////////////////////////////////////// */
 /* / Zlib                                                                   / */
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -2258,13 +2523,16 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings)
 	settings->minmatch = 3;
 	settings->nicematch = 128;
 	settings->lazymatching = 1;
+	settings->maxchainlength = 0;
+	settings->goodmatch = 0;
+	settings->singleprobe = 0;
 
 	settings->custom_zlib = 0;
 	settings->custom_deflate = 0;
 	settings->custom_context = 0;
 }
 
-const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0};
+const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0, 0, 0, 0};
 
 
 #endif /*LODEPNG_COMPILE_ENCODER*/
@@ -5067,62 +5335,417 @@ static unsigned addChunk_pHYs(ucvector* out, const LodePNGInfo* info)
 
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-static void filterScanline(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
-						   size_t length, size_t bytewidth, unsigned char filterType)
+/*
+Filters bytes [start, end) of a scanline. This is the reference every SIMD kernel below has to
+match byte for byte; the kernels only take over the middle of the row.
+*/
+static void filterScanlineRange(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+								size_t start, size_t end, size_t bytewidth, unsigned char filterType)
 {
 	size_t i;
+	/*the first pixel has nothing to its left*/
+	size_t first = bytewidth < end ? bytewidth : end;
+	size_t rest = start > bytewidth ? start : bytewidth;
 	switch(filterType)
 	{
 	case 0: /*None*/
-		for(i = 0; i != length; ++i) out[i] = scanline[i];
+		for(i = start; i < end; ++i) out[i] = scanline[i];
 		break;
 	case 1: /*Sub*/
-		for(i = 0; i != bytewidth; ++i) out[i] = scanline[i];
-		for(i = bytewidth; i < length; ++i) out[i] = scanline[i] - scanline[i - bytewidth];
+		for(i = start; i < first; ++i) out[i] = scanline[i];
+		for(i = rest; i < end; ++i) out[i] = scanline[i] - scanline[i - bytewidth];
 		break;
 	case 2: /*Up*/
 		if(prevline)
 		{
-			for(i = 0; i != length; ++i) out[i] = scanline[i] - prevline[i];
+			for(i = start; i < end; ++i) out[i] = scanline[i] - prevline[i];
 		}
 		else
 		{
-			for(i = 0; i != length; ++i) out[i] = scanline[i];
+			for(i = start; i < end; ++i) out[i] = scanline[i];
 		}
 		break;
 	case 3: /*Average*/
 		if(prevline)
 		{
-			for(i = 0; i != bytewidth; ++i) out[i] = scanline[i] - prevline[i] / 2;
-			for(i = bytewidth; i < length; ++i) out[i] = scanline[i] - ((scanline[i - bytewidth] + prevline[i]) / 2);
+			for(i = start; i < first; ++i) out[i] = scanline[i] - prevline[i] / 2;
+			for(i = rest; i < end; ++i) out[i] = scanline[i] - ((scanline[i - bytewidth] + prevline[i]) / 2);
 		}
 		else
 		{
-			for(i = 0; i != bytewidth; ++i) out[i] = scanline[i];
-			for(i = bytewidth; i < length; ++i) out[i] = scanline[i] - scanline[i - bytewidth] / 2;
+			for(i = start; i < first; ++i) out[i] = scanline[i];
+			for(i = rest; i < end; ++i) out[i] = scanline[i] - scanline[i - bytewidth] / 2;
 		}
 		break;
 	case 4: /*Paeth*/
 		if(prevline)
 		{
 			/*paethPredictor(0, prevline[i], 0) is always prevline[i]*/
-			for(i = 0; i != bytewidth; ++i) out[i] = (scanline[i] - prevline[i]);
-			for(i = bytewidth; i < length; ++i)
+			for(i = start; i < first; ++i) out[i] = (scanline[i] - prevline[i]);
+			for(i = rest; i < end; ++i)
 			{
 				out[i] = (scanline[i] - paethPredictor(scanline[i - bytewidth], prevline[i], prevline[i - bytewidth]));
 			}
 		}
 		else
 		{
-			for(i = 0; i != bytewidth; ++i) out[i] = scanline[i];
+			for(i = start; i < first; ++i) out[i] = scanline[i];
 			/*paethPredictor(scanline[i - bytewidth], 0, 0) is always scanline[i - bytewidth]*/
-			for(i = bytewidth; i < length; ++i) out[i] = (scanline[i] - scanline[i - bytewidth]);
+			for(i = rest; i < end; ++i) out[i] = (scanline[i] - scanline[i - bytewidth]);
 		}
 		break;
 	default: return; /*unexisting filter type given*/
 	}
 }
 
+void lodepng_filter_scanline_scalar(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+									size_t length, size_t bytewidth, unsigned char filterType)
+{
+	filterScanlineRange(out, scanline, prevline, 0, length, bytewidth, filterType);
+}
+
+/*
+Adds the cost of bytes [start, end) of a scanline under each filter type to sum, the cost of the
+minimum sum heuristic: bytes as they are for filter type 0, and for the differences of the other
+types the distance to 0 of the byte read as signed.
+*/
+static void filterSumsRange(size_t sum[5], const unsigned char* scanline, const unsigned char* prevline,
+							size_t start, size_t end, size_t bytewidth)
+{
+	size_t i;
+	for(i = start; i < end; ++i)
+	{
+		/*the bytes left, above and above left, zero outside the image like filterScanlineRange has them*/
+		unsigned char a = i >= bytewidth ? scanline[i - bytewidth] : 0;
+		unsigned char b = prevline ? prevline[i] : 0;
+		unsigned char c = prevline && i >= bytewidth ? prevline[i - bytewidth] : 0;
+		unsigned char f[4];
+		unsigned type;
+		f[0] = scanline[i] - a;
+		f[1] = scanline[i] - b;
+		f[2] = scanline[i] - (a + b) / 2;
+		f[3] = scanline[i] - paethPredictor(a, b, c);
+		sum[0] += scanline[i];
+		for(type = 0; type != 4; ++type) sum[type + 1] += f[type] < 128 ? f[type] : (255U - f[type]);
+	}
+}
+
+void lodepng_filter_sums_scalar(size_t sum[5], const unsigned char* scanline, const unsigned char* prevline,
+								size_t length, size_t bytewidth)
+{
+	unsigned char type;
+	for(type = 0; type != 5; ++type) sum[type] = 0;
+	filterSumsRange(sum, scanline, prevline, 0, length, bytewidth);
+}
+
+/*
+SIMD filter kernels, picked once at runtime. Encoding filters only read the unfiltered scanlines,
+so every byte is independent of the others and the filters vectorize directly; only Paeth needs
+16-bit lanes for its a + b - 2c term. A kernel filters from start, which is at least bytewidth,
+as far as whole vectors go and returns where it stopped; filterScanlineRange does the rest.
+The sums kernels do the same for the minimum sum heuristic, adding to sum what filterSumsRange
+would.
+*/
+typedef size_t (*FilterKernel)(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+							   size_t start, size_t length, size_t bytewidth, unsigned char filterType);
+typedef size_t (*FilterSumsKernel)(size_t* sum, const unsigned char* scanline, const unsigned char* prevline,
+								   size_t start, size_t length, size_t bytewidth);
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LODEPNG_FILTER_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif /*_MSC_VER*/
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define LODEPNG_TARGET(isa) __attribute__((target(isa)))
+#else /*__GNUC__*/
+#define LODEPNG_TARGET(isa)
+#endif /*__GNUC__*/
+
+/*Paeth predictor of 8 bytes in 16-bit lanes, with paethPredictor's tie breaking*/
+LODEPNG_TARGET("sse2") static __m128i paethSSE2(__m128i a, __m128i b, __m128i c)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i pa = _mm_sub_epi16(b, c);
+	__m128i pb = _mm_sub_epi16(a, c);
+	__m128i pc = _mm_add_epi16(pa, pb);
+	__m128i usec, useb, p;
+	pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+	pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+	pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+	usec = _mm_and_si128(_mm_cmplt_epi16(pc, pa), _mm_cmplt_epi16(pc, pb));
+	useb = _mm_cmplt_epi16(pb, pa);
+	p = _mm_or_si128(_mm_andnot_si128(useb, a), _mm_and_si128(useb, b));
+	return _mm_or_si128(_mm_andnot_si128(usec, p), _mm_and_si128(usec, c));
+}
+
+/*
+Filters 16 bytes x given the bytes left, above and above left of them. Without a previous line
+up and upleft are zero, which makes Average and Paeth come out as in filterScanlineRange.
+*/
+LODEPNG_TARGET("sse2") static __m128i filterSSE2(unsigned char filterType, __m128i x, __m128i left, __m128i up,
+												 __m128i upleft)
+{
+	__m128i zero = _mm_setzero_si128();
+	switch(filterType)
+	{
+	case 1: return _mm_sub_epi8(x, left);
+	case 2: return _mm_sub_epi8(x, up);
+	case 3:
+		/*_mm_avg_epu8 rounds up, the filter rounds down*/
+		return _mm_sub_epi8(x, _mm_sub_epi8(_mm_avg_epu8(left, up),
+			_mm_and_si128(_mm_xor_si128(left, up), _mm_set1_epi8(1))));
+	case 4:
+		return _mm_sub_epi8(x, _mm_packus_epi16(
+			paethSSE2(_mm_unpacklo_epi8(left, zero), _mm_unpacklo_epi8(up, zero), _mm_unpacklo_epi8(upleft, zero)),
+			paethSSE2(_mm_unpackhi_epi8(left, zero), _mm_unpackhi_epi8(up, zero), _mm_unpackhi_epi8(upleft, zero))));
+	default: return x;
+	}
+}
+
+LODEPNG_TARGET("sse2") static size_t filterKernelSSE2(unsigned char* out, const unsigned char* scanline,
+													 const unsigned char* prevline, size_t start, size_t length,
+													 size_t bytewidth, unsigned char filterType)
+{
+	size_t i = start;
+	__m128i zero = _mm_setzero_si128();
+	if(filterType > 4) return start;
+	for(; i + 16 <= length; i += 16)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)&scanline[i]);
+		__m128i left = _mm_loadu_si128((const __m128i*)&scanline[i - bytewidth]);
+		__m128i up = prevline ? _mm_loadu_si128((const __m128i*)&prevline[i]) : zero;
+		__m128i upleft = prevline ? _mm_loadu_si128((const __m128i*)&prevline[i - bytewidth]) : zero;
+		_mm_storeu_si128((__m128i*)&out[i], filterSSE2(filterType, x, left, up, upleft));
+	}
+	return i;
+}
+
+/*
+Sums all five filters in one pass. A filtered byte f costs f < 128 ? f : 255 - f, which is f
+xored with its sign; psadbw against zero then adds up 8 costs at a time into 64 bits.
+*/
+LODEPNG_TARGET("sse2") static size_t filterSumsKernelSSE2(size_t* sum, const unsigned char* scanline,
+														 const unsigned char* prevline, size_t start, size_t length,
+														 size_t bytewidth)
+{
+	size_t i = start;
+	unsigned char type;
+	__m128i zero = _mm_setzero_si128();
+	__m128i acc[5];
+	for(type = 0; type != 5; ++type) acc[type] = zero;
+	for(; i + 16 <= length; i += 16)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)&scanline[i]);
+		__m128i left = _mm_loadu_si128((const __m128i*)&scanline[i - bytewidth]);
+		__m128i up = prevline ? _mm_loadu_si128((const __m128i*)&prevline[i]) : zero;
+		__m128i upleft = prevline ? _mm_loadu_si128((const __m128i*)&prevline[i - bytewidth]) : zero;
+		acc[0] = _mm_add_epi64(acc[0], _mm_sad_epu8(x, zero));
+		for(type = 1; type != 5; ++type)
+		{
+			__m128i f = filterSSE2(type, x, left, up, upleft);
+			f = _mm_xor_si128(f, _mm_cmplt_epi8(f, zero));
+			acc[type] = _mm_add_epi64(acc[type], _mm_sad_epu8(f, zero));
+		}
+	}
+	for(type = 0; type != 5; ++type)
+	{
+		unsigned long long lanes[2];
+		_mm_storeu_si128((__m128i*)lanes, acc[type]);
+		sum[type] += (size_t)(lanes[0] + lanes[1]);
+	}
+	return i;
+}
+
+/*Paeth predictor of 16 bytes in 16-bit lanes*/
+LODEPNG_TARGET("avx2") static __m256i paethAVX2(__m256i a, __m256i b, __m256i c)
+{
+	__m256i pa = _mm256_sub_epi16(b, c);
+	__m256i pb = _mm256_sub_epi16(a, c);
+	__m256i pc = _mm256_abs_epi16(_mm256_add_epi16(pa, pb));
+	__m256i usec, useb;
+	pa = _mm256_abs_epi16(pa);
+	pb = _mm256_abs_epi16(pb);
+	usec = _mm256_and_si256(_mm256_cmpgt_epi16(pa, pc), _mm256_cmpgt_epi16(pb, pc));
+	useb = _mm256_cmpgt_epi16(pa, pb);
+	return _mm256_blendv_epi8(_mm256_blendv_epi8(a, b, useb), c, usec);
+}
+
+/*filterSSE2 for 32 bytes*/
+LODEPNG_TARGET("avx2") static __m256i filterAVX2(unsigned char filterType, __m256i x, __m256i left, __m256i up,
+												 __m256i upleft)
+{
+	__m256i lo, hi;
+	switch(filterType)
+	{
+	case 1: return _mm256_sub_epi8(x, left);
+	case 2: return _mm256_sub_epi8(x, up);
+	case 3:
+		return _mm256_sub_epi8(x, _mm256_sub_epi8(_mm256_avg_epu8(left, up),
+			_mm256_and_si256(_mm256_xor_si256(left, up), _mm256_set1_epi8(1))));
+	case 4:
+		lo = paethAVX2(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(left)),
+			_mm256_cvtepu8_epi16(_mm256_castsi256_si128(up)), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(upleft)));
+		hi = paethAVX2(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(left, 1)),
+			_mm256_cvtepu8_epi16(_mm256_extracti128_si256(up, 1)), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(upleft, 1)));
+		/*packus works within 128-bit lanes, the permute puts the halves back in order*/
+		return _mm256_sub_epi8(x, _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8));
+	default: return x;
+	}
+}
+
+LODEPNG_TARGET("avx2") static size_t filterKernelAVX2(unsigned char* out, const unsigned char* scanline,
+													 const unsigned char* prevline, size_t start, size_t length,
+													 size_t bytewidth, unsigned char filterType)
+{
+	size_t i = start;
+	__m256i zero = _mm256_setzero_si256();
+	if(filterType > 4) return start;
+	for(; i + 32 <= length; i += 32)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i*)&scanline[i]);
+		__m256i left = _mm256_loadu_si256((const __m256i*)&scanline[i - bytewidth]);
+		__m256i up = prevline ? _mm256_loadu_si256((const __m256i*)&prevline[i]) : zero;
+		__m256i upleft = prevline ? _mm256_loadu_si256((const __m256i*)&prevline[i - bytewidth]) : zero;
+		_mm256_storeu_si256((__m256i*)&out[i], filterAVX2(filterType, x, left, up, upleft));
+	}
+	return i;
+}
+
+LODEPNG_TARGET("avx2") static size_t filterSumsKernelAVX2(size_t* sum, const unsigned char* scanline,
+														 const unsigned char* prevline, size_t start, size_t length,
+														 size_t bytewidth)
+{
+	size_t i = start;
+	unsigned char type;
+	__m256i zero = _mm256_setzero_si256();
+	__m256i acc[5];
+	for(type = 0; type != 5; ++type) acc[type] = zero;
+	for(; i + 32 <= length; i += 32)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i*)&scanline[i]);
+		__m256i left = _mm256_loadu_si256((const __m256i*)&scanline[i - bytewidth]);
+		__m256i up = prevline ? _mm256_loadu_si256((const __m256i*)&prevline[i]) : zero;
+		__m256i upleft = prevline ? _mm256_loadu_si256((const __m256i*)&prevline[i - bytewidth]) : zero;
+		acc[0] = _mm256_add_epi64(acc[0], _mm256_sad_epu8(x, zero));
+		for(type = 1; type != 5; ++type)
+		{
+			__m256i f = filterAVX2(type, x, left, up, upleft);
+			f = _mm256_xor_si256(f, _mm256_cmpgt_epi8(zero, f));
+			acc[type] = _mm256_add_epi64(acc[type], _mm256_sad_epu8(f, zero));
+		}
+	}
+	for(type = 0; type != 5; ++type)
+	{
+		unsigned long long lanes[4];
+		_mm256_storeu_si256((__m256i*)lanes, acc[type]);
+		sum[type] += (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+	}
+	return i;
+}
+
+static int hasAVX2(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if(info[0] < 7) return 0;
+	/*the OS has to save the YMM registers too, not just the CPU support them*/
+	__cpuid(info, 1);
+	if((info[2] & ((1 << 27) | (1 << 28))) != ((1 << 27) | (1 << 28))) return 0;
+	if((_xgetbv(0) & 6) != 6) return 0;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else /*_MSC_VER*/
+	return __builtin_cpu_supports("avx2");
+#endif /*_MSC_VER*/
+}
+
+static int hasSSE2(void)
+{
+#if defined(_M_X64) || defined(__x86_64__)
+	return 1;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+#else
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+#endif /*LODEPNG_FILTER_X86*/
+
+/*selected on first use; threads racing on them all store the same values*/
+static FilterKernel filterKernel = 0;
+static FilterSumsKernel filterSumsKernel = 0;
+static const char* filterKernelName = 0;
+
+static void selectFilterKernel(void)
+{
+	FilterKernel kernel = 0;
+	FilterSumsKernel sumsKernel = 0;
+	const char* name = "scalar";
+#ifdef LODEPNG_FILTER_X86
+	if(hasAVX2())
+	{
+		kernel = filterKernelAVX2;
+		sumsKernel = filterSumsKernelAVX2;
+		name = "AVX2";
+	}
+	else if(hasSSE2())
+	{
+		kernel = filterKernelSSE2;
+		sumsKernel = filterSumsKernelSSE2;
+		name = "SSE2";
+	}
+#endif /*LODEPNG_FILTER_X86*/
+	filterKernel = kernel;
+	filterSumsKernel = sumsKernel;
+	filterKernelName = name;
+}
+
+static void filterScanline(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+						   size_t length, size_t bytewidth, unsigned char filterType)
+{
+	size_t done = bytewidth < length ? bytewidth : length;
+	if(!filterKernelName) selectFilterKernel();
+	filterScanlineRange(out, scanline, prevline, 0, done, bytewidth, filterType);
+	if(filterKernel) done = filterKernel(out, scanline, prevline, done, length, bytewidth, filterType);
+	filterScanlineRange(out, scanline, prevline, done, length, bytewidth, filterType);
+}
+
+/*the sums of the minimum sum heuristic for all five filter types of a scanline*/
+static void filterSums(size_t sum[5], const unsigned char* scanline, const unsigned char* prevline,
+					   size_t length, size_t bytewidth)
+{
+	size_t done = bytewidth < length ? bytewidth : length;
+	unsigned char type;
+	if(!filterKernelName) selectFilterKernel();
+	for(type = 0; type != 5; ++type) sum[type] = 0;
+	filterSumsRange(sum, scanline, prevline, 0, done, bytewidth);
+	if(filterSumsKernel) done = filterSumsKernel(sum, scanline, prevline, done, length, bytewidth);
+	filterSumsRange(sum, scanline, prevline, done, length, bytewidth);
+}
+
+void lodepng_filter_scanline(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+							 size_t length, size_t bytewidth, unsigned char filterType)
+{
+	filterScanline(out, scanline, prevline, length, bytewidth, filterType);
+}
+
+void lodepng_filter_sums(size_t sum[5], const unsigned char* scanline, const unsigned char* prevline,
+						 size_t length, size_t bytewidth)
+{
+	filterSums(sum, scanline, prevline, length, bytewidth);
+}
+
+const char* lodepng_filter_kernels(void)
+{
+	if(!filterKernelName) selectFilterKernel();
+	return filterKernelName;
+}
+
 /* log2 approximation. A slight bit faster than std::log. */
 static float flog2(float f)
 {
@@ -5132,8 +5755,13 @@ static float flog2(float f)
 	return result + 1.442695f * (f * f * f / 3 - 3 * f * f / 2 + 3 * f - 1.83333f);
 }
 
-static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
-					   const LodePNGColorMode* info, const LodePNGEncoderSettings* settings)
+/*
+Filters h scanlines starting at scanline firstrow of the image. prevline is the unfiltered scanline
+above the first one, or 0 when firstrow is 0.
+*/
+static unsigned filterRows(unsigned char* out, const unsigned char* in, const unsigned char* prevline,
+						   unsigned firstrow, unsigned w, unsigned h,
+						   const LodePNGColorMode* info, const LodePNGEncoderSettings* settings)
 {
 	/*
 	For PNG filter method 0
@@ -5146,7 +5774,6 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
 	size_t linebytes = (w * bpp + 7) / 8;
 	/*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise*/
 	size_t bytewidth = (bpp + 7) / 8;
-	const unsigned char* prevline = 0;
 	unsigned x, y;
 	unsigned error = 0;
 	LodePNGFilterStrategy strategy = settings->filter_strategy;
@@ -5182,62 +5809,32 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
 	}
 	else if(strategy == LFS_MINSUM)
 	{
-		/*adaptive filtering*/
+		/*adaptive filtering: sum all five filters in one pass over the row, then filter with the best*/
 		size_t sum[5];
-		ucvector attempt[5]; /*five filtering attempts, one for each filter type*/
 		size_t smallest = 0;
 		unsigned char type, bestType = 0;
 
-		for(type = 0; type != 5; ++type)
-		{
-			ucvector_init(&attempt[type]);
-			if(!ucvector_resize(&attempt[type], linebytes)) return 83; /*alloc fail*/
-		}
-
-		if(!error)
+		for(y = 0; y != h; ++y)
 		{
-			for(y = 0; y != h; ++y)
+			filterSums(sum, &in[y * linebytes], prevline, linebytes, bytewidth);
+			/*For differences, each byte is treated as signed, values above 127 are negative (converted to
+			signed char). Filtertype 0 isn't a difference though, so it is summed unsigned. This means
+			filtertype 0 is almost never chosen, but that is justified.*/
+			for(type = 0; type != 5; ++type)
 			{
-				/*try the 5 filter types*/
-				for(type = 0; type != 5; ++type)
+				/*check if this is smallest sum (or if type == 0 it's the first case so always store the values)*/
+				if(type == 0 || sum[type] < smallest)
 				{
-					filterScanline(attempt[type].data, &in[y * linebytes], prevline, linebytes, bytewidth, type);
-
-					/*calculate the sum of the result*/
-					sum[type] = 0;
-					if(type == 0)
-					{
-						for(x = 0; x != linebytes; ++x) sum[type] += (unsigned char)(attempt[type].data[x]);
-					}
-					else
-					{
-						for(x = 0; x != linebytes; ++x)
-						{
-							/*For differences, each byte should be treated as signed, values above 127 are negative
-							(converted to signed char). Filtertype 0 isn't a difference though, so use unsigned there.
-							This means filtertype 0 is almost never chosen, but that is justified.*/
-							unsigned char s = attempt[type].data[x];
-							sum[type] += s < 128 ? s : (255U - s);
-						}
-					}
-
-					/*check if this is smallest sum (or if type == 0 it's the first case so always store the values)*/
-					if(type == 0 || sum[type] < smallest)
-					{
-						bestType = type;
-						smallest = sum[type];
-					}
+					bestType = type;
+					smallest = sum[type];
 				}
-
-				prevline = &in[y * linebytes];
-
-				/*now fill the out values*/
-				out[y * (linebytes + 1)] = bestType; /*the first byte of a scanline will be the filter type*/
-				for(x = 0; x != linebytes; ++x) out[y * (linebytes + 1) + 1 + x] = attempt[bestType].data[x];
 			}
-		}
 
-		for(type = 0; type != 5; ++type) ucvector_cleanup(&attempt[type]);
+			/*the first byte of a scanline will be the filter type*/
+			out[y * (linebytes + 1)] = bestType;
+			filterScanline(&out[y * (linebytes + 1) + 1], &in[y * linebytes], prevline, linebytes, bytewidth, bestType);
+			prevline = &in[y * linebytes];
+		}
 	}
 	else if(strategy == LFS_ENTROPY)
 	{
@@ -5291,7 +5888,7 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
 		{
 			size_t outindex = (1 + linebytes) * y; /*the extra filterbyte added to each row*/
 			size_t inindex = linebytes * y;
-			unsigned char type = settings->predefined_filters[y];
+			unsigned char type = settings->predefined_filters[firstrow + y];
 			out[outindex] = type; /*filter type byte*/
 			filterScanline(&out[outindex + 1], &in[inindex], prevline, linebytes, bytewidth, type);
 			prevline = &in[inindex];
@@ -5352,6 +5949,12 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
 	return error;
 }
 
+static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
+					   const LodePNGColorMode* info, const LodePNGEncoderSettings* settings)
+{
+	return filterRows(out, in, 0, 0, w, h, info, settings);
+}
+
 static void addPaddingBits(unsigned char* out, const unsigned char* in,
 						   size_t olinebits, size_t ilinebits, unsigned h)
 {
@@ -5563,6 +6166,112 @@ static unsigned addUnknownChunks(ucvector* out, unsigned char* data, size_t data
 }
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
+/*writes the signature and every chunk that goes before the IDAT chunks*/
+static unsigned addChunks_beforeIDAT(ucvector* outv, unsigned w, unsigned h,
+									 const LodePNGInfo* info, const LodePNGEncoderSettings* settings)
+{
+	/*write signature and chunks*/
+	writeSignature(outv);
+	/*IHDR*/
+	addChunk_IHDR(outv, w, h, info->color.colortype, info->color.bitdepth, info->interlace_method);
+#ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
+	/*unknown chunks between IHDR and PLTE*/
+	if(info->unknown_chunks_data[0])
+	{
+		CERROR_TRY_RETURN(addUnknownChunks(outv, info->unknown_chunks_data[0], info->unknown_chunks_size[0]));
+	}
+#endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
+	/*PLTE*/
+	if(info->color.colortype == LCT_PALETTE)
+	{
+		addChunk_PLTE(outv, &info->color);
+	}
+	if(settings->force_palette && (info->color.colortype == LCT_RGB || info->color.colortype == LCT_RGBA))
+	{
+		addChunk_PLTE(outv, &info->color);
+	}
+	/*tRNS*/
+	if(info->color.colortype == LCT_PALETTE && getPaletteTranslucency(info->color.palette, info->color.palettesize) != 0)
+	{
+		addChunk_tRNS(outv, &info->color);
+	}
+	if((info->color.colortype == LCT_GREY || info->color.colortype == LCT_RGB) && info->color.key_defined)
+	{
+		addChunk_tRNS(outv, &info->color);
+	}
+#ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
+	/*bKGD (must come between PLTE and the IDAt chunks*/
+	if(info->background_defined) addChunk_bKGD(outv, info);
+	/*pHYs (must come before the IDAT chunks)*/
+	if(info->phys_defined) addChunk_pHYs(outv, info);
+
+	/*unknown chunks between PLTE and IDAT*/
+	if(info->unknown_chunks_data[1])
+	{
+		CERROR_TRY_RETURN(addUnknownChunks(outv, info->unknown_chunks_data[1], info->unknown_chunks_size[1]));
+	}
+#endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
+	return 0;
+}
+
+/*writes every chunk that goes after the IDAT chunks, up to and including IEND*/
+static unsigned addChunks_afterIDAT(ucvector* outv, const LodePNGInfo* info, LodePNGEncoderSettings* settings)
+{
+#ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
+	size_t i;
+	/*tIME*/
+	if(info->time_defined) addChunk_tIME(outv, &info->time);
+	/*tEXt and/or zTXt*/
+	for(i = 0; i != info->text_num; ++i)
+	{
+		if(strlen(info->text_keys[i]) > 79) return 66; /*text chunk too large*/
+		if(strlen(info->text_keys[i]) < 1) return 67; /*text chunk too small*/
+		if(settings->text_compression)
+		{
+			addChunk_zTXt(outv, info->text_keys[i], info->text_strings[i], &settings->zlibsettings);
+		}
+		else
+		{
+			addChunk_tEXt(outv, info->text_keys[i], info->text_strings[i]);
+		}
+	}
+	/*LodePNG version id in text chunk*/
+	if(settings->add_id)
+	{
+		unsigned alread_added_id_text = 0;
+		for(i = 0; i != info->text_num; ++i)
+		{
+			if(!strcmp(info->text_keys[i], "LodePNG"))
+			{
+				alread_added_id_text = 1;
+				break;
+			}
+		}
+		if(alread_added_id_text == 0)
+		{
+			addChunk_tEXt(outv, "LodePNG", LODEPNG_VERSION_STRING); /*it's shorter as tEXt than as zTXt chunk*/
+		}
+	}
+	/*iTXt*/
+	for(i = 0; i != info->itext_num; ++i)
+	{
+		if(strlen(info->itext_keys[i]) > 79) return 66; /*text chunk too large*/
+		if(strlen(info->itext_keys[i]) < 1) return 67; /*text chunk too small*/
+		addChunk_iTXt(outv, settings->text_compression,
+			info->itext_keys[i], info->itext_langtags[i], info->itext_transkeys[i], info->itext_strings[i],
+			&settings->zlibsettings);
+	}
+
+	/*unknown chunks between IDAT and IEND*/
+	if(info->unknown_chunks_data[2])
+	{
+		CERROR_TRY_RETURN(addUnknownChunks(outv, info->unknown_chunks_data[2], info->unknown_chunks_size[2]));
+	}
+#endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
+	addChunk_IEND(outv);
+	return 0;
+}
+
 unsigned lodepng_encode(unsigned char** out, size_t* outsize,
 						const unsigned char* image, unsigned w, unsigned h,
 						LodePNGState* state)
@@ -5626,135 +6335,187 @@ unsigned lodepng_encode(unsigned char** out, size_t* outsize,
 	ucvector_init(&outv);
 	while(!state->error) /*while only executed once, to break on error*/
 	{
-#ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
-		size_t i;
-#endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
-		/*write signature and chunks*/
-		writeSignature(&outv);
-		/*IHDR*/
-		addChunk_IHDR(&outv, w, h, info.color.colortype, info.color.bitdepth, info.interlace_method);
-#ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
-		/*unknown chunks between IHDR and PLTE*/
-		if(info.unknown_chunks_data[0])
-		{
-			state->error = addUnknownChunks(&outv, info.unknown_chunks_data[0], info.unknown_chunks_size[0]);
-			if(state->error) break;
-		}
-#endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
-		/*PLTE*/
-		if(info.color.colortype == LCT_PALETTE)
-		{
-			addChunk_PLTE(&outv, &info.color);
-		}
-		if(state->encoder.force_palette && (info.color.colortype == LCT_RGB || info.color.colortype == LCT_RGBA))
-		{
-			addChunk_PLTE(&outv, &info.color);
-		}
-		/*tRNS*/
-		if(info.color.colortype == LCT_PALETTE && getPaletteTranslucency(info.color.palette, info.color.palettesize) != 0)
-		{
-			addChunk_tRNS(&outv, &info.color);
-		}
-		if((info.color.colortype == LCT_GREY || info.color.colortype == LCT_RGB) && info.color.key_defined)
+		state->error = addChunks_beforeIDAT(&outv, w, h, &info, &state->encoder);
+		if(state->error) break;
+		/*IDAT (multiple IDAT chunks must be consecutive)*/
+		state->error = addChunk_IDAT(&outv, data, datasize, &state->encoder.zlibsettings);
+		if(state->error) break;
+		state->error = addChunks_afterIDAT(&outv, &info, &state->encoder);
+
+		break; /*this isn't really a while loop; no error happened so break out now!*/
+	}
+
+	lodepng_info_cleanup(&info);
+	lodepng_free(data);
+	/*instead of cleaning the vector up, give it to the output*/
+	*out = outv.data;
+	*outsize = outv.size;
+
+	return state->error;
+}
+
+#ifdef LODEPNG_COMPILE_ZLIB
+/*wraps data in a chunk of the given type and hands it to the write callback*/
+static unsigned writeChunk(unsigned (*write)(void*, const unsigned char*, size_t), void* user,
+						   const char* type, const unsigned char* data, size_t length)
+{
+	unsigned error;
+	ucvector chunk;
+	ucvector_init(&chunk);
+	error = addChunk(&chunk, type, data, length);
+	if(!error) error = write(user, chunk.data, chunk.size);
+	ucvector_cleanup(&chunk);
+	return error;
+}
+
+unsigned lodepng_encode_stream(unsigned (*write)(void* user, const unsigned char* data, size_t size), void* user,
+							   const unsigned char* image, unsigned w, unsigned h, LodePNGState* state)
+{
+	const LodePNGInfo* info = &state->info_png;
+	const LodePNGCompressSettings* zlibsettings = &state->encoder.zlibsettings;
+	unsigned bpp = lodepng_get_bpp(&info->color);
+	size_t linebytes = ((size_t)w * bpp + 7) / 8;
+	size_t insize = (size_t)h * (linebytes + 1); /*size of the whole filtered image*/
+	size_t blocksize, numdeflateblocks, i;
+	size_t base = 0; /*position of filtered.data[0] in the whole filtered image*/
+	size_t bp = 0; /*the bit pointer*/
+	unsigned filteredrows = 0;
+	unsigned adler = 1;
+	ucvector outv, filtered, deflated;
+	Hash hash;
+
+	state->error = 0;
+	if(state->encoder.auto_convert || info->interlace_method != 0 || bpp < 8
+		|| !lodepng_color_mode_equal(&state->info_raw, &info->color)
+		|| zlibsettings->custom_zlib || zlibsettings->custom_deflate)
+	{
+		CERROR_RETURN_ERROR(state->error, 94); /*error: not supported by the streaming encoder*/
+	}
+	if(zlibsettings->btype > 2) CERROR_RETURN_ERROR(state->error, 61); /*error: unexisting btype*/
+	if(info->color.colortype == LCT_PALETTE && (info->color.palettesize == 0 || info->color.palettesize > 256))
+	{
+		CERROR_RETURN_ERROR(state->error, 68); /*invalid palette size, it is only allowed to be 1-256*/
+	}
+	state->error = checkColorValidity(info->color.colortype, info->color.bitdepth);
+	if(state->error) return state->error;
+
+	/*same deflate blocks as lodepng_deflatev, so the zlib stream comes out the same, except that
+	fixed Huffman coding also gets split into blocks instead of using one for everything*/
+	if(zlibsettings->btype == 0) blocksize = 65535;
+	else
+	{
+		blocksize = insize / 8 + 8;
+		if(blocksize < 65536) blocksize = 65536;
+		if(blocksize > 262144) blocksize = 262144;
+	}
+	numdeflateblocks = (insize + blocksize - 1) / blocksize;
+	if(numdeflateblocks == 0) numdeflateblocks = 1;
+
+	ucvector_init(&outv);
+	ucvector_init(&filtered);
+	ucvector_init(&deflated);
+	if(zlibsettings->btype != 0)
+	{
+		state->error = hash_init(&hash, zlibsettings->windowsize);
+		if(state->error)
 		{
-			addChunk_tRNS(&outv, &info.color);
+			hash_cleanup(&hash);
+			return state->error;
 		}
-#ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
-		/*bKGD (must come between PLTE and the IDAt chunks*/
-		if(info.background_defined) addChunk_bKGD(&outv, &info);
-		/*pHYs (must come before the IDAT chunks)*/
-		if(info.phys_defined) addChunk_pHYs(&outv, &info);
+	}
+
+	state->error = addChunks_beforeIDAT(&outv, w, h, info, &state->encoder);
+	if(!state->error) state->error = write(user, outv.data, outv.size);
 
-		/*unknown chunks between PLTE and IDAT*/
-		if(info.unknown_chunks_data[1])
+	/*zlib header, see lodepng_zlib_compress*/
+	ucvector_push_back(&deflated, 120);
+	ucvector_push_back(&deflated, 1);
+
+	for(i = 0; i != numdeflateblocks && !state->error; ++i)
+	{
+		unsigned final = (i == numdeflateblocks - 1);
+		size_t start = i * blocksize;
+		size_t end = start + blocksize;
+		size_t flushsize, drop;
+		if(end > insize) end = insize;
+
+		/*filter as many scanlines as this block reaches into*/
+		while(base + filtered.size < end)
 		{
-			state->error = addUnknownChunks(&outv, info.unknown_chunks_data[1], info.unknown_chunks_size[1]);
+			size_t oldsize = filtered.size;
+			size_t rows = (end - base - oldsize + linebytes) / (linebytes + 1);
+			if(rows > h - filteredrows) rows = h - filteredrows;
+			if(!ucvector_resize(&filtered, oldsize + rows * (linebytes + 1))) CERROR_BREAK(state->error, 83);
+			state->error = filterRows(&filtered.data[oldsize], &image[filteredrows * linebytes],
+				filteredrows ? &image[(filteredrows - 1) * linebytes] : 0, filteredrows, w, (unsigned)rows,
+				&info->color, &state->encoder);
 			if(state->error) break;
+			filteredrows += (unsigned)rows;
 		}
-#endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
-		/*IDAT (multiple IDAT chunks must be consecutive)*/
-		state->error = addChunk_IDAT(&outv, data, datasize, &state->encoder.zlibsettings);
 		if(state->error) break;
-#ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
-		/*tIME*/
-		if(info.time_defined) addChunk_tIME(&outv, &info.time);
-		/*tEXt and/or zTXt*/
-		for(i = 0; i != info.text_num; ++i)
+
+		adler = update_adler32(adler, &filtered.data[start - base], (unsigned)(end - start));
+		if(zlibsettings->btype == 0)
 		{
-			if(strlen(info.text_keys[i]) > 79)
-			{
-				state->error = 66; /*text chunk too large*/
-				break;
-			}
-			if(strlen(info.text_keys[i]) < 1)
-			{
-				state->error = 67; /*text chunk too small*/
-				break;
-			}
-			if(state->encoder.text_compression)
-			{
-				addChunk_zTXt(&outv, info.text_keys[i], info.text_strings[i], &state->encoder.zlibsettings);
-			}
-			else
-			{
-				addChunk_tEXt(&outv, info.text_keys[i], info.text_strings[i]);
-			}
+			/*a stored block, byte aligned since every block is one*/
+			unsigned LEN = (unsigned)(end - start);
+			unsigned NLEN = 65535 - LEN;
+			size_t j;
+			ucvector_push_back(&deflated, (unsigned char)final);
+			ucvector_push_back(&deflated, (unsigned char)(LEN % 256));
+			ucvector_push_back(&deflated, (unsigned char)(LEN / 256));
+			ucvector_push_back(&deflated, (unsigned char)(NLEN % 256));
+			ucvector_push_back(&deflated, (unsigned char)(NLEN / 256));
+			for(j = start; j != end; ++j) ucvector_push_back(&deflated, filtered.data[j - base]);
 		}
-		/*LodePNG version id in text chunk*/
-		if(state->encoder.add_id)
+		else if(zlibsettings->btype == 1)
 		{
-			unsigned alread_added_id_text = 0;
-			for(i = 0; i != info.text_num; ++i)
-			{
-				if(!strcmp(info.text_keys[i], "LodePNG"))
-				{
-					alread_added_id_text = 1;
-					break;
-				}
-			}
-			if(alread_added_id_text == 0)
-			{
-				addChunk_tEXt(&outv, "LodePNG", LODEPNG_VERSION_STRING); /*it's shorter as tEXt than as zTXt chunk*/
-			}
+			state->error = deflateFixed(&deflated, &bp, &hash, filtered.data, start - base, end - base, zlibsettings, final);
 		}
-		/*iTXt*/
-		for(i = 0; i != info.itext_num; ++i)
+		else
 		{
-			if(strlen(info.itext_keys[i]) > 79)
-			{
-				state->error = 66; /*text chunk too large*/
-				break;
-			}
-			if(strlen(info.itext_keys[i]) < 1)
-			{
-				state->error = 67; /*text chunk too small*/
-				break;
-			}
-			addChunk_iTXt(&outv, state->encoder.text_compression,
-				info.itext_keys[i], info.itext_langtags[i], info.itext_transkeys[i], info.itext_strings[i],
-				&state->encoder.zlibsettings);
+			state->error = deflateDynamic(&deflated, &bp, &hash, filtered.data, start - base, end - base, zlibsettings, final);
 		}
+		if(state->error) break;
+
+		/*hand over the complete bytes; a partly written last byte stays for the next block*/
+		if(final) lodepng_add32bitInt(&deflated, adler);
+		flushsize = (!final && (bp & 7) != 0) ? deflated.size - 1 : deflated.size;
+		state->error = writeChunk(write, user, "IDAT", deflated.data, flushsize);
+		if(state->error) break;
+		if(flushsize != deflated.size) deflated.data[0] = deflated.data[deflated.size - 1];
+		deflated.size -= flushsize;
 
-		/*unknown chunks between IDAT and IEND*/
-		if(info.unknown_chunks_data[2])
+		/*keep the window before the next block. Dropping whole windows leaves every position at
+		the same place in the circular hash buffers*/
+		if(zlibsettings->btype == 0) drop = end - base;
+		else if(end - base > zlibsettings->windowsize)
 		{
-			state->error = addUnknownChunks(&outv, info.unknown_chunks_data[2], info.unknown_chunks_size[2]);
-			if(state->error) break;
+			drop = (end - base - zlibsettings->windowsize) / zlibsettings->windowsize * zlibsettings->windowsize;
+		}
+		else drop = 0;
+		if(drop != 0)
+		{
+			memmove(filtered.data, &filtered.data[drop], filtered.size - drop);
+			filtered.size -= drop;
+			base += drop;
 		}
-#endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
-		addChunk_IEND(&outv);
-
-		break; /*this isn't really a while loop; no error happened so break out now!*/
 	}
 
-	lodepng_info_cleanup(&info);
-	lodepng_free(data);
-	/*instead of cleaning the vector up, give it to the output*/
-	*out = outv.data;
-	*outsize = outv.size;
+	if(!state->error)
+	{
+		outv.size = 0;
+		state->error = addChunks_afterIDAT(&outv, info, &state->encoder);
+		if(!state->error) state->error = write(user, outv.data, outv.size);
+	}
 
+	if(zlibsettings->btype != 0) hash_cleanup(&hash);
+	ucvector_cleanup(&outv);
+	ucvector_cleanup(&filtered);
+	ucvector_cleanup(&deflated);
 	return state->error;
 }
+#endif /*LODEPNG_COMPILE_ZLIB*/
 
 unsigned lodepng_encode_memory(unsigned char** out, size_t* outsize, const unsigned char* image,
 							   unsigned w, unsigned h, LodePNGColorType colortype, unsigned bitdepth)
@@ -5924,6 +6685,10 @@ const char* lodepng_error_text(unsigned code)
 	case 91: return "invalid decompressed idat size";
 	case 92: return "too many pixels, not supported";
 	case 93: return "zero width or height is invalid";
+	/*lodepng_encode_stream only handles the plain cases*/
+	case 94: return "streaming encode needs no auto_convert, no interlacing, at least 8 bits per pixel, "
+		"the raw color mode equal to the PNG's and the built-in deflate";
+	case 95: return "deflate segment ends before it starts";
 	}
 	return "unknown error code";
 }
@@ -290,6 +290,15 @@ struct LodePNGCompressSettings /*deflate = compress*/
   unsigned minmatch; /*mininum lz77 length. 3 is normally best, 6 can be better for some PNGs. Default: 0*/
   unsigned nicematch; /*stop searching if >= this length found. Set to 258 for best compression. Default: 128*/
   unsigned lazymatching; /*use lazy matching: better compression but a bit slower. Default: true*/
+  /*how many earlier positions to try per match search. 0 picks it from the windowsize: windowsize / 8,
+  or all of the window from 8192 up. Default: 0*/
+  unsigned maxchainlength;
+  /*once a match of at least this length is found, search only a quarter of the rest of the chain.
+  0 for off. Default: 0*/
+  unsigned goodmatch;
+  /*try only the latest earlier position with the same hash instead of following hash chains,
+  without lazy matching: the fastest LZ77, for speed over size. Default: 0*/
+  unsigned singleprobe;
 
   /*use custom zlib encoder instead of built in one (default: null)*/
   unsigned (*custom_zlib)(unsigned char**, size_t*,
@@ -667,6 +676,44 @@ unsigned lodepng_inspect(unsigned* w, unsigned* h,
 unsigned lodepng_encode(unsigned char** out, size_t* outsize,
                         const unsigned char* image, unsigned w, unsigned h,
                         LodePNGState* state);
+
+#ifdef LODEPNG_COMPILE_ZLIB
+/*
+Like lodepng_encode, but hands the PNG to write in pieces as it is made instead of building it in
+memory. Scanlines are filtered and compressed one deflate block at a time, so beyond the image
+itself it needs about one block (at most 256 KB) plus the LZ77 window, whatever the image size.
+The zlib stream is the same as lodepng_encode's (fixed Huffman aside, which gets several blocks),
+spread over one IDAT chunk per block.
+Only the plain cases are supported, error 94 otherwise: auto_convert off, info_raw equal to
+info_png.color, no interlacing, at least 8 bits per pixel, no custom_zlib or custom_deflate.
+write returns nonzero to stop; that value is returned as the error.
+*/
+unsigned lodepng_encode_stream(unsigned (*write)(void* user, const unsigned char* data, size_t size), void* user,
+                               const unsigned char* image, unsigned w, unsigned h, LodePNGState* state);
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
+/*
+Applies PNG filter filterType (0-4) to one scanline of length bytes, prevline being the unfiltered
+line above or NULL for the first. The encoder uses SSE2 or AVX2 kernels when the CPU has them;
+these functions are in the public interface only for tests and benchmarks, which compare the
+kernels against the plain C version.
+*/
+void lodepng_filter_scanline(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+                             size_t length, size_t bytewidth, unsigned char filterType);
+void lodepng_filter_scanline_scalar(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+                                    size_t length, size_t bytewidth, unsigned char filterType);
+
+/*
+Sums of the minimum sum heuristic (LFS_MINSUM) of a scanline for filter types 0-4, all computed in
+one pass. Also only public for tests and benchmarks, like the two above.
+*/
+void lodepng_filter_sums(size_t sum[5], const unsigned char* scanline, const unsigned char* prevline,
+                         size_t length, size_t bytewidth);
+void lodepng_filter_sums_scalar(size_t sum[5], const unsigned char* scanline, const unsigned char* prevline,
+                                size_t length, size_t bytewidth);
+
+/*Name of the filter kernels the encoder uses on this CPU: "AVX2", "SSE2" or "scalar"*/
+const char* lodepng_filter_kernels(void);
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
 /*
@@ -787,6 +834,23 @@ unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGCompressSettings* settings);
 
+/*
+Deflates in[start..end) as one piece of a larger deflate stream, so pieces can be compressed in
+parallel and joined. The windowsize bytes before start are the LZ77 dictionary, so matches reach
+back into the previous piece like in a single stream. Unless final, the piece ends with an empty
+stored block (a zlib sync flush), which leaves it on a byte boundary for the next piece. Appends
+to *out like lodepng_deflate.
+*/
+unsigned lodepng_deflate_segment(unsigned char** out, size_t* outsize,
+                                 const unsigned char* in, size_t start, size_t end, unsigned final,
+                                 const LodePNGCompressSettings* settings);
+
+/*Adler32 checksum of data, as stored at the end of a zlib stream*/
+unsigned lodepng_adler32(const unsigned char* data, size_t len);
+
+/*Adler32 of two pieces of data joined, from the checksum of each and the length of the second*/
+unsigned lodepng_adler32_combine(unsigned adler1, unsigned adler2, size_t len2);
+
 #endif /*LODEPNG_COMPILE_ENCODER*/
 #endif /*LODEPNG_COMPILE_ZLIB*/
 